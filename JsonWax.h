@@ -9,13 +9,100 @@
  */
 
 #include <QFile>
-#include <QTextStream>
+#include <QSaveFile>
 #include <QCoreApplication>
+#include <QCryptographicHash>
 #include <QDir>
+#include <QFuture>
+#include <QFutureInterface>
+#include <QMutex>
+#include <QRunnable>
+#include <QSharedPointer>
+#include <QThreadPool>
 #include "JsonWaxParser.h"
 #include "JsonWaxEditor.h"
+#include "JsonWaxBinary.h"
+#include "JsonWaxCodecs.h"
+#include "JsonWaxCompression.h"
+#include "JsonWaxQuery.h"
 #include "JsonWaxSerializer.h"
 
+namespace JsonWaxInternals {
+
+template <typename Function>
+class FutureTask : public QRunnable                                 // Runs function() on a QThreadPool thread, and reports
+{                                                                   // its result to future().
+private:
+    Function FUNCTION;
+    QFutureInterface<bool> RESULT;
+
+public:
+    FutureTask( Function function) : FUNCTION( function)
+    {
+        RESULT.reportStarted();
+    }
+
+    QFuture<bool> future()
+    {
+        return RESULT.future();
+    }
+
+    void run() override
+    {
+        bool result = FUNCTION();
+        RESULT.reportResult( result);
+        RESULT.reportFinished();
+    }
+};
+
+class HashingDevice : public QIODevice                              // Passes what's written on to DEVICE, or what's read from
+{                                                                   // it, and hashes the bytes as they pass.
+private:
+    QIODevice* DEVICE;
+    QCryptographicHash HASH;
+
+public:
+    HashingDevice( QIODevice* device) : DEVICE( device), HASH( QCryptographicHash::Sha1){}
+
+    bool isSequential() const override
+    {
+        return true;
+    }
+
+    QByteArray result() const
+    {
+        return HASH.result().toHex();
+    }
+
+protected:
+    qint64 readData( char* data, qint64 maxSize) override
+    {
+        qint64 read = DEVICE->read( data, maxSize);
+
+        if (read > 0)
+            HASH.addData( data, int( read));
+        return read;
+    }
+
+    qint64 writeData( const char* data, qint64 size) override
+    {
+        qint64 written = DEVICE->write( data, size);
+
+        if (written > 0)
+            HASH.addData( data, int( written));
+        return written;
+    }
+};
+
+struct JournalState                                                 // Shared with a compaction of the journal, which runs
+{                                                                   // on a QThreadPool thread.
+    QMutex MUTEX;                                                   // Held while the journal is written.
+    QByteArray FILE_HASH;                                           // The SHA-1 of the file the journal's changes apply to,
+                                                                    // as it's on disk.
+    bool NEEDS_WHOLE_FILE = false;                                  // A compaction replaced the file, but not the journal.
+};                                                                  // The next save() writes the whole file.
+}
+
 class JsonWax
 {
 private:
@@ -23,13 +110,319 @@ private:
     JsonWaxInternals::Editor* EDITOR = 0;
     QString PROGRAM_PATH;
     QString FILENAME;
+    JsonWaxInternals::Compression COMPRESSION = JsonWaxInternals::Uncompressed;    // The compression of the loaded file.
     JsonWaxInternals::Serializer SERIALIZER;
+    bool IS_JOURNALED = false;
+    bool IS_PARALLEL = false;                                           // See setParallel().
+    JsonWaxInternals::Snapshot* JOURNAL_BASE = nullptr;                 // What the file and its journal contain, if that's known.
+    QSharedPointer<JsonWaxInternals::JournalState> JOURNAL = QSharedPointer<JsonWaxInternals::JournalState>::create();
+    QFuture<bool> COMPACTION;                                           // Of the journal, see appendToJournal().
+
+    QString filePath( const QString& fileName)                          // Relative paths are relative to the program.
+    {
+        QDir dir (fileName);
+        if (dir.isRelative())
+            return PROGRAM_PATH + '/' + fileName;
+        return fileName;
+    }
+
+    static QByteArray journalHeader( const QByteArray& fileHash)        // The first line of a journal. It names the file that
+    {                                                                   // the changes apply to, by the hash of its bytes.
+        return "{\"base\":\"" + fileHash + "\"}\n";
+    }
+
+    bool replaceRoot( JsonWaxInternals::JsonType* root)               // Takes over root, if it isn't nullptr. The indexes are kept.
+    {
+        if (root == nullptr)
+            return false;
+
+        replaceEditor( new JsonWaxInternals::Editor( root));
+        return true;
+    }
+
+    void replaceEditor( JsonWaxInternals::Editor* editor)               // Takes over editor. The indexes are kept for its content.
+    {
+        QList<JsonWaxInternals::ArrayIndex> indexes = EDITOR->indexes();
+        delete EDITOR;
+        EDITOR = editor;
+        EDITOR->setIndexes( indexes);
+        EDITOR->setParallel( IS_PARALLEL);
+    }
+
+    void resetJournalBase()                                             // The file on disk has the current content.
+    {
+        delete JOURNAL_BASE;
+        JOURNAL_BASE = IS_JOURNALED ? new JsonWaxInternals::Snapshot( EDITOR->snapshot()) : nullptr;
+    }
+
+    bool appendToJournal( JsonWaxInternals::StringStyle style, bool convertToCodePoints)  // Appends the changes since the last save to "<file>.journal".
+    {
+        QFile base( filePath( FILENAME));
+        QFile journal( filePath( FILENAME) + ".journal");
+
+        if (JOURNAL_BASE == nullptr || !base.exists())
+            return saveAs( FILENAME, style, convertToCodePoints, true, COMPRESSION);
+
+        Patch patch = EDITOR->diff( *JOURNAL_BASE);
+
+        if (patch.isEmpty())
+            return true;
+
+        QByteArray bytes = patch.toString( Compact, convertToCodePoints).toUtf8() + '\n';
+        {
+            QMutexLocker locker( &JOURNAL->MUTEX);                      // A compaction may be rewriting the journal.
+
+            if (JOURNAL->NEEDS_WHOLE_FILE)
+            {
+                locker.unlock();
+                return saveAs( FILENAME, style, convertToCodePoints, true, COMPRESSION);
+            }
+
+            if (!journal.open( QIODevice::WriteOnly | QIODevice::Append))
+            {
+                qWarning("JsonWax-save error: the journal couldn't be opened: \"%s\"", journal.fileName().toStdString().c_str());
+                return false;
+            }
+
+            qint64 previousSize = journal.size();
+
+            if (previousSize == 0)
+                bytes.prepend( journalHeader( JOURNAL->FILE_HASH));
+
+            if (journal.write( bytes) != bytes.size() || !journal.flush())
+            {
+                journal.resize( previousSize);                          // So the next change isn't written after a broken line.
+                return false;
+            }
+            journal.close();
+        }
+
+        delete JOURNAL_BASE;
+        JOURNAL_BASE = new JsonWaxInternals::Snapshot( EDITOR->snapshot());
+
+        if (journal.size() > base.size() && COMPACTION.isFinished())    // Folding the journal into the file when it outgrows
+            COMPACTION = compactJournalAsync( style, convertToCodePoints);  // it keeps loading fast.
+        return true;
+    }
+
+    QFuture<bool> compactJournalAsync( JsonWaxInternals::StringStyle style, bool convertToCodePoints)    // Writes the whole file on a
+    {                                                                   // QThreadPool thread. The journal then keeps only the
+        QString path = filePath( FILENAME);                             // changes saved meanwhile, under the new file's hash.
+        qint64 journalSize = QFile( path + ".journal").size();          // The changes that JOURNAL_BASE contains.
+        JsonWaxInternals::Snapshot snapshot = *JOURNAL_BASE;
+        QSharedPointer<JsonWaxInternals::JournalState> state = JOURNAL;
+        JsonWaxInternals::Compression compression = COMPRESSION;
+        bool parallel = IS_PARALLEL;
+        auto compact = [snapshot, path, style, convertToCodePoints, compression, parallel, journalSize, state]()
+        {
+            QByteArray hash;
+            QMutexLocker locker( &state->MUTEX);
+            locker.unlock();                                            // Only held from writing the new journal, until it's in place.
+
+            auto writeJournal = [&]( const QByteArray& fileHash)       // As "<file>.journal.pending", before the file is replaced.
+            {                                                           // loadFile() uses it, if the journals weren't swapped.
+                locker.relock();
+                QFile journal( path + ".journal");
+                QSaveFile pending( path + ".journal.pending");
+
+                if (!journal.open( QIODevice::ReadOnly) || !journal.seek( journalSize) || !pending.open( QIODevice::WriteOnly))
+                {
+                    qWarning("JsonWax-save error: the journal couldn't be rewritten for compaction: \"%s\"", journal.fileName().toStdString().c_str());
+                    return false;
+                }
+
+                QByteArray bytes = journalHeader( fileHash) + journal.readAll();
+
+                if (pending.write( bytes) != bytes.size() || !pending.commit())
+                {
+                    qWarning("JsonWax-save error: the journal couldn't be rewritten for compaction: \"%s\"", journal.fileName().toStdString().c_str());
+                    return false;
+                }
+                return true;
+            };
+
+            if (!writeFile( path, compression, [&]( QIODevice* device){ return snapshot.write( device, style, convertToCodePoints, {}, parallel); },
+                            writeJournal, &hash))
+            {
+                QFile::remove( path + ".journal.pending");              // The file and its journal are left as they were.
+                return false;
+            }
+
+            if (!QFile::remove( path + ".journal") || !QFile::rename( path + ".journal.pending", path + ".journal"))
+            {
+                qWarning("JsonWax-save error: the journal couldn't be replaced after compaction: \"%s\"", (path + ".journal").toStdString().c_str());
+                state->NEEDS_WHOLE_FILE = true;
+                return false;
+            }
+            state->FILE_HASH = hash;
+            return true;
+        };
+
+        auto task = new JsonWaxInternals::FutureTask<decltype(compact)>( compact);     // Deleted by the pool.
+        QFuture<bool> future = task->future();
+        QThreadPool::globalInstance()->start( task);
+        return future;
+    }
+
+    bool setJournalAside( QFile& journal, const char* reason)          // Keeps a journal that can't be applied, as
+    {                                                                   // "<file>.journal.rejected", and saves the whole file next.
+        QString aside = journal.fileName() + ".rejected";
+
+        for (int i = 2; QFile::exists( aside); ++i)
+            aside = journal.fileName() + ".rejected" + QString::number(i);
+
+        journal.close();
+        delete JOURNAL_BASE;
+        JOURNAL_BASE = nullptr;
+
+        if (!journal.rename( aside))
+        {
+            qWarning("JsonWax-loadFile error: the journal %s, and couldn't be moved aside: \"%s\"", reason, journal.fileName().toStdString().c_str());
+            return false;
+        }
+        qWarning("JsonWax-loadFile warning: the journal %s. It was moved to \"%s\"", reason, aside.toStdString().c_str());
+        return true;
+    }
+
+    template <typename Write>
+    static bool writeFile( const QString& path, JsonWaxInternals::Compression compression, Write write,    // write( QIODevice*) writes the text.
+                           QByteArray* hash = nullptr, bool isText = true)      // hash is set to the SHA-1 of what was written.
+    {
+        return writeFile( path, compression, write, []( const QByteArray&){ return true; }, hash, isText);
+    }
+
+    template <typename Write, typename BeforeCommit>
+    static bool writeFile( const QString& path, JsonWaxInternals::Compression compression, Write write,    // beforeCommit( hash) is called once
+                           BeforeCommit beforeCommit, QByteArray* hash, bool isText = true)        // all of it is written. If it returns
+    {                                                                                               // false, the file isn't replaced.
+#ifndef JSONWAX_ZLIB
+        if (compression != JsonWaxInternals::Uncompressed)
+        {
+            qWarning("JsonWax-saveAs error: compression needs JSONWAX_ZLIB to be defined. This document wasn't saved.");
+            return false;
+        }
+#endif
+        QSaveFile qfile( path);                                         // Replaces the file only once all of it is written. Where
+        JsonWaxInternals::HashingDevice hashing( &qfile);               // that isn't possible, nothing is written.
+        bool isWritten = false;
+
+        if (!qfile.open( QIODevice::WriteOnly))
+        {
+            qWarning("JsonWax-saveAs error: \"%s\" couldn't be written: %s", path.toStdString().c_str(), qfile.errorString().toStdString().c_str());
+            return false;
+        }
+
+        if (compression != JsonWaxInternals::Uncompressed)
+        {
+#ifdef JSONWAX_ZLIB
+            hashing.open( QIODevice::WriteOnly);
+            JsonWaxInternals::CompressedDevice compressor( &hashing, compression);
+            isWritten = compressor.open( QIODevice::WriteOnly) && write( &compressor);
+            compressor.close();
+            isWritten = isWritten && !compressor.hasError();
+#endif
+        } else {
+            hashing.open( QIODevice::WriteOnly | (isText ? QIODevice::Text : QIODevice::NotOpen));   // Line endings are converted
+            isWritten = write( &hashing);                                                           // before they're hashed.
+        }
+
+        if (!isWritten || !beforeCommit( hashing.result()))
+        {
+            qfile.cancelWriting();                                      // The old file, if any, is left as it was.
+            qfile.commit();
+            return false;
+        }
+
+        if (!qfile.commit())
+        {
+            qWarning("JsonWax-saveAs error: \"%s\" couldn't be replaced: %s", path.toStdString().c_str(), qfile.errorString().toStdString().c_str());
+            return false;
+        }
+
+        if (hash != nullptr)
+            *hash = hashing.result();
+        return true;
+    }
+
+    bool replayJournal()                                                // Applies "<file>.journal" to the loaded file. A journal
+    {                                                                   // that doesn't apply is moved aside, see setJournalAside().
+        QFile journal( filePath( FILENAME) + ".journal");
+        QFile pending( filePath( FILENAME) + ".journal.pending");
+
+        if (pending.open( QIODevice::ReadOnly))                         // Left by a compaction, see compactJournalAsync().
+        {
+            bool isForThisFile = pending.readLine() == journalHeader( JOURNAL->FILE_HASH);
+            pending.close();
+
+            if (!isForThisFile)
+            {
+                pending.remove();                                       // The file wasn't replaced, and the journal still applies.
+            } else if ((journal.exists() && !journal.remove()) || !pending.rename( journal.fileName())) {
+                qWarning("JsonWax-loadFile error: the journal couldn't be replaced by \"%s\"", pending.fileName().toStdString().c_str());
+                delete JOURNAL_BASE;
+                JOURNAL_BASE = nullptr;
+                return false;
+            }
+        }
+
+        if (!journal.exists())
+        {
+            resetJournalBase();
+            return true;
+        }
+
+        delete JOURNAL_BASE;                                            // Unknown until the journal is applied.
+        JOURNAL_BASE = nullptr;
+
+        if (!journal.open( QIODevice::ReadWrite))
+        {
+            qWarning("JsonWax-loadFile error: the journal couldn't be opened: \"%s\"", journal.fileName().toStdString().c_str());
+            return false;
+        }
+
+        if (journal.readLine() != journalHeader( JOURNAL->FILE_HASH))   // It's left over from a save of the whole file that was
+            return setJournalAside( journal, "belongs to another version of the file");    // interrupted, or the file was
+                                                                                            // changed elsewhere.
+        qint64 validSize = journal.pos();
+
+        while (!journal.atEnd())
+        {
+            QByteArray line = journal.readLine();
+
+            if (!line.endsWith('\n'))                                   // The last write was interrupted.
+            {
+                qWarning("JsonWax-loadFile warning: the last change in the journal is incomplete, and was dropped.");
+                journal.resize( validSize);
+                break;
+            }
+
+            if (!applyPatch( line.left( line.size() - 1)))
+                return setJournalAside( journal, "has a change that couldn't be applied");
+
+            validSize = journal.pos();
+        }
+
+        resetJournalBase();
+        return true;
+    }
 
 public:
     typedef JsonWaxInternals::StringStyle StringStyle;
     static const StringStyle Compact = JsonWaxInternals::StringStyle::Compact;
     static const StringStyle Readable = JsonWaxInternals::StringStyle::Readable;
 
+    typedef JsonWaxInternals::Compression Compression;
+    static const Compression Uncompressed = JsonWaxInternals::Compression::Uncompressed;
+    static const Compression Gzip = JsonWaxInternals::Compression::Gzip;
+    static const Compression Zlib = JsonWaxInternals::Compression::Zlib;
+
+    typedef JsonWaxInternals::Batch Batch;
+    typedef JsonWaxInternals::JsonChildren Children;
+    typedef JsonWaxInternals::JsonNode Node;
+    typedef JsonWaxInternals::JsonPath JsonPath;
+    typedef JsonWaxInternals::JsonPatch Patch;
+    typedef JsonWaxInternals::Snapshot Snapshot;
+
     typedef JsonWaxInternals::Type Type;
     static const Type Array = JsonWaxInternals::Type::Array;
     static const Type Null = JsonWaxInternals::Type::Null;
@@ -50,7 +443,9 @@ public:
 
     ~JsonWax()
     {
+        COMPACTION.waitForFinished();
         delete EDITOR;
+        delete JOURNAL_BASE;
     }
 
     int append( const QVariantList& keys, const QVariant& value)
@@ -58,6 +453,53 @@ public:
         return EDITOR->append( keys, value);
     }
 
+    bool apply( const Batch& batch)     // Performs all the recorded operations, or none of them if one is invalid.
+    {                                   // Snapshots taken before and after never contain half of a batch.
+        return EDITOR->apply( batch);
+    }
+
+    bool applyPatch( const Patch& patch)                            // Performs all the operations, or none of them if one fails.
+    {
+        return EDITOR->applyPatch( patch);
+    }
+
+    bool applyPatch( const QByteArray& patchJson)                   // Same, for an RFC 6902 document.
+    {
+        JsonWaxInternals::Parser parser;
+        bool isWellFormed = parser.isWellformed( patchJson);
+        JsonWaxInternals::Editor* editor = parser.getEditorObject();
+        Patch patch;
+        bool isPatch = isWellFormed && patch.read( editor->getPointer( {}));
+        delete editor;                                              // The patch keeps its values.
+
+        if (!isPatch)
+        {
+            qWarning("JsonWax-applyPatch error: not a JSON Patch document.");
+            return false;
+        }
+        return EDITOR->applyPatch( patch);
+    }
+
+    Children children( const QVariantList& keys = {})              // Iterates over the (key, node) pairs of an object or array:
+    {                                                               // for (auto child : json.children({"list"})) child.second.value();
+        return EDITOR->children( keys);                             // Valid until the document is changed.
+    }
+
+    void compact( const QVariantList& keys = {})                    // Frees unused capacity, and packs arrays that can be packed.
+    {
+        EDITOR->compact( keys);
+    }
+
+    bool compactJournal( StringStyle style = Readable, bool convertToCodePoints = false)   // Writes the whole file, and deletes its journal.
+    {
+        if (FILENAME.isEmpty())
+        {
+            qWarning("JsonWax-compactJournal error: no file has been loaded or saved.");
+            return false;
+        }
+        return saveAs( FILENAME, style, convertToCodePoints, true, COMPRESSION);
+    }
+
     void copy( const QVariantList& keysFrom, QVariantList keysTo)
     {
         EDITOR->copy( keysFrom, EDITOR, keysTo);
@@ -68,18 +510,21 @@ public:
         EDITOR->copy( keysFrom, jsonTo.EDITOR, keysTo);
     }
 
+    void createIndex( const QVariantList& arrayKeys, const QVariantList& fieldKeys)    // Makes findBy() O(1) for this array and field.
+    {                                                                                   // The index is kept up to date by all changes.
+        EDITOR->createIndex( arrayKeys, fieldKeys);
+    }
+
     template <class T>
     T deserializeBytes( const QVariantList& keys, const T defaultValue = T())
     {
         if (keys.isEmpty())         // Can't deserialize from root, since it's not a value.
             return defaultValue;
 
-        JsonWaxInternals::JsonType* element = EDITOR->getPointer( keys);
-
-        if (element == nullptr || element->hasType != Type::Value)              // Return default value if the found JsonType is not of type Value.
+        if (!EDITOR->isValue( keys))                                            // Return default value if the found JsonType is not of type Value.
             return defaultValue;
 
-        QVariant value = static_cast<JsonWaxInternals::JsonValue*>(element)->VALUE;
+        QVariant value = EDITOR->value( keys, QVariant());
         return SERIALIZER.deserializeBytes<T>( value.toString().toUtf8());
     }
 
@@ -89,21 +534,17 @@ public:
         if (keys.isEmpty())         // Can't deserialize from root, since it's not a value.
             return;
 
-        JsonWaxInternals::JsonType* element = EDITOR->getPointer( keys);
-
-        if (element == nullptr || element->hasType != Type::Value)
+        if (!EDITOR->isValue( keys))
             return;
 
-        QVariant value = static_cast<JsonWaxInternals::JsonValue*>(element)->VALUE;
+        QVariant value = EDITOR->value( keys, QVariant());
         SERIALIZER.deserializeBytes<T>( value.toString().toUtf8(), outputHere);
     }
 
     template <class T>
     T deserializeJson( const QVariantList& keys, T defaultValue = T())
     {
-        JsonWaxInternals::JsonType* element = EDITOR->getPointer( keys);
-
-        if (element == nullptr)
+        if (!EDITOR->exists( keys))
             return defaultValue;
 
         T value;
@@ -114,14 +555,38 @@ public:
     template <class T>
     void deserializeJson( T& outputHere, const QVariantList& keys)
     {
-        JsonWaxInternals::JsonType* element = EDITOR->getPointer( keys);
-
-        if (element == nullptr)
+        if (!EDITOR->exists( keys))
             return;
 
         SERIALIZER.deserializeJson<T>( EDITOR, keys, outputHere);
     }
 
+    Patch diff( const JsonWax& target)                              // The RFC 6902 operations that turn this document into target.
+    {                                                               // Parts that are shared (fx. after copy()) aren't compared.
+        return EDITOR->diff( target.EDITOR);
+    }
+
+    void dropIndex( const QVariantList& arrayKeys, const QVariantList& fieldKeys)
+    {
+        EDITOR->dropIndex( arrayKeys, fieldKeys);
+    }
+
+    template <class T, class... Args>
+    void emplace( const QVariantList& keys, Args&&... args)     // Fx. emplace<QString>({"line"}, 80, '-') stores 80 dashes.
+    {
+        EDITOR->emplace<T>( keys, std::forward<Args>(args)...);
+    }
+
+    bool equals( const JsonWax& other)                              // Same content, fx. 3 and 3.0 are equal. Parts whose hashes
+    {                                                               // differ aren't compared further, see hash().
+        return EDITOR->equals( {}, other.EDITOR, {});
+    }
+
+    bool equals( const QVariantList& keys, const JsonWax& other, const QVariantList& otherKeys)
+    {
+        return EDITOR->equals( keys, other.EDITOR, otherKeys);
+    }
+
     int errorCode()
     {
         return PARSER.LAST_ERROR;
@@ -142,14 +607,44 @@ public:
         return EDITOR->exists( keys);
     }
 
+    int findBy( const QVariantList& arrayKeys, const QVariantList& fieldKeys, const QVariant& value)   // The position of the first
+    {                                                                                                   // element whose field equals value,
+        return EDITOR->findBy( arrayKeys, fieldKeys, value);                                            // or -1.
+    }
+
+    template <typename Callback>
+    void forEach( const QVariantList& keys, Callback callback)      // Calls callback( const QVariant& key, const Node& node) for
+    {                                                               // every child of the object or array at keys.
+        EDITOR->forEach( keys, callback);
+    }
+
     bool fromByteArray( const QByteArray& bytes)
     {
-        delete EDITOR;
         bool isWellFormed = PARSER.isWellformed( bytes);
-        EDITOR = PARSER.getEditorObject();
+        replaceEditor( PARSER.getEditorObject());
         return isWellFormed;
     }
 
+    bool fromCbor( const QByteArray& bytes)                         // A CBOR (RFC 8949) map or array. Nothing is changed, if it
+    {                                                               // isn't valid.
+        return replaceRoot( JsonWaxInternals::CborReader().read( bytes));
+    }
+
+    bool fromMessagePack( const QByteArray& bytes)                  // A MessagePack map or array. Nothing is changed, if it
+    {                                                               // isn't valid.
+        return replaceRoot( JsonWaxInternals::MessagePackReader().read( bytes));
+    }
+
+    quint64 hash( const QVariantList& keys = {})                    // Equal content has equal hashes. An object or array remembers
+    {                                                               // its hash until it changes. 0 if nothing is at keys.
+        return EDITOR->hash( keys);
+    }
+
+    void insertRange( const QVariantList& keys, int at, const QVariantList& values)
+    {
+        EDITOR->insertRange( keys, at, values);
+    }
+
     bool isArray( const QVariantList& keys)
     {
         return EDITOR->isArray( keys);
@@ -175,27 +670,88 @@ public:
         return EDITOR->keys( keys);
     }
 
-    bool loadFile( const QString& fileName)
-    {
+    bool loadBinary( const QString& fileName)                       // Loads a file written by saveBinary(). The file is mapped into
+    {                                                               // memory, and the elements are created without any parsing.
+        QFile qfile( filePath( fileName));
+
+        if (!qfile.open( QIODevice::ReadOnly))
+            return false;
+
+        JsonWaxInternals::JsonType* root = nullptr;
+        uchar* data = qfile.map( 0, qfile.size());
+
+        if (data != nullptr)
+        {
+            root = JsonWaxInternals::BinaryReader().read( data, qfile.size());
+            qfile.unmap( data);
+        } else {                                                    // Fx. an empty file, which can't be mapped.
+            QByteArray bytes = qfile.readAll();
+            root = JsonWaxInternals::BinaryReader().read( reinterpret_cast<const uchar*>(bytes.constData()), bytes.size());
+        }
+
+        if (!replaceRoot( root))
+        {
+            qWarning("JsonWax-loadBinary error: not a valid binary document: \"%s\"", fileName.toStdString().c_str());
+            return false;
+        }
+        return true;
+    }
+
+    bool loadFile( const QString& fileName)                         // Also applies the changes in "<fileName>.journal", see setJournaled().
+    {                                                               // The text is parsed while it's read, and decompressed for
+        COMPACTION.waitForFinished();                               // gzip and zlib files, so the file isn't held in memory.
         FILENAME = fileName;
-        QDir dir (fileName);
-        QFile qfile;
-        if (dir.isRelative())
-            qfile.setFileName( PROGRAM_PATH + '/' + fileName);
-        else
-            qfile.setFileName( fileName);
+        QFile qfile( filePath( fileName));
 
         if (!qfile.exists())
             return false;
 
-        QTextStream in (&qfile);
-        in.setCodec("UTF-8");
-        /*
-            TODO: Determine correct codec. UTF-8 setting invalidates some ansi characters like "æ,ø,å".
-            So make sure the read file is UTF-8 encoded, then everything will work perfectly.
-        */
         qfile.open(QIODevice::ReadOnly);
-        return fromByteArray( in.readAll().toUtf8());
+        JsonWaxInternals::HashingDevice hashing( &qfile);           // The file's bytes are hashed as they're read, for the
+        hashing.open( QIODevice::ReadOnly);                         // journal's header.
+        COMPRESSION = JsonWaxInternals::compressionOf( qfile.peek(2));
+        bool isWellFormed = false;
+
+        if (COMPRESSION != Uncompressed)
+        {
+#ifdef JSONWAX_ZLIB
+            JsonWaxInternals::CompressedDevice decompressor( &hashing); // The text is parsed as it's decompressed.
+            decompressor.open( QIODevice::ReadOnly);
+            isWellFormed = PARSER.isWellformed( &decompressor);
+
+            if (decompressor.hasError())
+            {
+                delete PARSER.getEditorObject();                    // The document is left as it was.
+                qWarning("JsonWax-loadFile error: the compressed file is damaged: \"%s\"", fileName.toStdString().c_str());
+                return false;
+            }
+#else
+            qWarning("JsonWax-loadFile error: the file is compressed, and JSONWAX_ZLIB isn't defined: \"%s\"", fileName.toStdString().c_str());
+            return false;
+#endif
+        } else {
+            /*
+                TODO: Determine correct codec. The file is read as UTF-8, which invalidates some ansi characters like "æ,ø,å".
+                So make sure the read file is UTF-8 encoded, then everything will work perfectly.
+            */
+            if (hashing.peek(3) == "\xEF\xBB\xBF")                      // A UTF-8 byte order mark is skipped.
+                hashing.read(3);
+            isWellFormed = PARSER.isWellformed( &hashing);
+        }
+
+        replaceEditor( PARSER.getEditorObject());
+
+        if (!isWellFormed)
+            return false;
+
+        hashing.readAll();                                          // Whatever follows the document, so all of the file is hashed.
+        JOURNAL->FILE_HASH = hashing.result();
+        return replayJournal();
+    }
+
+    qint64 memoryUsage( const QVariantList& keys = {})              // Bytes used by the elements, strings and containers at keys.
+    {
+        return EDITOR->memoryUsage( keys);
     }
 
     void move( const QVariantList& keysFrom, const QVariantList& keysTo)
@@ -208,6 +764,11 @@ public:
         EDITOR->move( keysFrom, jsonTo.EDITOR, keysTo);
     }
 
+    void moveFrom( JsonWax&& jsonFrom, const QVariantList& keysTo)     // Moves the whole document, without copying it.
+    {                                                                   // jsonFrom is left empty.
+        jsonFrom.EDITOR->move( {}, EDITOR, keysTo);
+    }
+
     void popFirst( const QVariantList& keys, int removeTimes = 1)
     {
         EDITOR->popFirst( keys, removeTimes);
@@ -223,39 +784,115 @@ public:
         EDITOR->prepend( keys, value);
     }
 
+    QList<QVariantList> query( const JsonPath& path)                // The keys of the elements that match a JSONPath expression,
+    {                                                               // fx. "$.orders[*].items[?(@.qty > 10)].sku". Keep the JsonPath
+        if (!path.isValid())                                        // to avoid compiling it again.
+        {
+            qWarning("JsonWax-query error: %s (position %d in \"%s\")", path.errorToString().toStdString().c_str(),
+                     path.errorPosition(), path.path().toStdString().c_str());
+            return QList<QVariantList>();
+        }
+        return path.keys( EDITOR->getPointer( {}));
+    }
+
+    QVariantList queryValues( const JsonPath& path)                 // The values that match a JSONPath expression. Matching
+    {                                                               // objects and arrays are left out.
+        if (!path.isValid())
+        {
+            qWarning("JsonWax-queryValues error: %s (position %d in \"%s\")", path.errorToString().toStdString().c_str(),
+                     path.errorPosition(), path.path().toStdString().c_str());
+            return QVariantList();
+        }
+        return path.values( EDITOR->getPointer( {}));
+    }
+
     void remove( const QVariantList& keys)
     {
         EDITOR->remove( keys);
     }
 
+    void removeRange( const QVariantList& keys, int from, int count)
+    {
+        EDITOR->removeRange( keys, from, count);
+    }
+
     bool save( StringStyle style = Readable, bool convertToCodePoints = false)
     {
         if (FILENAME.isEmpty())
         {
             qWarning("JsonWax-save error: use saveAs() if you haven't loaded a .json file. This document wasn't saved.");
             return false;
+        } else if (IS_JOURNALED) {
+            return appendToJournal( style, convertToCodePoints);
         } else {
-            return saveAs( FILENAME, style, convertToCodePoints, true);
+            return saveAs( FILENAME, style, convertToCodePoints, true, COMPRESSION);
         }
     }
 
-    bool saveAs( const QString& fileName, StringStyle style = Readable, bool convertToCodePoints = false, bool overwriteAllowed = true)
+    bool saveAs( const QString& fileName, StringStyle style = Readable, bool convertToCodePoints = false, bool overwriteAllowed = true,
+                 Compression compression = Uncompressed)     // Gzip and Zlib compress the text while it's written.
     {
-        QDir dir (fileName);
-        QFile qfile;
-        if (dir.isRelative())
-            qfile.setFileName( PROGRAM_PATH + '/' + fileName);
-        else
-            qfile.setFileName( fileName);
+        QString path = filePath( fileName);
+        bool isLoadedFile = !FILENAME.isEmpty() && filePath( FILENAME) == path;
+        QByteArray hash;
+
+        if (QFile::exists( path) && !overwriteAllowed)
+            return false;
+
+        if (isLoadedFile)
+            COMPACTION.waitForFinished();
 
-        if (qfile.exists() && !overwriteAllowed)
+        if (!writeFile( path, compression, [&]( QIODevice* device){ return EDITOR->write( device, {}, style, convertToCodePoints); }, &hash))
             return false;
 
-        qfile.open( QIODevice::WriteOnly | QIODevice::Text);
-        QByteArray bytes = EDITOR->toByteArray( {}, style, convertToCodePoints);
-        qint64 bytesWritten = qfile.write( bytes);
-        qfile.close();
-        return (bytesWritten == bytes.size());
+        QFile::remove( path + ".journal");                              // The file has every change now.
+        QFile::remove( path + ".journal.pending");
+
+        if (isLoadedFile)
+        {
+            COMPRESSION = compression;
+            JOURNAL->FILE_HASH = hash;
+            JOURNAL->NEEDS_WHOLE_FILE = false;
+            resetJournalBase();
+        }
+        return true;
+    }
+
+    QFuture<bool> saveAsync( const QString& fileName, StringStyle style = Readable, bool convertToCodePoints = false,
+                             Compression compression = Uncompressed)    // Like saveAs(), on a QThreadPool thread. The document is
+    {                                                                   // saved as it is now, and can be changed at once. Wait for
+        QString path = filePath( fileName);                             // the result before saving to the same file again.
+
+        if (!FILENAME.isEmpty() && filePath( FILENAME) == path)
+        {
+            COMPACTION.waitForFinished();
+            COMPRESSION = compression;
+            delete JOURNAL_BASE;                                        // Unknown until the file is written, so the next
+            JOURNAL_BASE = nullptr;                                     // journaled save() writes the whole file.
+        }
+
+        Snapshot snapshot = EDITOR->snapshot();
+        bool parallel = IS_PARALLEL;
+        auto save = [snapshot, path, style, convertToCodePoints, compression, parallel]()
+        {
+            if (!writeFile( path, compression, [&]( QIODevice* device){ return snapshot.write( device, style, convertToCodePoints, {}, parallel); }))
+                return false;
+
+            QFile::remove( path + ".journal");
+            QFile::remove( path + ".journal.pending");
+            return true;
+        };
+
+        auto task = new JsonWaxInternals::FutureTask<decltype(save)>( save);     // Deleted by the pool.
+        QFuture<bool> future = task->future();
+        QThreadPool::globalInstance()->start( task);
+        return future;
+    }
+
+    bool saveBinary( const QString& fileName)                       // A binary copy of the document, see loadBinary().
+    {
+        return writeFile( filePath( fileName), Uncompressed, [&]( QIODevice* device){ return JsonWaxInternals::BinaryWriter().write( EDITOR->getPointer( {}), device); },
+                          nullptr, false);
     }
 
     template <class T>
@@ -281,6 +918,19 @@ public:
         EDITOR->setEmptyObject( keys);
     }
 
+    void setJournaled( bool journaled)                              // When journaled, save() appends the changes since the last save
+    {                                                               // to "<file>.journal", instead of writing the whole file.
+        IS_JOURNALED = journaled;                                   // loadFile() applies them again. The first save() after this
+        delete JOURNAL_BASE;                                        // writes the whole file. A journal that outgrows the file is
+        JOURNAL_BASE = nullptr;                                     // folded into it on a QThreadPool thread.
+    }
+
+    void setParallel( bool parallel)                                // Large documents are serialized on several QThreadPool
+    {                                                               // threads, by toString(), toByteArray(), write() and the
+        IS_PARALLEL = parallel;                                     // saves. The text is the same.
+        EDITOR->setParallel( parallel);
+    }
+
     void setNull( const QVariantList& keys)
     {
         EDITOR->setValue( keys, QVariant());
@@ -291,11 +941,45 @@ public:
         EDITOR->setValue( keys, value);
     }
 
+    void setValue( const QVariantList& keys, QVariant&& value)
+    {
+        EDITOR->setValue( keys, std::move( value));
+    }
+
     int size( const QVariantList& keys = {})
     {
         return EDITOR->size( keys);
     }
 
+    Snapshot snapshot()                 // An immutable version of the document, which other threads can read
+    {                                   // while this document is being changed.
+        return EDITOR->snapshot();
+    }
+
+    void splice( const QVariantList& keys, int from, int removeCount, const QVariantList& values = {})
+    {
+        EDITOR->splice( keys, from, removeCount, values);
+    }
+
+    QByteArray toByteArray( StringStyle style = Readable, bool convertToCodePoints = false, const QVariantList& keys = {})
+    {                                                               // The text of toString() as UTF-8, without a QString between.
+        return EDITOR->toByteArray( keys, style, convertToCodePoints);
+    }
+
+    QByteArray toCbor( const QVariantList& keys = {})               // The element at keys as CBOR. Integers, doubles and
+    {                                                               // QByteArray values keep their types.
+        QByteArray bytes;
+        JsonWaxInternals::TreeEncoder<JsonWaxInternals::CborFormat>::encode( bytes, EDITOR->node( keys));
+        return bytes;
+    }
+
+    QByteArray toMessagePack( const QVariantList& keys = {})        // The element at keys as MessagePack.
+    {
+        QByteArray bytes;
+        JsonWaxInternals::TreeEncoder<JsonWaxInternals::MessagePackFormat>::encode( bytes, EDITOR->node( keys));
+        return bytes;
+    }
+
     QString toString( StringStyle style = Readable, bool convertToCodePoints = false, const QVariantList& keys = {})
     {
         return EDITOR->toString( style, convertToCodePoints, keys);
@@ -311,6 +995,11 @@ public:
         return EDITOR->value( keys, defaultValue);
     }
 
+    bool write( QIODevice* device, StringStyle style = Readable, bool convertToCodePoints = false, const QVariantList& keys = {})
+    {                                                               // The text of toByteArray(), written to an open device
+        return EDITOR->write( device, keys, style, convertToCodePoints);    // 64KB at a time.
+    }
+
 };
 
 #endif // JSONWAX_H
@@ -0,0 +1,518 @@
+#ifndef JSONWAX_BINARY_H
+#define JSONWAX_BINARY_H
+
+/* Original author: Nikolai S | https://github.com/doublejim
+ *
+ * You may use this file under the terms of any of these licenses:
+ * GNU General Public License version 2.0       https://www.gnu.org/licenses/gpl-2.0.html
+ * GNU General Public License version 3         https://www.gnu.org/licenses/gpl-3.0.html
+ */
+
+#include <QByteArray>
+#include <QHash>
+#include <QIODevice>
+#include <QString>
+#include <QVector>
+#include <QtEndian>
+#include <cstring>
+#include "JsonWaxEditor.h"
+
+namespace JsonWaxInternals {
+
+// The binary format is a copy of the element tree, which loads without tokenizing, unescaping or
+// converting numbers. Every string (keys and values) is stored once, as UTF-16, in a string table
+// with an offset table in front of it, so each string is loaded with a single copy, and repeated
+// strings share their memory. Numbers are stored as they are in memory, and packed arrays as one
+// block. Everything is little-endian.
+//
+//     "JWAXBIN" 1                  Magic, and the version.
+//     quint32 stringCount
+//     quint32 offsets[ stringCount + 1]        In UTF-16 code units, from the start of the string data.
+//     quint16 strings[ offsets[ stringCount]]
+//     element                      The root.
+//
+// An element is a BinaryTag, followed by:
+//
+//     NULL, FALSE, TRUE            Nothing.
+//     INT, UINT                    4 bytes.
+//     LONG_LONG, ULONG_LONG        8 bytes.
+//     DOUBLE                       8 bytes.
+//     STRING                       quint32 string index.
+//     OBJECT                       quint32 count, and count times: quint32 key index, element. Sorted by key.
+//     ARRAY                        quint32 count, and count elements.
+//     SPARSE_ARRAY                 quint32 size, quint32 count, and count times: quint32 position, element.
+//     PACKED_INT, PACKED_LONG_LONG quint32 count, and count qint64.
+//     PACKED_DOUBLE                quint32 count, and count doubles.
+//     PACKED_BOOL                  quint32 count, and count bytes.
+
+enum BinaryTag : quint8 {BINARY_NULL, BINARY_FALSE, BINARY_TRUE, BINARY_INT, BINARY_UINT, BINARY_LONG_LONG,
+                         BINARY_ULONG_LONG, BINARY_DOUBLE, BINARY_STRING, BINARY_OBJECT, BINARY_ARRAY,
+                         BINARY_SPARSE_ARRAY, BINARY_PACKED_INT, BINARY_PACKED_LONG_LONG, BINARY_PACKED_DOUBLE,
+                         BINARY_PACKED_BOOL};
+
+static const char BINARY_MAGIC[8] = {'J', 'W', 'A', 'X', 'B', 'I', 'N', 1};
+
+class BinaryWriter
+{
+private:
+    QByteArray ELEMENTS;
+    QHash<QString, quint32> STRING_INDEXES;
+    QVector<QString> STRINGS;
+
+    template <class T>
+    static void put( QByteArray& bytes, T number)
+    {
+        number = qToLittleEndian( number);
+        bytes.append( reinterpret_cast<const char*>(&number), sizeof(T));
+    }
+
+    static quint64 bitsOf( double number)
+    {
+        quint64 bits;
+        std::memcpy( &bits, &number, sizeof(bits));
+        return bits;
+    }
+
+    template <class T>
+    void putBlock( const QVector<T>& buffer, int from, int count)  // T is 8 bytes.
+    {
+        put( ELEMENTS, quint32( count));
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+        ELEMENTS.append( reinterpret_cast<const char*>(buffer.constData() + from), count * int(sizeof(T)));
+#else
+        for (int i = from; i < from + count; ++i)
+        {
+            quint64 bits;
+            std::memcpy( &bits, &buffer.at(i), sizeof(bits));
+            put( ELEMENTS, bits);
+        }
+#endif
+    }
+
+    quint32 stringIndex( const QString& text)
+    {
+        auto it = STRING_INDEXES.constFind( text);
+
+        if (it != STRING_INDEXES.constEnd())
+            return it.value();
+
+        STRINGS.append( text);
+        STRING_INDEXES.insert( text, quint32( STRINGS.size() - 1));
+        return quint32( STRINGS.size() - 1);
+    }
+
+    void writeValue( const QVariant& value)
+    {
+        switch (static_cast<QMetaType::Type>(value.type()))
+        {
+        case QMetaType::Bool:
+            ELEMENTS.append( char( value.toBool() ? BINARY_TRUE : BINARY_FALSE));
+            break;
+        case QMetaType::Int:
+            ELEMENTS.append( char( BINARY_INT));
+            put( ELEMENTS, qint32( value.toInt()));
+            break;
+        case QMetaType::UInt:
+            ELEMENTS.append( char( BINARY_UINT));
+            put( ELEMENTS, quint32( value.toUInt()));
+            break;
+        case QMetaType::LongLong:
+            ELEMENTS.append( char( BINARY_LONG_LONG));
+            put( ELEMENTS, qint64( value.toLongLong()));
+            break;
+        case QMetaType::ULongLong:
+            ELEMENTS.append( char( BINARY_ULONG_LONG));
+            put( ELEMENTS, quint64( value.toULongLong()));
+            break;
+        case QMetaType::Double: case QMetaType::Float:
+            ELEMENTS.append( char( BINARY_DOUBLE));
+            put( ELEMENTS, bitsOf( value.toDouble()));
+            break;
+        case QMetaType::QString: case QMetaType::QChar:
+            ELEMENTS.append( char( BINARY_STRING));
+            put( ELEMENTS, stringIndex( value.toString()));
+            break;
+        default:                                                    // Null, and what toString() would write as ERROR.
+            ELEMENTS.append( char( BINARY_NULL));
+        }
+    }
+
+    void writeArray( JsonArray* array)
+    {
+        int count = array->size();
+
+        switch (array->PACKING)
+        {
+        case JsonArray::PACKED_INT:
+            ELEMENTS.append( char( BINARY_PACKED_INT));
+            putBlock( array->PACKED_INTEGERS, array->PACKED_FRONT, count);
+            return;
+        case JsonArray::PACKED_LONG_LONG:
+            ELEMENTS.append( char( BINARY_PACKED_LONG_LONG));
+            putBlock( array->PACKED_INTEGERS, array->PACKED_FRONT, count);
+            return;
+        case JsonArray::PACKED_DOUBLE:
+            ELEMENTS.append( char( BINARY_PACKED_DOUBLE));
+            putBlock( array->PACKED_DOUBLES, array->PACKED_FRONT, count);
+            return;
+        case JsonArray::PACKED_BOOL:
+            ELEMENTS.append( char( BINARY_PACKED_BOOL));
+            put( ELEMENTS, quint32( count));
+
+            for (int i = 0; i < count; ++i)
+                ELEMENTS.append( char( array->PACKED_BOOLS.at( array->PACKED_FRONT + i)));
+            return;
+        default:
+            break;
+        }
+
+        if (array->IS_SPARSE)
+        {
+            ELEMENTS.append( char( BINARY_SPARSE_ARRAY));
+            put( ELEMENTS, quint32( array->SPARSE_SIZE));
+            put( ELEMENTS, quint32( array->SPARSE_ELEMENTS.size()));
+
+            for (auto it = array->SPARSE_ELEMENTS.cbegin(); it != array->SPARSE_ELEMENTS.cend(); ++it)
+            {
+                put( ELEMENTS, quint32( it.key()));
+                writeElement( it.value());
+            }
+            return;
+        }
+
+        ELEMENTS.append( char( BINARY_ARRAY));
+        put( ELEMENTS, quint32( count));
+
+        for (JsonType* element : qAsConst( array->ARRAY))
+            writeElement( element);
+    }
+
+    void writeElement( JsonType* element)
+    {
+        switch (element->hasType)
+        {
+        case Type::Object:
+        {
+            const QMap<QString, JsonType*>& map = static_cast<JsonObject*>(element)->MAP;
+            ELEMENTS.append( char( BINARY_OBJECT));
+            put( ELEMENTS, quint32( map.size()));
+
+            for (auto it = map.cbegin(); it != map.cend(); ++it)
+            {
+                put( ELEMENTS, stringIndex( it.key()));
+                writeElement( it.value());
+            }
+            break;
+        }
+        case Type::Array:
+            writeArray( static_cast<JsonArray*>(element));
+            break;
+        default:
+            writeValue( static_cast<JsonValue*>(element)->VALUE);
+        }
+    }
+
+public:
+    bool write( JsonType* root, QIODevice* device)                  // The strings are only known once the elements are
+    {                                                               // written, so the elements are buffered.
+        ELEMENTS.clear();
+        STRING_INDEXES.clear();
+        STRINGS.clear();
+        writeElement( root);
+
+        QByteArray header( BINARY_MAGIC, sizeof(BINARY_MAGIC));
+        put( header, quint32( STRINGS.size()));
+        quint32 offset = 0;
+        put( header, offset);
+
+        for (const QString& text : qAsConst( STRINGS))
+        {
+            offset += quint32( text.size());
+            put( header, offset);
+        }
+
+        QByteArray strings;
+        strings.reserve( int(offset) * 2);
+
+        for (const QString& text : qAsConst( STRINGS))
+        {
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+            strings.append( reinterpret_cast<const char*>(text.utf16()), text.size() * 2);
+#else
+            for (QChar c : text)
+                put( strings, c.unicode());
+#endif
+        }
+
+        bool isWritten = (device->write( header) == header.size() && device->write( strings) == strings.size()
+                          && device->write( ELEMENTS) == ELEMENTS.size());
+        ELEMENTS.clear();
+        STRING_INDEXES.clear();
+        STRINGS.clear();
+        return isWritten;
+    }
+};
+
+class BinaryReader
+{
+private:
+    const uchar* POSITION = nullptr;
+    const uchar* END = nullptr;
+    QVector<QString> STRINGS;
+    bool IS_VALID = true;
+    int DEPTH = 0;
+    static const int MAX_DEPTH = 1000;                              // Deeper documents are refused, instead of overflowing the stack.
+
+    bool has( qint64 bytes)                                         // Anything that would read past the end makes the
+    {                                                               // document invalid.
+        if (END - POSITION < bytes)
+            IS_VALID = false;
+        return IS_VALID;
+    }
+
+    template <class T>
+    T take()
+    {
+        if (!has( sizeof(T)))
+            return T(0);
+
+        T number = qFromLittleEndian<T>( POSITION);
+        POSITION += sizeof(T);
+        return number;
+    }
+
+    double takeDouble()
+    {
+        quint64 bits = take<quint64>();
+        double number;
+        std::memcpy( &number, &bits, sizeof(number));
+        return number;
+    }
+
+    QString takeString()
+    {
+        quint32 index = take<quint32>();
+
+        if (index >= quint32( STRINGS.size()))
+        {
+            IS_VALID = false;
+            return QString();
+        }
+        return STRINGS.at( int(index));
+    }
+
+    quint32 takeCount( int minimumBytesEach)                        // Every element takes at least one byte, so a count that
+    {                                                               // doesn't fit in the rest of the document is invalid.
+        quint32 count = take<quint32>();
+        has( qint64( count) * minimumBytesEach);
+        return IS_VALID ? count : 0;
+    }
+
+    template <class T>
+    void takeBlock( QVector<T>& buffer, quint32 count)              // T is 8 bytes.
+    {
+        buffer.resize( int(count));
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+        std::memcpy( buffer.data(), POSITION, count * sizeof(T));
+        POSITION += count * sizeof(T);
+#else
+        for (quint32 i = 0; i < count; ++i)
+        {
+            quint64 bits = take<quint64>();
+            std::memcpy( &buffer[ int(i)], &bits, sizeof(bits));
+        }
+#endif
+    }
+
+    JsonArray* readPacked( JsonArray::Packing packing)
+    {
+        JsonArray* array = new JsonArray();
+        array->PACKING = packing;
+
+        switch (packing)
+        {
+        case JsonArray::PACKED_BOOL:
+        {
+            quint32 count = takeCount( 1);
+            array->PACKED_BOOLS.resize( int(count));
+
+            for (quint32 i = 0; i < count; ++i)
+                array->PACKED_BOOLS[ int(i)] = (POSITION[i] != 0);
+            POSITION += count;
+            break;
+        }
+        case JsonArray::PACKED_DOUBLE:
+            takeBlock( array->PACKED_DOUBLES, takeCount( 8));
+            break;
+        default:
+            takeBlock( array->PACKED_INTEGERS, takeCount( 8));
+        }
+        return array;
+    }
+
+    JsonType* readElement()                                         // nullptr if the document is invalid.
+    {
+        if (!has(1))
+            return nullptr;
+
+        if (++DEPTH > MAX_DEPTH)
+        {
+            IS_VALID = false;
+            return nullptr;
+        }
+
+        BinaryTag tag = BinaryTag( *POSITION++);
+        JsonType* element = nullptr;
+
+        switch (tag)
+        {
+        case BINARY_NULL:           element = new JsonValue(); break;
+        case BINARY_FALSE:          element = new JsonValue( false); break;
+        case BINARY_TRUE:           element = new JsonValue( true); break;
+        case BINARY_INT:            element = new JsonValue( int( take<qint32>())); break;
+        case BINARY_UINT:           element = new JsonValue( uint( take<quint32>())); break;
+        case BINARY_LONG_LONG:      element = new JsonValue( qlonglong( take<qint64>())); break;
+        case BINARY_ULONG_LONG:     element = new JsonValue( qulonglong( take<quint64>())); break;
+        case BINARY_DOUBLE:         element = new JsonValue( takeDouble()); break;
+        case BINARY_STRING:         element = new JsonValue( takeString()); break;
+        case BINARY_PACKED_INT:         element = readPacked( JsonArray::PACKED_INT); break;
+        case BINARY_PACKED_LONG_LONG:   element = readPacked( JsonArray::PACKED_LONG_LONG); break;
+        case BINARY_PACKED_DOUBLE:      element = readPacked( JsonArray::PACKED_DOUBLE); break;
+        case BINARY_PACKED_BOOL:        element = readPacked( JsonArray::PACKED_BOOL); break;
+        case BINARY_OBJECT:
+        {
+            JsonObject* object = new JsonObject();
+            element = object;
+            quint32 count = takeCount( 5);
+
+            for (quint32 i = 0; i < count && IS_VALID; ++i)
+            {
+                QString key = takeString();
+
+                if (i > 0 && !(object->MAP.lastKey() < key))        // The keys must be sorted, and unique.
+                    IS_VALID = false;
+
+                JsonType* child = IS_VALID ? readElement() : nullptr;
+
+                if (child != nullptr)
+                    object->MAP.insert( object->MAP.cend(), key, child);
+            }
+            break;
+        }
+        case BINARY_ARRAY:
+        {
+            JsonArray* array = new JsonArray();
+            element = array;
+            quint32 count = takeCount( 1);
+            array->ARRAY.reserve( int(count));
+
+            for (quint32 i = 0; i < count && IS_VALID; ++i)
+            {
+                JsonType* child = readElement();
+
+                if (child != nullptr)
+                    array->ARRAY.append( child);
+            }
+            break;
+        }
+        case BINARY_SPARSE_ARRAY:
+        {
+            JsonArray* array = new JsonArray();
+            element = array;
+            array->IS_SPARSE = true;
+            array->SPARSE_SIZE = int( take<quint32>());
+            quint32 count = takeCount( 5);
+
+            if (array->SPARSE_SIZE < 0)
+                IS_VALID = false;
+
+            for (quint32 i = 0; i < count && IS_VALID; ++i)
+            {
+                int position = int( take<quint32>());
+
+                if (position < 0 || position >= array->SPARSE_SIZE || (i > 0 && position <= array->SPARSE_ELEMENTS.lastKey()))
+                    IS_VALID = false;
+
+                JsonType* child = IS_VALID ? readElement() : nullptr;
+
+                if (child != nullptr)
+                    array->SPARSE_ELEMENTS.insert( array->SPARSE_ELEMENTS.cend(), position, child);
+            }
+            break;
+        }
+        default:
+            IS_VALID = false;
+        }
+
+        --DEPTH;
+
+        if (!IS_VALID)
+        {
+            release( element);
+            return nullptr;
+        }
+        return element;
+    }
+
+public:
+    JsonType* read( const uchar* data, qint64 size)                 // The root, or nullptr if the document isn't valid.
+    {
+        POSITION = data;
+        END = data + size;
+        DEPTH = 0;
+        IS_VALID = (size >= qint64( sizeof(BINARY_MAGIC)) && std::memcmp( data, BINARY_MAGIC, sizeof(BINARY_MAGIC)) == 0);
+        POSITION += sizeof(BINARY_MAGIC);
+
+        quint32 stringCount = takeCount( 4);
+        const uchar* offsets = POSITION;
+        has( (qint64( stringCount) + 1) * 4);
+
+        if (!IS_VALID)
+            return nullptr;
+
+        POSITION += (qint64( stringCount) + 1) * 4;
+        quint32 characterCount = qFromLittleEndian<quint32>( offsets + qint64( stringCount) * 4);
+
+        if (!has( qint64( characterCount) * 2))
+            return nullptr;
+
+        STRINGS.clear();
+        STRINGS.reserve( int( stringCount));
+        quint32 start = 0;
+
+        for (quint32 i = 1; i <= stringCount && IS_VALID; ++i)
+        {
+            quint32 end = qFromLittleEndian<quint32>( offsets + qint64(i) * 4);
+
+            if (end < start || end > characterCount)
+            {
+                IS_VALID = false;
+                break;
+            }
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+            STRINGS.append( QString( reinterpret_cast<const QChar*>(POSITION + start * 2), int(end - start)));
+#else
+            QString text( int(end - start), Qt::Uninitialized);
+
+            for (quint32 c = start; c < end; ++c)
+                text[ int(c - start)] = QChar( qFromLittleEndian<quint16>( POSITION + c * 2));
+            STRINGS.append( text);
+#endif
+            start = end;
+        }
+
+        POSITION += qint64( characterCount) * 2;
+        JsonType* root = IS_VALID ? readElement() : nullptr;
+        STRINGS.clear();
+
+        if (root != nullptr && (POSITION != END || root->hasType == Type::Value))     // Like JSON documents, the root is an
+        {                                                                               // object or an array.
+            release( root);
+            root = nullptr;
+        }
+        return root;
+    }
+};
+}
+
+#endif // JSONWAX_BINARY_H
@@ -0,0 +1,694 @@
+#ifndef JSONWAX_CODECS_H
+#define JSONWAX_CODECS_H
+
+/* Original author: Nikolai S | https://github.com/doublejim
+ *
+ * You may use this file under the terms of any of these licenses:
+ * GNU General Public License version 2.0       https://www.gnu.org/licenses/gpl-2.0.html
+ * GNU General Public License version 3         https://www.gnu.org/licenses/gpl-3.0.html
+ */
+
+#include <QByteArray>
+#include <QString>
+#include <QVariant>
+#include <QtEndian>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include "JsonWaxEditor.h"
+
+namespace JsonWaxInternals {
+
+// CBOR (RFC 8949) and MessagePack codecs. They encode straight from the elements, and decode
+// straight into new elements, so there's no text in between. Integers, doubles and byte
+// strings (QByteArray values) keep their types. Objects have string keys; integer keys are
+// decoded as their decimal text, like JSON would have them.
+
+static QVariant integerValue( qint64 number)                       // Ints where they fit, like the Parser.
+{
+    if (number >= std::numeric_limits<int>::min() && number <= std::numeric_limits<int>::max())
+        return QVariant( int( number));
+    return QVariant( qlonglong( number));
+}
+
+static QVariant unsignedValue( quint64 number)
+{
+    if (number <= quint64( std::numeric_limits<qint64>::max()))
+        return integerValue( qint64( number));
+    return QVariant( qulonglong( number));
+}
+
+template <class T>
+static void putBigEndian( QByteArray& out, T number)
+{
+    number = qToBigEndian( number);
+    out.append( reinterpret_cast<const char*>(&number), sizeof(T));
+}
+
+static quint64 bitsOfDouble( double number)
+{
+    quint64 bits;
+    std::memcpy( &bits, &number, sizeof(bits));
+    return bits;
+}
+
+class CborFormat
+{
+private:
+    static void head( QByteArray& out, quint8 major, quint64 argument)     // The shortest form of the argument.
+    {
+        char type = char( major << 5);
+
+        if (argument < 24)
+            out.append( char( type | char( argument)));
+        else if (argument <= 0xff) {
+            out.append( char( type | 24));
+            out.append( char( argument));
+        } else if (argument <= 0xffff) {
+            out.append( char( type | 25));
+            putBigEndian( out, quint16( argument));
+        } else if (argument <= 0xffffffffULL) {
+            out.append( char( type | 26));
+            putBigEndian( out, quint32( argument));
+        } else {
+            out.append( char( type | 27));
+            putBigEndian( out, quint64( argument));
+        }
+    }
+
+public:
+    static void putNull( QByteArray& out)                   { out.append( char(0xf6)); }
+    static void putBool( QByteArray& out, bool value)       { out.append( char( value ? 0xf5 : 0xf4)); }
+    static void putUnsigned( QByteArray& out, quint64 value){ head( out, 0, value); }
+    static void putArray( QByteArray& out, int count)       { head( out, 4, quint64( count)); }
+    static void putMap( QByteArray& out, int count)         { head( out, 5, quint64( count)); }
+
+    static void putInteger( QByteArray& out, qint64 value)
+    {
+        if (value >= 0)
+            head( out, 0, quint64( value));
+        else
+            head( out, 1, quint64( -1 - value));
+    }
+
+    static void putDouble( QByteArray& out, double value)
+    {
+        out.append( char(0xfb));
+        putBigEndian( out, bitsOfDouble( value));
+    }
+
+    static void putString( QByteArray& out, const QString& value)
+    {
+        QByteArray utf8 = value.toUtf8();
+        head( out, 3, quint64( utf8.size()));
+        out.append( utf8);
+    }
+
+    static void putBytes( QByteArray& out, const QByteArray& value)
+    {
+        head( out, 2, quint64( value.size()));
+        out.append( value);
+    }
+};
+
+class MessagePackFormat
+{
+private:
+    static void head( QByteArray& out, int fixed, int fixedLimit, quint8 type16, quint64 count)    // Strings, arrays
+    {                                                                                               // and maps.
+        if (count < quint64( fixedLimit))
+            out.append( char( fixed | int( count)));
+        else if (count <= 0xffff) {
+            out.append( char( type16));
+            putBigEndian( out, quint16( count));
+        } else {
+            out.append( char( type16 + 1));
+            putBigEndian( out, quint32( count));
+        }
+    }
+
+public:
+    static void putNull( QByteArray& out)                   { out.append( char(0xc0)); }
+    static void putBool( QByteArray& out, bool value)       { out.append( char( value ? 0xc3 : 0xc2)); }
+    static void putArray( QByteArray& out, int count)       { head( out, 0x90, 16, 0xdc, quint64( count)); }
+    static void putMap( QByteArray& out, int count)         { head( out, 0x80, 16, 0xde, quint64( count)); }
+
+    static void putUnsigned( QByteArray& out, quint64 value)
+    {
+        if (value < 0x80)
+            out.append( char( value));
+        else if (value <= 0xff) {
+            out.append( char(0xcc));
+            out.append( char( value));
+        } else if (value <= 0xffff) {
+            out.append( char(0xcd));
+            putBigEndian( out, quint16( value));
+        } else if (value <= 0xffffffffULL) {
+            out.append( char(0xce));
+            putBigEndian( out, quint32( value));
+        } else {
+            out.append( char(0xcf));
+            putBigEndian( out, quint64( value));
+        }
+    }
+
+    static void putInteger( QByteArray& out, qint64 value)
+    {
+        if (value >= 0)
+            putUnsigned( out, quint64( value));
+        else if (value >= -32)
+            out.append( char( value));                                  // Negative fixint.
+        else if (value >= -128) {
+            out.append( char(0xd0));
+            out.append( char( value));
+        } else if (value >= -32768) {
+            out.append( char(0xd1));
+            putBigEndian( out, qint16( value));
+        } else if (value >= std::numeric_limits<qint32>::min()) {
+            out.append( char(0xd2));
+            putBigEndian( out, qint32( value));
+        } else {
+            out.append( char(0xd3));
+            putBigEndian( out, qint64( value));
+        }
+    }
+
+    static void putDouble( QByteArray& out, double value)
+    {
+        out.append( char(0xcb));
+        putBigEndian( out, bitsOfDouble( value));
+    }
+
+    static void putString( QByteArray& out, const QString& value)
+    {
+        QByteArray utf8 = value.toUtf8();
+
+        if (utf8.size() < 32)
+            out.append( char( 0xa0 | utf8.size()));
+        else if (utf8.size() <= 0xff) {
+            out.append( char(0xd9));
+            out.append( char( utf8.size()));
+        } else if (utf8.size() <= 0xffff) {
+            out.append( char(0xda));
+            putBigEndian( out, quint16( utf8.size()));
+        } else {
+            out.append( char(0xdb));
+            putBigEndian( out, quint32( utf8.size()));
+        }
+        out.append( utf8);
+    }
+
+    static void putBytes( QByteArray& out, const QByteArray& value)
+    {
+        if (value.size() <= 0xff) {
+            out.append( char(0xc4));
+            out.append( char( value.size()));
+        } else if (value.size() <= 0xffff) {
+            out.append( char(0xc5));
+            putBigEndian( out, quint16( value.size()));
+        } else {
+            out.append( char(0xc6));
+            putBigEndian( out, quint32( value.size()));
+        }
+        out.append( value);
+    }
+};
+
+template <class Format>
+class TreeEncoder                                                   // Format is CborFormat or MessagePackFormat.
+{
+private:
+    static void encodeValue( QByteArray& out, const QVariant& value)
+    {
+        switch (static_cast<QMetaType::Type>(value.type()))
+        {
+        case QMetaType::Bool:                                   Format::putBool( out, value.toBool()); break;
+        case QMetaType::Int: case QMetaType::LongLong:          Format::putInteger( out, value.toLongLong()); break;
+        case QMetaType::UInt: case QMetaType::ULongLong:        Format::putUnsigned( out, value.toULongLong()); break;
+        case QMetaType::Double: case QMetaType::Float:          Format::putDouble( out, value.toDouble()); break;
+        case QMetaType::QString: case QMetaType::QChar:         Format::putString( out, value.toString()); break;
+        case QMetaType::QByteArray:                             Format::putBytes( out, value.toByteArray()); break;
+        default:                                                Format::putNull( out);     // Null, and what toString()
+        }                                                                                   // would write as ERROR.
+    }
+
+    static void encodeArray( QByteArray& out, JsonArray* array)
+    {
+        int count = array->size();
+        int front = array->PACKED_FRONT;
+        Format::putArray( out, count);
+
+        switch (array->PACKING)                                     // Packed numbers are read from the buffer, without a QVariant.
+        {
+        case JsonArray::PACKED_INT: case JsonArray::PACKED_LONG_LONG:
+            for (int i = 0; i < count; ++i)
+                Format::putInteger( out, array->PACKED_INTEGERS.at( front + i));
+            return;
+        case JsonArray::PACKED_DOUBLE:
+            for (int i = 0; i < count; ++i)
+                Format::putDouble( out, array->PACKED_DOUBLES.at( front + i));
+            return;
+        case JsonArray::PACKED_BOOL:
+            for (int i = 0; i < count; ++i)
+                Format::putBool( out, array->PACKED_BOOLS.at( front + i));
+            return;
+        default:
+            for (int i = 0; i < count; ++i)
+            {
+                JsonType* element = array->at(i);
+
+                if (element == nullptr)                             // A hole.
+                    Format::putNull( out);
+                else
+                    encode( out, element);
+            }
+        }
+    }
+
+public:
+    static void encode( QByteArray& out, JsonType* element)
+    {
+        switch (element->hasType)
+        {
+        case Type::Object:
+        {
+            const QMap<QString, JsonType*>& map = static_cast<JsonObject*>(element)->MAP;
+            Format::putMap( out, map.size());
+
+            for (auto it = map.cbegin(); it != map.cend(); ++it)
+            {
+                Format::putString( out, it.key());
+                encode( out, it.value());
+            }
+            break;
+        }
+        case Type::Array:
+            encodeArray( out, static_cast<JsonArray*>(element));
+            break;
+        default:
+            encodeValue( out, static_cast<JsonValue*>(element)->VALUE);
+        }
+    }
+
+    static void encode( QByteArray& out, const JsonNode& node)     // Also a packed element or a hole.
+    {
+        if (node.element() != nullptr)
+            encode( out, node.element());
+        else if (node.exists())
+            encodeValue( out, node.value());
+    }
+};
+
+// The decoders share the way elements are built. readItem() returns a new object or array, or
+// nullptr for a value, which is put in value. Anything malformed clears IS_VALID, and the
+// elements read so far are released.
+
+class TreeDecoder
+{
+protected:
+    const uchar* POSITION = nullptr;
+    const uchar* END = nullptr;
+    bool IS_VALID = true;
+    int DEPTH = 0;
+    static const int MAX_DEPTH = 1000;                              // Deeper documents are refused, instead of overflowing the stack.
+
+    bool has( quint64 bytes)
+    {
+        if (quint64( END - POSITION) < bytes)
+            IS_VALID = false;
+        return IS_VALID;
+    }
+
+    template <class T>
+    T take()
+    {
+        if (!has( sizeof(T)))
+            return T(0);
+
+        T number = qFromBigEndian<T>( POSITION);
+        POSITION += sizeof(T);
+        return number;
+    }
+
+    QByteArray takeBytes( quint64 count)
+    {
+        if (!has( count))
+            return QByteArray();
+
+        QByteArray bytes( reinterpret_cast<const char*>(POSITION), int( count));
+        POSITION += count;
+        return bytes;
+    }
+
+    static double doubleOfBits( quint64 bits)
+    {
+        double number;
+        std::memcpy( &number, &bits, sizeof(number));
+        return number;
+    }
+
+    static double floatOfBits( quint32 bits)
+    {
+        float number;
+        std::memcpy( &number, &bits, sizeof(number));
+        return double( number);
+    }
+
+    bool enter()
+    {
+        if (++DEPTH > MAX_DEPTH)
+            IS_VALID = false;
+        return IS_VALID;
+    }
+
+    void addToArray( JsonArray* array, JsonType* child, const QVariant& value)     // Values go through appendValue(),
+    {                                                                               // so arrays are packed like parsed ones.
+        if (child == nullptr)
+            array->appendValue( value);
+        else
+            array->insertStrong( array->size(), child);
+    }
+
+    void addToObject( JsonObject* object, const QVariant& key, JsonType* child, const QVariant& value)
+    {
+        QString name;
+
+        switch (static_cast<QMetaType::Type>(key.type()))
+        {
+        case QMetaType::QString: case QMetaType::Int: case QMetaType::LongLong: case QMetaType::ULongLong:
+            name = key.toString();
+            break;
+        default:                                                    // Keys are strings or integers.
+            IS_VALID = false;
+            release( child);
+            return;
+        }
+
+        if (child == nullptr)
+            object->setValue( name, value);
+        else
+            object->insertStrong( name, child);
+    }
+
+    JsonType* finish( JsonType* root)                               // The root must be an object or an array, which uses
+    {                                                               // every byte.
+        if (root != nullptr && IS_VALID && POSITION == END)
+            return root;
+
+        release( root);
+        return nullptr;
+    }
+};
+
+class CborReader : public TreeDecoder
+{
+private:
+    quint64 argument( quint8 info)
+    {
+        switch (info)
+        {
+        case 24: return take<quint8>();
+        case 25: return take<quint16>();
+        case 26: return take<quint32>();
+        case 27: return take<quint64>();
+        default:
+            if (info >= 24)                                         // Reserved, or indefinite where it's not allowed.
+                IS_VALID = false;
+            return info;
+        }
+    }
+
+    bool isBreak()                                                  // The end of an indefinite length item.
+    {
+        if (has(1) && *POSITION == 0xff)
+        {
+            ++POSITION;
+            return true;
+        }
+        return false;
+    }
+
+    static double halfToDouble( quint16 half)                       // RFC 8949, appendix D.
+    {
+        int exponent = (half >> 10) & 0x1f;
+        int mantissa = half & 0x3ff;
+        double number;
+
+        if (exponent == 0)
+            number = std::ldexp( mantissa, -24);
+        else if (exponent != 31)
+            number = std::ldexp( mantissa + 1024, exponent - 25);
+        else
+            number = (mantissa == 0) ? std::numeric_limits<double>::infinity() : std::numeric_limits<double>::quiet_NaN();
+
+        return (half & 0x8000) ? -number : number;
+    }
+
+    QByteArray readString( quint8 major, quint8 info)               // Byte and text strings. Indefinite ones are chunked.
+    {
+        if (info != 31)
+            return takeBytes( argument( info));
+
+        QByteArray bytes;
+
+        while (IS_VALID && !isBreak())
+        {
+            quint8 initial = take<quint8>();
+
+            if ((initial >> 5) != major || (initial & 0x1f) == 31)
+                IS_VALID = false;
+            else
+                bytes.append( takeBytes( argument( initial & 0x1f)));
+        }
+        return bytes;
+    }
+
+    JsonType* readArray( quint8 info)
+    {
+        JsonArray* array = new JsonArray();
+        bool isIndefinite = (info == 31);
+        quint64 count = isIndefinite ? 0 : argument( info);
+        has( count);                                                // Every item takes at least one byte.
+
+        for (quint64 i = 0; IS_VALID && (isIndefinite ? !isBreak() : i < count); ++i)
+        {
+            QVariant value;
+            JsonType* child = readItem( value);
+
+            if (IS_VALID)
+                addToArray( array, child, value);
+        }
+        return array;
+    }
+
+    JsonType* readMap( quint8 info)
+    {
+        JsonObject* object = new JsonObject();
+        bool isIndefinite = (info == 31);
+        quint64 count = isIndefinite ? 0 : argument( info);
+        has( count * 2);
+
+        for (quint64 i = 0; IS_VALID && (isIndefinite ? !isBreak() : i < count); ++i)
+        {
+            QVariant key;
+            QVariant value;
+            release( readItem( key));                               // Containers aren't valid keys.
+            JsonType* child = IS_VALID ? readItem( value) : nullptr;
+
+            if (IS_VALID)
+                addToObject( object, key, child, value);
+        }
+        return object;
+    }
+
+    void readSimple( quint8 info, QVariant& value)
+    {
+        switch (info)
+        {
+        case 20: value = false; break;
+        case 21: value = true; break;
+        case 22: case 23: value = QVariant(); break;                // Null and undefined.
+        case 25: value = halfToDouble( take<quint16>()); break;
+        case 26: value = floatOfBits( take<quint32>()); break;
+        case 27: value = doubleOfBits( take<quint64>()); break;
+        default: IS_VALID = false;
+        }
+    }
+
+public:
+    JsonType* readItem( QVariant& value)
+    {
+        if (!has(1) || !enter())
+            return nullptr;
+
+        quint8 initial = *POSITION++;
+        quint8 major = initial >> 5;
+        quint8 info = initial & 0x1f;
+        JsonType* element = nullptr;
+
+        switch (major)
+        {
+        case 0:
+            value = unsignedValue( argument( info));
+            break;
+        case 1:
+        {
+            quint64 number = argument( info);
+
+            if (number <= quint64( std::numeric_limits<qint64>::max()))
+                value = integerValue( -1 - qint64( number));
+            else
+                value = -1.0 - double( number);
+            break;
+        }
+        case 2:
+            value = readString( 2, info);
+            break;
+        case 3:
+            value = QString::fromUtf8( readString( 3, info));
+            break;
+        case 4:
+            element = readArray( info);
+            break;
+        case 5:
+            element = readMap( info);
+            break;
+        case 6:                                                     // Tags are skipped, the tagged item is kept.
+            argument( info);
+            element = readItem( value);
+            break;
+        default:
+            readSimple( info, value);
+        }
+
+        --DEPTH;
+
+        if (!IS_VALID)
+        {
+            release( element);
+            return nullptr;
+        }
+        return element;
+    }
+
+    JsonType* read( const QByteArray& bytes)                        // The root, or nullptr if it isn't a valid document.
+    {
+        POSITION = reinterpret_cast<const uchar*>(bytes.constData());
+        END = POSITION + bytes.size();
+        IS_VALID = true;
+        DEPTH = 0;
+        QVariant value;
+        return finish( readItem( value));
+    }
+};
+
+class MessagePackReader : public TreeDecoder
+{
+private:
+    JsonType* readArray( quint64 count)
+    {
+        JsonArray* array = new JsonArray();
+        has( count);
+
+        for (quint64 i = 0; IS_VALID && i < count; ++i)
+        {
+            QVariant value;
+            JsonType* child = readItem( value);
+
+            if (IS_VALID)
+                addToArray( array, child, value);
+        }
+        return array;
+    }
+
+    JsonType* readMap( quint64 count)
+    {
+        JsonObject* object = new JsonObject();
+        has( count * 2);
+
+        for (quint64 i = 0; IS_VALID && i < count; ++i)
+        {
+            QVariant key;
+            QVariant value;
+            release( readItem( key));
+            JsonType* child = IS_VALID ? readItem( value) : nullptr;
+
+            if (IS_VALID)
+                addToObject( object, key, child, value);
+        }
+        return object;
+    }
+
+public:
+    JsonType* readItem( QVariant& value)                            // Extension types aren't supported.
+    {
+        if (!has(1) || !enter())
+            return nullptr;
+
+        quint8 type = *POSITION++;
+        JsonType* element = nullptr;
+
+        if (type < 0x80)
+            value = int( type);
+        else if (type >= 0xe0)
+            value = int( qint8( type));
+        else if (type <= 0x8f)
+            element = readMap( type & 0x0f);
+        else if (type <= 0x9f)
+            element = readArray( type & 0x0f);
+        else if (type <= 0xbf)
+            value = QString::fromUtf8( takeBytes( type & 0x1f));
+        else
+        {
+            switch (type)
+            {
+            case 0xc0: value = QVariant(); break;
+            case 0xc2: value = false; break;
+            case 0xc3: value = true; break;
+            case 0xc4: value = takeBytes( take<quint8>()); break;
+            case 0xc5: value = takeBytes( take<quint16>()); break;
+            case 0xc6: value = takeBytes( take<quint32>()); break;
+            case 0xca: value = floatOfBits( take<quint32>()); break;
+            case 0xcb: value = doubleOfBits( take<quint64>()); break;
+            case 0xcc: value = unsignedValue( take<quint8>()); break;
+            case 0xcd: value = unsignedValue( take<quint16>()); break;
+            case 0xce: value = unsignedValue( take<quint32>()); break;
+            case 0xcf: value = unsignedValue( take<quint64>()); break;
+            case 0xd0: value = integerValue( take<qint8>()); break;
+            case 0xd1: value = integerValue( take<qint16>()); break;
+            case 0xd2: value = integerValue( take<qint32>()); break;
+            case 0xd3: value = integerValue( take<qint64>()); break;
+            case 0xd9: value = QString::fromUtf8( takeBytes( take<quint8>())); break;
+            case 0xda: value = QString::fromUtf8( takeBytes( take<quint16>())); break;
+            case 0xdb: value = QString::fromUtf8( takeBytes( take<quint32>())); break;
+            case 0xdc: element = readArray( take<quint16>()); break;
+            case 0xdd: element = readArray( take<quint32>()); break;
+            case 0xde: element = readMap( take<quint16>()); break;
+            case 0xdf: element = readMap( take<quint32>()); break;
+            default: IS_VALID = false;
+            }
+        }
+
+        --DEPTH;
+
+        if (!IS_VALID)
+        {
+            release( element);
+            return nullptr;
+        }
+        return element;
+    }
+
+    JsonType* read( const QByteArray& bytes)                        // The root, or nullptr if it isn't a valid document.
+    {
+        POSITION = reinterpret_cast<const uchar*>(bytes.constData());
+        END = POSITION + bytes.size();
+        IS_VALID = true;
+        DEPTH = 0;
+        QVariant value;
+        return finish( readItem( value));
+    }
+};
+}
+
+#endif // JSONWAX_CODECS_H
@@ -0,0 +1,199 @@
+#ifndef JSONWAX_COMPRESSION_H
+#define JSONWAX_COMPRESSION_H
+
+/* Original author: Nikolai S | https://github.com/doublejim
+ *
+ * You may use this file under the terms of any of these licenses:
+ * GNU General Public License version 2.0       https://www.gnu.org/licenses/gpl-2.0.html
+ * GNU General Public License version 3         https://www.gnu.org/licenses/gpl-3.0.html
+ */
+
+#include <QByteArray>
+#include <QIODevice>
+
+// Compressed files need zlib. Define JSONWAX_ZLIB before including JsonWax.h, and link with zlib
+// (fx. LIBS += -lz), to enable them. Without it, compressed files are refused with a warning.
+
+#ifdef JSONWAX_ZLIB
+#include <zlib.h>
+#endif
+
+namespace JsonWaxInternals {
+
+enum Compression {Uncompressed, Gzip, Zlib};
+
+static Compression compressionOf( const QByteArray& start)          // Recognizes the first two bytes of a file.
+{
+    if (start.size() < 2)
+        return Uncompressed;
+
+    uchar byte1 = uchar( start.at(0));
+    uchar byte2 = uchar( start.at(1));
+
+    if (byte1 == 0x1f && byte2 == 0x8b)
+        return Gzip;
+
+    if (byte1 == 0x78 && (byte1 * 256 + byte2) % 31 == 0)         // A JSON document can't start with 'x'.
+        return Zlib;
+
+    return Uncompressed;
+}
+
+#ifdef JSONWAX_ZLIB
+
+// A CompressedDevice compresses what's written to it, or decompresses what's read from it, in
+// chunks, so neither the compressed nor the uncompressed data has to be in memory all at once.
+// Writing ends with close(), which writes the end of the stream.
+
+class CompressedDevice : public QIODevice
+{
+private:
+    static const int CHUNK_SIZE = 64 * 1024;
+
+    QIODevice* DEVICE;
+    Compression FORMAT;
+    z_stream STREAM;
+    QByteArray BUFFER;                                              // Compressed data, on its way in or out.
+    bool IS_STREAM_OPEN = false;
+    bool IS_FINISHED = false;
+    bool HAS_ERROR = false;
+
+    bool writeBuffer( int size)
+    {
+        if (size > 0 && DEVICE->write( BUFFER.constData(), size) != size)
+            HAS_ERROR = true;
+        return !HAS_ERROR;
+    }
+
+    bool deflateInput( int flush)                                   // Compresses STREAM's input, and writes the result.
+    {
+        int result;
+
+        do {
+            STREAM.next_out = reinterpret_cast<Bytef*>(BUFFER.data());
+            STREAM.avail_out = CHUNK_SIZE;
+            result = deflate( &STREAM, flush);
+
+            if (result == Z_STREAM_ERROR || !writeBuffer( CHUNK_SIZE - int( STREAM.avail_out)))
+            {
+                HAS_ERROR = true;
+                return false;
+            }
+        } while (STREAM.avail_out == 0 || (flush == Z_FINISH && result != Z_STREAM_END));
+
+        return true;
+    }
+
+public:
+    CompressedDevice( QIODevice* device, Compression format = Gzip) : DEVICE( device), FORMAT( format)
+    {
+        STREAM.zalloc = Z_NULL;
+        STREAM.zfree = Z_NULL;
+        STREAM.opaque = Z_NULL;
+    }
+
+    ~CompressedDevice()
+    {
+        close();
+    }
+
+    bool hasError() const
+    {
+        return HAS_ERROR;
+    }
+
+    bool isSequential() const override
+    {
+        return true;
+    }
+
+    bool open( OpenMode mode) override                              // ReadOnly or WriteOnly. Reading recognizes gzip and zlib.
+    {
+        BUFFER.resize( CHUNK_SIZE);
+        STREAM.next_in = Z_NULL;
+        STREAM.avail_in = 0;
+        IS_FINISHED = false;
+        HAS_ERROR = false;
+
+        if (mode & QIODevice::WriteOnly)
+            IS_STREAM_OPEN = (deflateInit2( &STREAM, Z_DEFAULT_COMPRESSION, Z_DEFLATED, (FORMAT == Gzip) ? 15 + 16 : 15, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+        else
+            IS_STREAM_OPEN = (inflateInit2( &STREAM, 15 + 32) == Z_OK);
+
+        return IS_STREAM_OPEN && QIODevice::open( (mode & QIODevice::WriteOnly) ? QIODevice::WriteOnly : QIODevice::ReadOnly);
+    }
+
+    void close() override
+    {
+        if (!IS_STREAM_OPEN)
+            return;
+
+        if (openMode() & QIODevice::WriteOnly)
+        {
+            STREAM.next_in = Z_NULL;
+            STREAM.avail_in = 0;
+            deflateInput( Z_FINISH);
+            deflateEnd( &STREAM);
+        } else {
+            inflateEnd( &STREAM);
+        }
+        IS_STREAM_OPEN = false;
+        QIODevice::close();
+    }
+
+protected:
+    qint64 readData( char* data, qint64 maxSize) override
+    {
+        if (HAS_ERROR)
+            return -1;
+
+        STREAM.next_out = reinterpret_cast<Bytef*>(data);
+        STREAM.avail_out = uInt( qMin( maxSize, qint64( 1 << 30)));
+
+        while (!IS_FINISHED && STREAM.avail_out > 0)
+        {
+            if (STREAM.avail_in == 0)
+            {
+                qint64 size = DEVICE->read( BUFFER.data(), CHUNK_SIZE);
+
+                if (size <= 0)                                      // The compressed data ended too soon.
+                {
+                    HAS_ERROR = true;
+                    return -1;
+                }
+                STREAM.next_in = reinterpret_cast<Bytef*>(BUFFER.data());
+                STREAM.avail_in = uInt( size);
+            }
+
+            uInt before = STREAM.avail_out;
+            int result = inflate( &STREAM, Z_NO_FLUSH);
+
+            if (result == Z_STREAM_END)
+                IS_FINISHED = true;
+            else if (result != Z_OK && result != Z_BUF_ERROR)
+            {
+                HAS_ERROR = true;
+                return -1;
+            }
+
+            if (STREAM.avail_out < before)                          // Returns what's there, rather than waiting for more.
+                break;
+        }
+        return qint64( qMin( maxSize, qint64( 1 << 30))) - STREAM.avail_out;
+    }
+
+    qint64 writeData( const char* data, qint64 size) override
+    {
+        if (HAS_ERROR)
+            return -1;
+
+        STREAM.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        STREAM.avail_in = uInt( size);
+        return deflateInput( Z_NO_FLUSH) ? size : -1;
+    }
+};
+
+#endif // JSONWAX_ZLIB
+}
+
+#endif // JSONWAX_COMPRESSION_H
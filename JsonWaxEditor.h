@@ -9,8 +9,29 @@
  */
 
 #include <QByteArray>
+#include <QHash>
+#include <QIODevice>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThreadPool>
+#include <QStringList>
+#include <QVector>
+#include <QAtomicInt>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <iterator>
+#include <utility>
+#include <QtAlgorithms>
+#include "JsonWaxNumbers.h"
 #include "JsonWaxParser.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define JSONWAX_SSE2
+#include <emmintrin.h>
+#endif
+
 /* TODO:
  * - Problem: Make sure that documents are stored using UTF-8 codec, before loading them.
  */
@@ -18,6 +39,9 @@
 /* There are 3 classes and an editor.
  * Object, Array and Value implement functions from "JsonType".
  * Objects and Arrays use polymorphism to contain any of the 3 types.
+ *
+ * Elements are reference counted and can be shared by several parents (fx. after a copy).
+ * A shared element is never changed; the Editor replaces it with a clone before writing to it.
  */
 
 namespace JsonWaxInternals
@@ -28,42 +52,331 @@ namespace JsonWaxInternals
     enum StringStyle {Compact, Readable};
 
     static thread_local bool CONVERT_TO_CODE_POINTS = false;
+    static thread_local bool CACHE_FRAGMENTS = false;              // See Fragment.
+
+// Escaping looks at every character of every string, so runs of characters that need nothing done
+// are found 8 at a time where SSE2 is available, and copied in one go. The other characters are
+// looked up in ESCAPES (ASCII) or written as UTF-8 or \uXXXX. The text is the same as QString::toUtf8()
+// would give for the escaped string, fx. a surrogate without its other half becomes '?'.
+
+class EscapeTable
+{
+public:
+    char ESCAPES[128];                                              // 0: as it is, 'u': a code point if CONVERT_TO_CODE_POINTS,
+                                                                    // else the letter after the backslash.
+    EscapeTable()
+    {
+        for (int ch = 0; ch < 128; ++ch)
+            ESCAPES[ ch] = (ch < 32 || ch == 127) ? 'u' : 0;
+
+        ESCAPES[ int('\"')] = '\"';
+        ESCAPES[ int('\\')] = '\\';
+        ESCAPES[ int('\b')] = 'b';
+        ESCAPES[ int('\f')] = 'f';
+        ESCAPES[ int('\n')] = 'n';
+        ESCAPES[ int('\r')] = 'r';
+        ESCAPES[ int('\t')] = 't';
+    }
+};
+
+static const EscapeTable& escapeTable()
+{
+    static const EscapeTable table;
+    return table;
+}
+
+static int plainLength( const ushort* chars, int size)             // How many characters, from the start, need no escaping
+{                                                                   // and are ASCII.
+    int i = 0;
+#ifdef JSONWAX_SSE2
+    const __m128i below = _mm_set1_epi16( 0x1f);
+    const __m128i above = _mm_set1_epi16( 0x7f);
+    const __m128i quote = _mm_set1_epi16( '\"');
+    const __m128i backslash = _mm_set1_epi16( '\\');
+
+    for (; i + 8 <= size; i += 8)
+    {
+        __m128i block = _mm_loadu_si128( reinterpret_cast<const __m128i*>(chars + i));  // Signed: 0x8000 and up are below 0x1f.
+        __m128i isPlain = _mm_and_si128( _mm_cmpgt_epi16( block, below), _mm_cmplt_epi16( block, above));
+        isPlain = _mm_andnot_si128( _mm_or_si128( _mm_cmpeq_epi16( block, quote), _mm_cmpeq_epi16( block, backslash)), isPlain);
+        uint mask = uint( _mm_movemask_epi8( isPlain));
 
-static void indent( QString& str, int indentation)
+        if (mask != 0xffff)
+            return i + int( qCountTrailingZeroBits( ~mask & 0xffff)) / 2;
+    }
+#endif
+    const EscapeTable& table = escapeTable();
+
+    while (i < size && chars[ i] < 128 && table.ESCAPES[ chars[ i]] == 0)
+        ++i;
+    return i;
+}
+
+static void appendCodePoint( QByteArray& output, ushort ch)         // \uXXXX
 {
-    for (int i = 0; i < indentation; ++i)
-        str.append("    ");
+    static const char digits[] = "0123456789abcdef";
+    char text[6] = {'\\', 'u', digits[ ch >> 12], digits[ (ch >> 8) & 15], digits[ (ch >> 4) & 15], digits[ ch & 15]};
+    output.append( text, 6);
 }
 
-static QString toJsonString( const QString& input)
+static void appendJsonString( QByteArray& output, const QString& input)    // The escaped text, as UTF-8, without quotes.
 {
-    QString result;
+    const ushort* chars = input.utf16();
+    const EscapeTable& table = escapeTable();
+    int size = input.size();
+    int i = 0;
 
-    for (const QChar& ch : input)
-        switch( ch.unicode())
+    while (i < size)
+    {
+        int length = plainLength( chars + i, size - i);
+
+        if (length > 0)
         {
-        case '\\': result.append('\\'); result.append('\\');  break;    // Breaks special characters up into two characters.
-        case '\"': result.append("\\"); result.append('\"');  break;
-        case '\b': result.append('\\'); result.append('b');   break;
-        case '\f': result.append('\\'); result.append('f');   break;
-        case '\n': result.append('\\'); result.append('n');   break;
-        case '\r': result.append('\\'); result.append('r');   break;
-        case '\t': result.append('\\'); result.append('t');   break;
-        default:
-            if (!CONVERT_TO_CODE_POINTS)
+            int position = output.size();
+            output.resize( position + length);
+            char* out = output.data() + position;
+
+            for (int k = 0; k < length; ++k)
+                out[ k] = char( chars[ i + k]);
+
+            i += length;
+            continue;
+        }
+
+        ushort ch = chars[ i++];
+
+        if (ch < 128)
+        {
+            char escape = table.ESCAPES[ ch];
+
+            if (escape != 'u')
             {
-                result.append(ch);
+                output.append('\\');
+                output.append( escape);
+            } else if (CONVERT_TO_CODE_POINTS) {
+                appendCodePoint( output, ch);
             } else {
-                if ( ch.unicode() > 31 && ch.unicode() < 127)
-                {
-                    result.append( ch);
-                } else {
-                    result.append( "\\u");
-                    result.append( QString::number( ch.unicode(), 16).rightJustified(4, '0'));
-                }
+                output.append( char( ch));
             }
+        } else if (CONVERT_TO_CODE_POINTS) {                        // Every UTF-16 unit, also each half of a surrogate pair.
+            appendCodePoint( output, ch);
+        } else if (ch < 0x800) {
+            output.append( char( 0xc0 | (ch >> 6)));
+            output.append( char( 0x80 | (ch & 0x3f)));
+        } else if (!QChar::isSurrogate( ch)) {
+            output.append( char( 0xe0 | (ch >> 12)));
+            output.append( char( 0x80 | ((ch >> 6) & 0x3f)));
+            output.append( char( 0x80 | (ch & 0x3f)));
+        } else if (QChar::isHighSurrogate( ch) && i < size && QChar::isLowSurrogate( chars[ i])) {
+            uint codePoint = QChar::surrogateToUcs4( ch, chars[ i++]);
+            output.append( char( 0xf0 | (codePoint >> 18)));
+            output.append( char( 0x80 | ((codePoint >> 12) & 0x3f)));
+            output.append( char( 0x80 | ((codePoint >> 6) & 0x3f)));
+            output.append( char( 0x80 | (codePoint & 0x3f)));
+        } else {
+            output.append('?');                                     // Like QString::toUtf8().
+        }
+    }
+}
+
+static qint64 stringMemory( const QString& str)                     // The string data, including unused capacity.
+{
+    if (str.isNull())
+        return 0;
+    return sizeof(QArrayData) + (str.capacity() + 1) * sizeof(QChar);
+}
+
+static qint64 byteArrayMemory( const QByteArray& bytes)
+{
+    if (bytes.isNull())
+        return 0;
+    return sizeof(QArrayData) + bytes.capacity() + 1;
+}
+
+template <class T>
+static qint64 vectorMemory( const QVector<T>& vector)
+{
+    if (vector.capacity() == 0)
+        return 0;
+    return sizeof(QArrayData) + vector.capacity() * sizeof(T);
+}
+
+// The serialized text of an object or array is kept as a fragment, so saving a large document
+// where a few values changed only serializes the objects and arrays on the paths to the changes.
+// The Editor marks every element on a path it writes to as dirty, which drops its fragments.
+// Only the Editor uses fragments (CACHE_FRAGMENTS is set while it serializes), and only below
+// elements that aren't shared: those can't be reached by Snapshots, other Editors or threads.
+
+class Fragment
+{
+public:
+    QByteArray TEXT;                                                // UTF-8.
+    int INDENTATION = -1;                                           // -1 when there's no text.
+    bool CODE_POINTS = false;
+
+    void clear()
+    {
+        TEXT = QByteArray();
+        INDENTATION = -1;
+    }
+};
+
+class FragmentScope                                                 // Serializes one object or array, using and storing its fragment.
+{
+private:
+    Fragment& FRAGMENT;
+    bool IS_CACHEABLE;
+    bool WAS_CACHING;
+    int INDENTATION;
+
+public:
+    FragmentScope( Fragment& fragment, bool isShared, StringStyle style, int indentation)
+        : FRAGMENT(fragment), IS_CACHEABLE(CACHE_FRAGMENTS && !isShared), WAS_CACHING(CACHE_FRAGMENTS),
+          INDENTATION( (style == StringStyle::Compact) ? 0 : indentation)
+    {
+        CACHE_FRAGMENTS = IS_CACHEABLE;                             // Nothing below a shared element is cached.
+    }
+
+    ~FragmentScope()
+    {
+        CACHE_FRAGMENTS = WAS_CACHING;
+    }
+
+    bool isCacheable() const
+    {
+        return IS_CACHEABLE;
+    }
+
+    bool isCached() const
+    {
+        return IS_CACHEABLE && FRAGMENT.INDENTATION == INDENTATION && FRAGMENT.CODE_POINTS == CONVERT_TO_CODE_POINTS;
+    }
+
+    void store( const QByteArray& text)
+    {
+        if (IS_CACHEABLE)
+        {
+            FRAGMENT.TEXT = text;
+            FRAGMENT.INDENTATION = INDENTATION;
+            FRAGMENT.CODE_POINTS = CONVERT_TO_CODE_POINTS;
+        }
+    }
+
+    const QByteArray& text() const
+    {
+        return FRAGMENT.TEXT;
+    }
+};
+
+// Numbers are compared by value, so 3 and 3.0 are equal, and equal values have equal hashes.
+// Both go through a NumberKey: every number that is an integer, also a double like 3.0, is kept as
+// a sign and a magnitude, so no conversion rounds it, and the rest are kept as doubles.
+
+static bool isNumber( const QVariant& value)
+{
+    switch (static_cast<QMetaType::Type>(value.type()))
+    {
+    case QMetaType::Int: case QMetaType::UInt: case QMetaType::LongLong:
+    case QMetaType::ULongLong: case QMetaType::Double: case QMetaType::Float:
+        return true;
+    default:
+        return false;
+    }
+}
+
+class NumberKey
+{
+public:
+    bool IS_INTEGER = true;
+    bool IS_NEGATIVE = false;
+    quint64 MAGNITUDE = 0;                                          // Integers.
+    double DOUBLE = 0;                                              // The rest, fx. 0.5, nan and inf.
+
+    NumberKey( const QVariant& value)                               // The value must be a number.
+    {
+        switch (static_cast<QMetaType::Type>(value.type()))
+        {
+        case QMetaType::UInt: case QMetaType::ULongLong:
+            MAGNITUDE = value.toULongLong();
+            return;
+        case QMetaType::Int: case QMetaType::LongLong:
+        {
+            qint64 integer = value.toLongLong();
+            IS_NEGATIVE = (integer < 0);
+            MAGNITUDE = IS_NEGATIVE ? quint64(0) - quint64( integer) : quint64( integer);
+            return;
+        }
+        default:
+            break;
+        }
+
+        double number = value.toDouble();
+        double magnitude = std::fabs( number);
+
+        if (magnitude == std::floor( magnitude) && magnitude < 18446744073709551616.0)     // Integral, and below 2^64.
+        {
+            IS_NEGATIVE = (number < 0);                             // Not for -0.
+            MAGNITUDE = quint64( magnitude);
+        } else {
+            IS_INTEGER = false;
+            DOUBLE = number;
         }
-    return result;
+    }
+
+    bool operator == ( const NumberKey& other) const
+    {
+        if (IS_INTEGER != other.IS_INTEGER)
+            return false;
+
+        if (IS_INTEGER)
+            return (IS_NEGATIVE == other.IS_NEGATIVE && MAGNITUDE == other.MAGNITUDE);
+
+        return DOUBLE == other.DOUBLE;
+    }
+
+    quint64 hash() const
+    {
+        if (IS_INTEGER)
+            return (quint64( qHash( MAGNITUDE, IS_NEGATIVE ? 3 : 1)) << 32) | qHash( MAGNITUDE, IS_NEGATIVE ? 4 : 2);
+
+        return (quint64( qHash( DOUBLE, 1)) << 32) | qHash( DOUBLE, 2);
+    }
+};
+
+static bool valuesAreEqual( const QVariant& value1, const QVariant& value2)
+{
+    if (isNumber( value1) || isNumber( value2))
+    {
+        if (!isNumber( value1) || !isNumber( value2))
+            return false;
+
+        return NumberKey( value1) == NumberKey( value2);
+    }
+
+    if (!value1.isValid() || !value2.isValid())                     // Null.
+        return !value1.isValid() && !value2.isValid();
+
+    return (value1.type() == value2.type() && value1 == value2);
+}
+
+static quint64 combineHash( quint64 hash, quint64 value)
+{
+    return hash ^ (value + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2));
+}
+
+static quint64 valueHash( const QVariant& value)
+{
+    if (!value.isValid())
+        return 0x6e756c6cULL;
+
+    if (isNumber( value))
+        return NumberKey( value).hash();
+
+    if (value.type() == QVariant::Bool)
+        return value.toBool() ? 0x74727565ULL : 0x66616c7365ULL;
+
+    QString text = value.toString();
+    return combineHash( quint64( value.type()), (quint64( qHash( text, 1)) << 32) | qHash( text, 2));
 }
 
 // ------------------------- JSON TYPES -------------------------
@@ -72,10 +385,11 @@ class JsonType
 {
 public:
     Type hasType;
+    QAtomicInt REF;                                                 // The number of parents (or editors) holding this element.
 
-    JsonType(){}
+    JsonType() : REF(1){}
 
-    JsonType( Type type)
+    JsonType( Type type) : REF(1)
     {
         setType( type);
     }
@@ -85,16 +399,26 @@ public:
         hasType = type;
     }
 
+    bool isShared()
+    {
+        return REF.loadAcquire() > 1;                               // Acquire: a Snapshot on another thread may just have let go of it.
+    }
+
     virtual ~JsonType(){}
+    virtual JsonType* clone() = 0;                                  // A copy that shares the children of this element.
+    virtual JsonType* compacted() = 0;                              // A deep copy without unused capacity (shared children stay shared).
+    virtual qint64 memoryUsage() = 0;                               // Bytes used by this element and its children.
     virtual QString toString( StringStyle style, int indentation = 0) = 0;
     virtual JsonType* insertWeak( const QVariant& key, JsonType* fresh_element) = 0;
     virtual JsonType* insertStrong( const QVariant& key, JsonType* fresh_element) = 0;
-    virtual void setValue( const QVariant& key, const QVariant& value) = 0;
+    virtual void setValue( const QVariant& key, QVariant value) = 0;     // The value is moved into place.
     virtual JsonType* value( const QVariant& key) = 0;
     virtual bool remove( const QVariant& key) = 0;
     virtual bool removeWeak( const QVariant& key) = 0;
     virtual bool contains( const QVariant& key) = 0;
     virtual int size() = 0;
+    virtual quint64 contentHash() = 0;                              // Equal content has equal hashes. Objects and arrays remember theirs.
+    virtual void markDirty(){}                                      // Drops what an object or array remembers: fragments and hash.
 
     virtual QVariantList keys()
     {
@@ -102,6 +426,24 @@ public:
     }
 };
 
+static JsonType* retain( JsonType* element)
+{
+    if (element != nullptr)
+        element->REF.ref();
+    return element;
+}
+
+static void release( JsonType* element)
+{
+    if (element != nullptr && !element->REF.deref())                // Deleted when the last holder lets go of it.
+        delete element;
+}
+
+static JsonType* compactedChild( JsonType* element)                 // Compacting a shared element would unshare it.
+{
+    return element->isShared() ? retain( element) : element->compacted();
+}
+
 class JsonValue : public JsonType
 {
 public:
@@ -110,65 +452,65 @@ public:
         setType( Type::Value);
     }
 
-    JsonValue( const QVariant& value)
+    JsonValue( QVariant value)
     {
         setType( Type::Value);
-        setValue({}, value);
+        setValue({}, std::move( value));
     }
 
     ~JsonValue(){}
 
     QVariant VALUE;
 
-    QString toString( StringStyle style, int indentation = 0)
+    JsonType* clone()
     {
-        Q_UNUSED(style);
-        Q_UNUSED(indentation);
-
-        QString result;
+        return new JsonValue( VALUE);
+    }
 
-        switch(static_cast<QMetaType::Type>(VALUE.type()))
-        {
-        case QVariant::String: case QMetaType::QChar:
+    JsonType* compacted()
+    {
+        if (VALUE.type() == QVariant::String)
         {
-            result.append('\"');
-            result.append( toJsonString( VALUE.toString()));
-            result.append('\"');
-            break;
-        }
-        case QMetaType::Int: case QMetaType::UInt:
-        case QMetaType::Double: case QMetaType::Float:
-        case QMetaType::LongLong: case QMetaType::ULongLong:
-        case QMetaType::Bool:
-            result.append( VALUE.toString());
-            break;
-        case QVariant::Invalid:
-            result.append("null");
-            break;
-        default:
-            result.append("ERROR");
+            QString str = VALUE.toString();
+
+            if (str.capacity() > str.size())
+                str.squeeze();
+            return new JsonValue( str);
         }
+        return new JsonValue( VALUE);
+    }
 
-        return result;
+    quint64 contentHash()
+    {
+        return valueHash( VALUE);
+    }
+
+    qint64 memoryUsage()
+    {
+        if (VALUE.type() == QVariant::String)
+            return sizeof(JsonValue) + stringMemory( *static_cast<const QString*>(VALUE.constData()));
+        return sizeof(JsonValue);
     }
 
-    void setValue(const QVariant& key, const QVariant& value)
+    QString toString( StringStyle style, int indentation = 0);      // See JsonWriter.
+
+    void setValue(const QVariant& key, QVariant value)
     {
         Q_UNUSED(key);
-        VALUE = value;
+        VALUE = std::move( value);
     }
 
     JsonType* insertWeak( const QVariant& key, JsonType* fresh_element)
     {
         Q_UNUSED(key);
-        delete fresh_element;
+        release( fresh_element);
         return this;
     }
 
     JsonType* insertStrong( const QVariant& key, JsonType* fresh_element)
     {
         Q_UNUSED(key);
-        delete fresh_element;
+        release( fresh_element);
         return this;
     }
 
@@ -215,7 +557,7 @@ private:
         {
             if (value->hasType != fresh_element->hasType)       // The value is of a wrong type.
             {                                                   // Delete its data and use the fresh_element.
-                delete value;
+                release( value);
             } else {
                 INSERTED_ELEMENT = value;
                 return false;
@@ -228,6 +570,9 @@ private:
 
 public:
     QMap<QString, JsonType*> MAP;
+    Fragment FRAGMENTS[2];                                          // One per StringStyle.
+    std::atomic<quint64> HASH{0};                                   // 0 until it's computed. Shared elements never change,
+                                                                    // so any thread may compute and store it.
 
     JsonObject()
     {
@@ -236,71 +581,78 @@ public:
 
     ~JsonObject()
     {
-        for (JsonType* jt : MAP.values())
-            delete jt;
+        for (JsonType* jt : MAP)
+            release( jt);
     }
 
-    QVariantList keys()
+    JsonType* clone()
     {
-        QVariantList result;
+        JsonObject* result = new JsonObject();
+        result->MAP = MAP;
 
-        for (QString str : MAP.keys())
-            result.append( str);
+        for (JsonType* jt : qAsConst( MAP))                         // Const access. The map mustn't detach, since other
+            retain( jt);                                            // threads may be reading this element.
 
         return result;
     }
 
-    QString toString( StringStyle style, int indentation = 0)
+    JsonType* compacted()                                           // The nodes are allocated in order, one after another.
     {
-        QString result;
+        JsonObject* result = new JsonObject();
 
-        result.append('{');
+        for (auto it = MAP.cbegin(); it != MAP.cend(); ++it)
+            result->MAP.insert( result->MAP.cend(), it.key(), compactedChild( it.value()));
 
-        switch( style)
-        {
-        case StringStyle::Readable:
-            result.append('\n');
+        return result;
+    }
 
-            for (QString& key : MAP.keys())
-            {
-                indent( result, indentation);
-
-                result.append('\"');
-                result.append( toJsonString( key));
-                result.append('\"');
-                result.append(':');
-                result.append(' ');
-                result.append( MAP.value(key)->toString( style, indentation + 1));
-                result.append(",\n");
-            }
+    quint64 contentHash()
+    {
+        quint64 result = HASH.load( std::memory_order_relaxed);
 
-            if (!MAP.isEmpty())
-                result.chop(2);
+        if (result != 0)
+            return result;
 
-            result.append('\n');
-            indent( result, indentation - 1);
-            break;
-        case StringStyle::Compact:
+        result = 0x6f626a656374ULL;
 
-            for (QString& key : MAP.keys())
-            {
-                result.append('\"');
-                result.append( toJsonString( key));
-                result.append('\"');
-                result.append(':');
-                result.append( MAP.value(key)->toString( style));
-                result.append(',');
-            }
+        for (auto it = MAP.cbegin(); it != MAP.cend(); ++it)
+            result = combineHash( combineHash( result, qHash( it.key())), it.value()->contentHash());
 
-            if (!MAP.isEmpty())
-                result.chop(1);
-            break;
-        }
-        result.append('}');
+        result = qMax( result, quint64(1));
+        HASH.store( result, std::memory_order_relaxed);
+        return result;
+    }
+
+    void markDirty()
+    {
+        FRAGMENTS[ StringStyle::Compact].clear();
+        FRAGMENTS[ StringStyle::Readable].clear();
+        HASH.store( 0, std::memory_order_relaxed);
+    }
+
+    qint64 memoryUsage()
+    {
+        qint64 result = sizeof(JsonObject) + MAP.size() * sizeof(QMapNode<QString, JsonType*>)
+                      + byteArrayMemory( FRAGMENTS[ StringStyle::Compact].TEXT) + byteArrayMemory( FRAGMENTS[ StringStyle::Readable].TEXT);
+
+        for (auto it = MAP.cbegin(); it != MAP.cend(); ++it)
+            result += stringMemory( it.key()) + it.value()->memoryUsage();
+
+        return result;
+    }
+
+    QVariantList keys()
+    {
+        QVariantList result;
+
+        for (QString str : MAP.keys())
+            result.append( str);
 
         return result;
     }
 
+    QString toString( StringStyle style, int indentation = 0);      // See JsonWriter.
+
     bool isValidKey( const QVariant& key)
     {
         if (key.type() == QVariant::String)
@@ -311,7 +663,7 @@ public:
     JsonType* insertWeak( const QVariant& key, JsonType* fresh_element)
     {
         if (!insertBase( key, fresh_element))
-            delete fresh_element;
+            release( fresh_element);
 
         return INSERTED_ELEMENT;
     }
@@ -320,25 +672,24 @@ public:
     {
         if (!insertBase( key, fresh_element))
         {
-            delete INSERTED_ELEMENT;
+            release( INSERTED_ELEMENT);
             MAP.insert( key.toString(), fresh_element);
         }
         return fresh_element;
     }
 
-    void setValue( const QVariant& key, const QVariant& value)              // key is expected to be a string.
+    void setValue( const QVariant& key, QVariant value)                     // key is expected to be a string.
     {
-        if (MAP.contains( key.toString()))
+        auto it = MAP.find( key.toString());                                // One lookup.
+
+        if (it == MAP.end())
         {
-            if (MAP[ key.toString()]->hasType != Type::Value)
-            {
-                remove( key);                                               // It deletes any existing object or array.
-                MAP.insert( key.toString(), new JsonValue(value));
-            } else {
-                MAP[ key.toString()]->setValue( {}, value);
-            }
+            MAP.insert( key.toString(), new JsonValue( std::move( value)));
+        } else if (it.value()->hasType != Type::Value || it.value()->isShared()) {
+            release( it.value());                                           // It deletes any existing object or array.
+            it.value() = new JsonValue( std::move( value));
         } else {
-        MAP.insert( key.toString(), new JsonValue(value));
+            it.value()->setValue( {}, std::move( value));
         }
     }
 
@@ -358,7 +709,7 @@ public:
 
     bool remove( const QVariant& key)
     {
-        delete MAP.value( key.toString(), nullptr);
+        release( MAP.value( key.toString(), nullptr));
         int i = MAP.remove( key.toString());
         return i==0 ? false : true;
     }
@@ -377,198 +728,2382 @@ public:
 
 class JsonArray : public JsonType
 {
+public:
+    enum Packing {NOT_PACKED, PACKED_INT, PACKED_LONG_LONG, PACKED_DOUBLE, PACKED_BOOL};
+
 private:
     JsonType* INSERTED_ELEMENT = 0;
 
-    bool insertBase( const QVariant& key, JsonType* fresh_element)
+    bool insertBase( const QVariant& key, JsonType* fresh_element)  // The array must be unpacked.
     {
         inflate( key.toInt() + 1);
-        JsonType* val = value( key);
+        JsonType*& slot = elementAt( key.toInt());
+        JsonType* val = slot;
 
         if (val != nullptr)
         {
             if (val->hasType != fresh_element->hasType)
             {
-                delete val;
+                release( val);
             } else {
                 INSERTED_ELEMENT = val;
                 return false;
             }
         }
-        ARRAY[ key.toInt()] = fresh_element;
+        slot = fresh_element;
         INSERTED_ELEMENT = fresh_element;
+        densifyIfFull();
         return true;
     }
 
-public:
-    JsonArray()
-    {
-        setType( Type::Array);
+    JsonType*& elementAt( int index)                        // The array must be unpacked. A hole in a sparse
+    {                                                       // array is a nullptr.
+        if (IS_SPARSE)
+            return SPARSE_ELEMENTS[ index];
+        return ARRAY[ index];
     }
 
-    ~JsonArray()
+    static bool isNull( JsonType* element)
     {
-        for (JsonType* jt : ARRAY)
-            delete jt;
+        return (element->hasType == Type::Value && static_cast<JsonValue*>(element)->VALUE.isNull());
     }
 
-    QList<JsonType*> ARRAY;
-
-    bool isValidKey( const QVariant& key)
+    void makeSparse()                                       // Only the non-null elements are kept.
     {
-        if (key.type() == QVariant::Int && key.toInt() >= 0)
-            return true;
-        return false;
+        for (int i = 0; i < ARRAY.size(); ++i)
+        {
+            if (isNull( ARRAY.at(i)))
+                release( ARRAY.at(i));
+            else
+                SPARSE_ELEMENTS.insert( SPARSE_ELEMENTS.cend(), i, ARRAY.at(i));
+        }
+        SPARSE_SIZE = ARRAY.size();
+        ARRAY.clear();
+        IS_SPARSE = true;
     }
 
-    void inflate( int elementCount)
+    void densifyIfFull()                                    // A sparse array that's mostly filled becomes a list again.
     {
-        while (ARRAY.size() < elementCount)
-            ARRAY.append( new JsonValue());
-    }
+        if (!IS_SPARSE || SPARSE_ELEMENTS.size() * 2 <= SPARSE_SIZE)
+            return;
 
-    QVariantList keys()
-    {
-        QVariantList result;
+        ARRAY.reserve( SPARSE_SIZE);
 
-        for (int i = 0; i < ARRAY.size(); ++i)
-            result.append(i);
+        for (auto it = SPARSE_ELEMENTS.cbegin(); it != SPARSE_ELEMENTS.cend(); ++it)
+        {
+            while (ARRAY.size() < it.key())
+                ARRAY.append( new JsonValue());
+            ARRAY.append( it.value());
+        }
 
-        return result;
+        while (ARRAY.size() < SPARSE_SIZE)
+            ARRAY.append( new JsonValue());
+
+        SPARSE_ELEMENTS.clear();
+        SPARSE_SIZE = 0;
+        IS_SPARSE = false;
     }
 
-    QString toString( StringStyle style, int indentation = 0)
-    {
-        QString result;
-        result.append('[');
+    void shiftSparse( int from, int offset)                 // Moves the elements from position from by offset. A negative
+    {                                                       // offset deletes the elements that are moved over.
+        QMap<int, JsonType*> shifted;
 
-        switch(style)
+        for (auto it = SPARSE_ELEMENTS.cbegin(); it != SPARSE_ELEMENTS.cend(); ++it)
         {
-        case StringStyle::Readable:
-            for (JsonType* jt : ARRAY)
-            {
-                result.append('\n');
-                indent( result, indentation);
-                result.append( jt->toString( style, indentation + 1));
-                result.append(",");
-            }
-
-            if (!ARRAY.isEmpty())
-                result.chop(1);
-
-            result.append('\n');
-            indent( result, indentation - 1);
-            break;
-        case StringStyle::Compact:
-            for (JsonType* jt : ARRAY)
-            {
-                result.append( jt->toString( style));
-                result.append(',');
-            }
-
-            if (!ARRAY.isEmpty())
-                result.chop(1);
-            break;
+            if (it.key() >= from)
+                shifted.insert( shifted.cend(), it.key() + offset, it.value());
+            else if (it.key() >= from + offset)
+                release( it.value());
+            else
+                shifted.insert( shifted.cend(), it.key(), it.value());
         }
-
-        result.append(']');
-        return result;
+        SPARSE_ELEMENTS = shifted;
+        SPARSE_SIZE += offset;
     }
 
-    JsonType* insertWeak( const QVariant& key, JsonType* fresh_element)
+    static Packing packingOf( const QVariant& value)
     {
-        if (!isValidKey( key))      // Can I just assume that it's valid?
+        switch (static_cast<QMetaType::Type>(value.type()))
         {
-            delete fresh_element;
-            return nullptr;
+        case QMetaType::Int:        return PACKED_INT;
+        case QMetaType::LongLong:   return PACKED_LONG_LONG;
+        case QMetaType::Double:     return PACKED_DOUBLE;
+        case QMetaType::Bool:       return PACKED_BOOL;
+        default:                    return NOT_PACKED;
         }
+    }
 
-        if (!insertBase( key, fresh_element))
-            delete fresh_element;
+    QVariant packedValue( int index)
+    {
+        switch (PACKING)
+        {
+        case PACKED_INT:        return QVariant( int( PACKED_INTEGERS.at( PACKED_FRONT + index)));
+        case PACKED_LONG_LONG:  return QVariant( qlonglong( PACKED_INTEGERS.at( PACKED_FRONT + index)));
+        case PACKED_DOUBLE:     return QVariant( PACKED_DOUBLES.at( PACKED_FRONT + index));
+        case PACKED_BOOL:       return QVariant( PACKED_BOOLS.at( PACKED_FRONT + index));
+        default:                return QVariant();
+        }
+    }
+
+    void storePacked( int index, const QVariant& value)     // The value must match the packing.
+    {
+        switch (PACKING)
+        {
+        case PACKED_INT: case PACKED_LONG_LONG: PACKED_INTEGERS[ PACKED_FRONT + index] = value.toLongLong();    break;
+        case PACKED_DOUBLE:                     PACKED_DOUBLES[ PACKED_FRONT + index] = value.toDouble();       break;
+        case PACKED_BOOL:                       PACKED_BOOLS[ PACKED_FRONT + index] = value.toBool();           break;
+        default: break;
+        }
+    }
+
+    template <class T>
+    void openPacked( QVector<T>& buffer, int index, int count)     // Makes room for count elements before index.
+    {
+        if (index == 0)                                             // The unused slots at the front make prepending O(1).
+        {
+            if (PACKED_FRONT < count)
+            {
+                int room = qMax( count, buffer.size() - PACKED_FRONT);
+                buffer.insert( buffer.begin(), room, T());
+                PACKED_FRONT += room;
+            }
+            PACKED_FRONT -= count;
+        } else {
+            buffer.insert( buffer.begin() + PACKED_FRONT + index, count, T());
+        }
+    }
+
+    template <class T>
+    void closePacked( QVector<T>& buffer, int index, int count)    // Removes count elements from index.
+    {
+        if (index == 0)                                             // Popping the first element is O(1), the slots are
+        {                                                           // reused, or released once they outnumber the elements.
+            PACKED_FRONT += count;
+
+            if (PACKED_FRONT > 2 * (buffer.size() - PACKED_FRONT) + 16)
+            {
+                buffer.remove( 0, PACKED_FRONT);
+                PACKED_FRONT = 0;
+            }
+        } else {
+            buffer.remove( PACKED_FRONT + index, count);
+        }
+    }
+
+    void openPackedRange( int index, int count)
+    {
+        switch (PACKING)
+        {
+        case PACKED_INT: case PACKED_LONG_LONG: openPacked( PACKED_INTEGERS, index, count); break;
+        case PACKED_DOUBLE:                     openPacked( PACKED_DOUBLES, index, count);  break;
+        case PACKED_BOOL:                       openPacked( PACKED_BOOLS, index, count);    break;
+        default: break;
+        }
+    }
+
+    void closePackedRange( int index, int count)
+    {
+        switch (PACKING)
+        {
+        case PACKED_INT: case PACKED_LONG_LONG: closePacked( PACKED_INTEGERS, index, count); break;
+        case PACKED_DOUBLE:                     closePacked( PACKED_DOUBLES, index, count);  break;
+        case PACKED_BOOL:                       closePacked( PACKED_BOOLS, index, count);    break;
+        default: break;
+        }
+    }
+
+    template <class T>
+    static QVector<T> denseCopy( const QVector<T>& buffer, int from)   // A copy without unused capacity.
+    {
+        QVector<T> result;
+
+        if (buffer.size() > from)
+        {
+            result.reserve( buffer.size() - from);
+
+            for (int i = from; i < buffer.size(); ++i)
+                result.append( buffer.at(i));
+        }
+        return result;
+    }
+
+    bool canPack( int index, Packing packing)               // Unpacks the array, if it can't be packed with a value of
+    {                                                       // that packing inserted before index.
+        if (PACKING == NOT_PACKED && !IS_SPARSE && ARRAY.isEmpty() && index == 0)     // An empty array becomes packed.
+            PACKING = packing;
+
+        if (PACKING == NOT_PACKED)
+            return false;
+
+        if (packing != PACKING || index > size())
+        {
+            unpack();
+            return false;
+        }
+        return true;
+    }
+
+    bool insertPacked( int index, const QVariant& value)    // Inserts before index. Returns false, if the array
+    {                                                       // can't be (or become) packed with the value.
+        if (!canPack( index, packingOf( value)))
+            return false;
+
+        openPackedRange( index, 1);
+        storePacked( index, value);
+        return true;
+    }
+
+    bool insertPacked( int index, const QVariantList& values)
+    {
+        Packing packing = packingOf( values.first());
+
+        for (const QVariant& value : values)
+            if (packingOf( value) != packing)
+                packing = NOT_PACKED;
+
+        if (!canPack( index, packing))
+            return false;
+
+        openPackedRange( index, values.size());
+
+        for (int i = 0; i < values.size(); ++i)
+            storePacked( index + i, values.at(i));
+        return true;
+    }
+
+public:
+    JsonArray()
+    {
+        setType( Type::Array);
+    }
+
+    ~JsonArray()
+    {
+        for (JsonType* jt : ARRAY)
+            release( jt);
+
+        for (JsonType* jt : SPARSE_ELEMENTS)
+            release( jt);
+    }
+
+    QList<JsonType*> ARRAY;                                 // Empty while the array is packed or sparse.
+
+    // An array with long runs of nulls is sparse: only the other elements are stored, by position.
+    // It becomes a list again when at least half of it is filled.
+
+    bool IS_SPARSE = false;
+    QMap<int, JsonType*> SPARSE_ELEMENTS;
+    int SPARSE_SIZE = 0;
+
+    // Arrays that only contain ints, long longs, doubles or booleans (of one kind) are packed:
+    // the numbers are stored in a single buffer, instead of a JsonValue per element.
+    // Anything else that's put in the array unpacks it.
+
+    Packing PACKING = NOT_PACKED;
+    QVector<qint64> PACKED_INTEGERS;                        // PACKED_INT and PACKED_LONG_LONG.
+    QVector<double> PACKED_DOUBLES;
+    QVector<bool> PACKED_BOOLS;
+    int PACKED_FRONT = 0;                                   // Unused slots at the start of the packed buffer.
+
+    Fragment FRAGMENTS[2];                                  // One per StringStyle.
+    std::atomic<quint64> HASH{0};                           // 0 until it's computed, see JsonObject::HASH.
+
+    JsonType* clone()
+    {
+        JsonArray* result = new JsonArray();
+        result->ARRAY = ARRAY;
+        result->PACKING = PACKING;
+        result->PACKED_INTEGERS = PACKED_INTEGERS;
+        result->PACKED_DOUBLES = PACKED_DOUBLES;
+        result->PACKED_BOOLS = PACKED_BOOLS;
+        result->PACKED_FRONT = PACKED_FRONT;
+        result->IS_SPARSE = IS_SPARSE;
+        result->SPARSE_ELEMENTS = SPARSE_ELEMENTS;
+        result->SPARSE_SIZE = SPARSE_SIZE;
+
+        for (JsonType* jt : qAsConst( ARRAY))                       // Const access. The list mustn't detach, since other
+            retain( jt);                                            // threads may be reading this element.
+
+        for (JsonType* jt : qAsConst( SPARSE_ELEMENTS))
+            retain( jt);
+
+        return result;
+    }
+
+    JsonType* compacted()                                           // Picks the smallest representation: a packed array is
+    {                                                               // repacked, and a list that can be packed, is.
+        JsonArray* result = new JsonArray();
+        int count = size();
+
+        if (PACKING != NOT_PACKED)
+        {
+            result->PACKING = PACKING;
+            result->PACKED_INTEGERS = denseCopy( PACKED_INTEGERS, PACKED_FRONT);
+            result->PACKED_DOUBLES = denseCopy( PACKED_DOUBLES, PACKED_FRONT);
+            result->PACKED_BOOLS = denseCopy( PACKED_BOOLS, PACKED_FRONT);
+            return result;
+        }
+
+        if (IS_SPARSE)
+        {
+            result->IS_SPARSE = true;
+            result->SPARSE_SIZE = SPARSE_SIZE;
+
+            for (auto it = SPARSE_ELEMENTS.cbegin(); it != SPARSE_ELEMENTS.cend(); ++it)
+                result->SPARSE_ELEMENTS.insert( result->SPARSE_ELEMENTS.cend(), it.key(), compactedChild( it.value()));
+            return result;
+        }
+
+        Packing packing = (count > 0 && ARRAY.first()->hasType == Type::Value) ? packingOf( static_cast<JsonValue*>(ARRAY.first())->VALUE) : NOT_PACKED;
+        int nullCount = 0;
+
+        for (JsonType* jt : qAsConst( ARRAY))
+        {
+            if (jt->hasType != Type::Value || packingOf( static_cast<JsonValue*>(jt)->VALUE) != packing)
+                packing = NOT_PACKED;
+
+            if (isNull( jt))
+                ++nullCount;
+        }
+
+        if (packing != NOT_PACKED)
+        {
+            switch (packing)
+            {
+            case PACKED_INT: case PACKED_LONG_LONG: result->PACKED_INTEGERS.reserve( count);  break;
+            case PACKED_DOUBLE:                     result->PACKED_DOUBLES.reserve( count);   break;
+            case PACKED_BOOL:                       result->PACKED_BOOLS.reserve( count);     break;
+            default: break;
+            }
+
+            for (JsonType* jt : qAsConst( ARRAY))
+                result->appendValue( static_cast<JsonValue*>(jt)->VALUE);
+            return result;
+        }
+
+        if (nullCount > 2 * (count - nullCount) + 32)
+        {
+            result->IS_SPARSE = true;
+            result->SPARSE_SIZE = count;
+
+            for (int i = 0; i < count; ++i)
+                if (!isNull( ARRAY.at(i)))
+                    result->SPARSE_ELEMENTS.insert( result->SPARSE_ELEMENTS.cend(), i, compactedChild( ARRAY.at(i)));
+            return result;
+        }
+
+        result->ARRAY.reserve( count);
+
+        for (JsonType* jt : qAsConst( ARRAY))
+            result->ARRAY.append( compactedChild( jt));
+
+        return result;
+    }
+
+    quint64 contentHash()
+    {
+        quint64 result = HASH.load( std::memory_order_relaxed);
+
+        if (result != 0)
+            return result;
+
+        result = 0x6172726179ULL;
+
+        for (int i = 0; i < size(); ++i)
+        {
+            JsonType* element = at(i);
+            result = combineHash( result, (element == nullptr) ? valueHash( valueAt(i)) : element->contentHash());
+        }
+
+        result = qMax( result, quint64(1));
+        HASH.store( result, std::memory_order_relaxed);
+        return result;
+    }
+
+    void markDirty()
+    {
+        FRAGMENTS[ StringStyle::Compact].clear();
+        FRAGMENTS[ StringStyle::Readable].clear();
+        HASH.store( 0, std::memory_order_relaxed);
+    }
+
+    qint64 memoryUsage()
+    {
+        qint64 result = sizeof(JsonArray) + vectorMemory( PACKED_INTEGERS) + vectorMemory( PACKED_DOUBLES) + vectorMemory( PACKED_BOOLS)
+                      + byteArrayMemory( FRAGMENTS[ StringStyle::Compact].TEXT) + byteArrayMemory( FRAGMENTS[ StringStyle::Readable].TEXT);
+
+        if (!ARRAY.isEmpty())                                       // QList doesn't tell its capacity.
+            result += sizeof(QListData::Data) + ARRAY.size() * sizeof(void*);
+
+        result += SPARSE_ELEMENTS.size() * sizeof(QMapNode<int, JsonType*>);
+
+        for (JsonType* jt : qAsConst( ARRAY))
+            result += jt->memoryUsage();
+
+        for (JsonType* jt : qAsConst( SPARSE_ELEMENTS))
+            result += jt->memoryUsage();
+
+        return result;
+    }
+
+    bool isValidKey( const QVariant& key)
+    {
+        if (key.type() == QVariant::Int && key.toInt() >= 0)
+            return true;
+        return false;
+    }
+
+    void inflate( int elementCount)
+    {
+        if (size() >= elementCount)
+            return;
+
+        unpack();                                                   // Nulls can't be packed.
+
+        if (!IS_SPARSE && elementCount - ARRAY.size() > 2 * ARRAY.size() + 32)  // Don't allocate a long run of nulls.
+            makeSparse();
+
+        if (IS_SPARSE)
+        {
+            SPARSE_SIZE = elementCount;
+            return;
+        }
+
+        while (ARRAY.size() < elementCount)
+            ARRAY.append( new JsonValue());
+    }
+
+    void unpack()                                                   // Gives every element its own JsonValue.
+    {
+        if (PACKING == NOT_PACKED)
+            return;
+
+        int count = size();
+        ARRAY.reserve( count);
+
+        for (int i = 0; i < count; ++i)
+            ARRAY.append( new JsonValue( packedValue(i)));
+
+        PACKED_INTEGERS.clear();
+        PACKED_DOUBLES.clear();
+        PACKED_BOOLS.clear();
+        PACKED_FRONT = 0;
+        PACKING = NOT_PACKED;
+    }
+
+    void appendValue( const QVariant& value)
+    {
+        if (insertPacked( size(), value))
+            return;
+
+        if (IS_SPARSE)
+            setValue( SPARSE_SIZE, value);
+        else
+            ARRAY.append( new JsonValue( value));
+    }
+
+    void prependValue( const QVariant& value)
+    {
+        if (insertPacked( 0, value))
+            return;
+
+        if (IS_SPARSE)
+            insertRange( 0, {value});
+        else
+            ARRAY.prepend( new JsonValue( value));
+    }
+
+    void insertRange( int at, const QVariantList& values)          // Inserts the values before at (with one shift).
+    {
+        if (values.isEmpty())
+            return;
+
+        inflate( at);
+
+        if (insertPacked( at, values))
+            return;
+
+        if (IS_SPARSE)
+        {
+            shiftSparse( at, values.size());
+
+            for (int i = 0; i < values.size(); ++i)
+                if (!values.at(i).isNull())
+                    SPARSE_ELEMENTS.insert( at + i, new JsonValue( values.at(i)));
+
+            densifyIfFull();
+            return;
+        }
+
+        if (at == 0)
+        {
+            for (int i = values.size() - 1; i >= 0; --i)
+                ARRAY.prepend( new JsonValue( values.at(i)));
+        } else {
+            QList<JsonType*> tail = ARRAY.mid( at);
+            ARRAY.erase( ARRAY.begin() + at, ARRAY.end());
+
+            for (const QVariant& value : values)
+                ARRAY.append( new JsonValue( value));
+            ARRAY.append( tail);
+        }
+    }
+
+    void removeRange( int from, int count)                          // Removes up to count elements from from (with one shift).
+    {
+        if (from < 0 || from >= size())
+            return;
+
+        count = qMin( count, size() - from);
+
+        if (count <= 0)
+            return;
+
+        if (PACKING != NOT_PACKED)
+        {
+            closePackedRange( from, count);
+            return;
+        }
+
+        if (IS_SPARSE)
+        {
+            shiftSparse( from + count, -count);
+            return;
+        }
+
+        for (int i = from; i < from + count; ++i)
+            release( ARRAY.at(i));
+        ARRAY.erase( ARRAY.begin() + from, ARRAY.begin() + from + count);   // QList moves the shorter side.
+    }
+
+    void splice( int from, int removeCount, const QVariantList& values)    // Replaces removeCount elements from from with the values.
+    {
+        removeCount = qMax( 0, qMin( removeCount, size() - from));
+        int overwriteCount = qMin( removeCount, values.size());
+
+        for (int i = 0; i < overwriteCount; ++i)                    // Overlapping elements are replaced in place,
+            setValue( from + i, values.at(i));                      // so only the difference is shifted.
+
+        if (removeCount > overwriteCount)
+            removeRange( from + overwriteCount, removeCount - overwriteCount);
+        else
+            insertRange( from + overwriteCount, values.mid( overwriteCount));
+    }
+
+    QVariantList keys()
+    {
+        QVariantList result;
+
+        for (int i = 0; i < size(); ++i)
+            result.append(i);
+
+        return result;
+    }
+
+    QString toString( StringStyle style, int indentation = 0);      // See JsonWriter.
+
+    JsonType* insertWeak( const QVariant& key, JsonType* fresh_element)
+    {
+        if (!isValidKey( key))      // Can I just assume that it's valid?
+        {
+            release( fresh_element);
+            return nullptr;
+        }
+
+        unpack();                   // The inserted element is returned, so it must exist.
+
+        if (!insertBase( key, fresh_element))
+            release( fresh_element);
+
+        return INSERTED_ELEMENT;
+    }
+
+    JsonType* insertStrong( const QVariant& key, JsonType* fresh_element)
+    {
+        if (!isValidKey( key))      // Can I just assume that it's valid?
+        {
+            qWarning("JsonWax-insert error: invalid key.");
+            release( fresh_element);
+            return 0;
+        }
+
+        unpack();
+
+        if (!insertBase( key, fresh_element))
+        {
+            release( INSERTED_ELEMENT);
+            elementAt( key.toInt()) = fresh_element;
+        }
+        return fresh_element;
+    }
+
+    void setValue( const QVariant& key, QVariant value)         // Key is required to be an int.
+    {
+        if (!isValidKey( key))
+        {
+            qWarning("JsonWax-insert error: invalid key.");
+            return;
+        }
+
+        int intkey = key.toInt();
+
+        if (PACKING != NOT_PACKED && intkey < size() && packingOf( value) == PACKING)
+        {
+            storePacked( intkey, value);
+            return;
+        }
+
+        if (intkey == size() && insertPacked( intkey, value))     // Appends to a packed (or empty) array.
+            return;
+
+        unpack();
+        inflate( intkey + 1);
+
+        if (IS_SPARSE && value.isNull())                            // Stays a hole.
+        {
+            release( SPARSE_ELEMENTS.take( intkey));
+            return;
+        }
+
+        JsonType*& slot = elementAt( intkey);
+
+        if (slot == nullptr || slot->hasType != Type::Value || slot->isShared())
+        {
+            release( slot);
+            slot = new JsonValue( std::move( value));
+            densifyIfFull();
+        } else {
+            slot->setValue( {}, std::move( value));
+        }
+    }
+
+    JsonType* at( int index)                                // Like value(), for an index that's known to be in range. Packed
+    {                                                       // elements and holes have no element of their own, so they're
+        if (PACKING != NOT_PACKED)                          // nullptr: read them with typeAt() and valueAt().
+            return nullptr;
+
+        if (IS_SPARSE)
+            return SPARSE_ELEMENTS.value( index, nullptr);
+
+        return ARRAY.at( index);
+    }
+
+    Type typeAt( int index)                                 // For an index that's known to be in range.
+    {
+        JsonType* element = at( index);
+        return (element == nullptr) ? Type::Value : element->hasType;
+    }
+
+    QVariant valueAt( int index)                            // For an index that's known to be in range. Null for
+    {                                                       // objects and arrays.
+        if (PACKING != NOT_PACKED)
+            return packedValue( index);
+
+        JsonType* element = at( index);
+
+        if (element == nullptr || element->hasType != Type::Value)
+            return QVariant();
+        return static_cast<JsonValue*>(element)->VALUE;
+    }
+
+    JsonType* value( const QVariant& key)
+    {
+        if (!contains( key))
+            return nullptr;
+
+        return at( key.toInt());
+    }
+
+    bool contains( const QVariant& key)
+    {
+        if (isValidKey(key) && key.toInt() < size())
+            return true;
+        return false;
+    }
+
+    bool remove( const QVariant& key)
+    {
+        if (!contains( key))
+            return false;
+
+        removeRange( key.toInt(), 1);
+        return true;
+    }
+
+    bool removeWeak( const QVariant& key)
+    {
+        unpack();
+
+        if (key.isNull())
+            ARRAY[ key.toInt()] = new JsonValue();
+
+        if (!contains( key))
+            return false;
+
+        if (IS_SPARSE)
+            SPARSE_ELEMENTS.remove( key.toInt());
+        else
+            ARRAY[ key.toInt()] = new JsonValue();
+        return true;
+    }
+
+    int size()
+    {
+        switch (PACKING)
+        {
+        case PACKED_INT: case PACKED_LONG_LONG: return PACKED_INTEGERS.size() - PACKED_FRONT;
+        case PACKED_DOUBLE:                     return PACKED_DOUBLES.size() - PACKED_FRONT;
+        case PACKED_BOOL:                       return PACKED_BOOLS.size() - PACKED_FRONT;
+        default:                                return IS_SPARSE ? SPARSE_SIZE : ARRAY.size();
+        }
+    }
+};
+
+// ---------------------------------------------------------
+
+class WriterTask : public QRunnable                                 // Runs work() on a QThreadPool thread, see JsonWriter.
+{
+private:
+    std::function<void()> WORK;
+    QSemaphore& FINISHED;
+
+public:
+    WriterTask( const std::function<void()>& work, QSemaphore& finished) : WORK( work), FINISHED( finished){}
+
+    void run() override
+    {
+        WORK();
+        FINISHED.release();
+    }
+};
+
+// ---------------------------------------------------------
+
+// A JsonWriter serializes elements as UTF-8 into one growing buffer: every element appends its text
+// once, where it belongs, instead of returning its own string for the parent to copy. With a device,
+// the text is written out whenever CHUNK_SIZE bytes have been collected, so the memory used
+// doesn't depend on the size of the document. Fragments (see FragmentScope) are used where they're
+// cached. They're only stored without a device, since with one, the text may already be written out.
+// In parallel mode (see setParallel()), large objects and arrays are split into chunks of children,
+// which are written on QThreadPool threads into buffers of their own, and joined in order.
+
+class JsonWriter
+{
+private:
+    static const int CHUNK_SIZE = 64 * 1024;
+    static const int PARALLEL_MIN_ELEMENTS = 50000;                 // Smaller objects and arrays aren't worth the threads.
+    static const int PARALLEL_MIN_CHILDREN = 16;
+
+    QByteArray BUFFER;
+    QIODevice* DEVICE;
+    StringStyle STYLE;
+    int SIZE_HINT;
+    bool IS_PARALLEL = false;
+    bool HAS_ERROR = false;
+
+    void flushIfFull()
+    {
+        if (DEVICE != nullptr && BUFFER.size() >= CHUNK_SIZE)
+            flush();
+    }
+
+    void writeIndent( int indentation)
+    {
+        for (int i = 0; i < indentation; ++i)
+            BUFFER.append("    ");
+    }
+
+    void writeString( const QString& text)
+    {
+        BUFFER.append('\"');
+        appendJsonString( BUFFER, text);
+        BUFFER.append('\"');
+    }
+
+    void writeValue( const QVariant& value)                         // Like JsonValue::toString().
+    {
+        switch (static_cast<QMetaType::Type>(value.type()))
+        {
+        case QMetaType::QString: case QMetaType::QChar:
+            writeString( value.toString());
+            break;
+        case QMetaType::Int:        writeInteger( *static_cast<const int*>(value.constData()));         break;
+        case QMetaType::UInt:       writeInteger( *static_cast<const uint*>(value.constData()));        break;
+        case QMetaType::LongLong:   writeInteger( *static_cast<const qlonglong*>(value.constData()));   break;
+        case QMetaType::ULongLong:  writeUnsigned( *static_cast<const qulonglong*>(value.constData())); break;
+        case QMetaType::Double:     writeDouble( *static_cast<const double*>(value.constData()));       break;
+        case QMetaType::Float:      writeFloat( *static_cast<const float*>(value.constData()));         break;
+        case QMetaType::Bool:
+            writeBool( *static_cast<const bool*>(value.constData()));
+            break;
+        case QMetaType::UnknownType:
+            BUFFER.append("null");
+            break;
+        default:
+            BUFFER.append("ERROR");
+        }
+    }
+
+    void writeInteger( qint64 value)                                // Numbers are formatted in place, see JsonWaxNumbers.h.
+    {
+        char text[ NUMBER_BUFFER_SIZE];
+        BUFFER.append( text, formatInteger( text, value));
+    }
+
+    void writeUnsigned( quint64 value)
+    {
+        char text[ NUMBER_BUFFER_SIZE];
+        BUFFER.append( text, formatUnsigned( text, value));
+    }
+
+    void writeDouble( double value)
+    {
+        char text[ NUMBER_BUFFER_SIZE];
+        BUFFER.append( text, formatDouble( text, value));
+    }
+
+    void writeFloat( float value)
+    {
+        char text[ NUMBER_BUFFER_SIZE];
+        BUFFER.append( text, formatFloat( text, value));
+    }
+
+    void writeBool( bool value)
+    {
+        if (value)
+            BUFFER.append( "true", 4);
+        else
+            BUFFER.append( "false", 5);
+    }
+
+    void writePacked( JsonArray* array, int index)                  // Without a QVariant. Holes are null.
+    {
+        switch (array->PACKING)
+        {
+        case JsonArray::PACKED_INT: case JsonArray::PACKED_LONG_LONG:
+            writeInteger( array->PACKED_INTEGERS.at( array->PACKED_FRONT + index));
+            break;
+        case JsonArray::PACKED_DOUBLE:
+            writeDouble( array->PACKED_DOUBLES.at( array->PACKED_FRONT + index));
+            break;
+        case JsonArray::PACKED_BOOL:
+            writeBool( array->PACKED_BOOLS.at( array->PACKED_FRONT + index));
+            break;
+        default:
+            BUFFER.append("null");
+        }
+    }
+
+    static qint64 countElements( JsonType* element, qint64 limit)  // In the subtree, but stops counting at about limit.
+    {
+        qint64 count = 1;
+
+        if (element->hasType == Type::Object)
+        {
+            QMap<QString, JsonType*>& map = static_cast<JsonObject*>(element)->MAP;
+
+            for (auto it = map.cbegin(); it != map.cend() && count < limit; ++it)
+                count += countElements( it.value(), limit - count);
+        } else if (element->hasType == Type::Array) {
+            JsonArray* array = static_cast<JsonArray*>(element);
+
+            if (array->PACKING != JsonArray::NOT_PACKED)
+                return count + array->size();
+
+            for (int i = 0; i < array->size() && count < limit; ++i)
+            {
+                JsonType* child = array->at(i);
+                count += (child == nullptr) ? 1 : countElements( child, limit - count);
+            }
+        }
+        return count;
+    }
+
+    bool isParallelHere( JsonType* element, int childCount)         // Large enough to be split up. Turns IS_PARALLEL off
+    {                                                               // for small elements, since their children are smaller.
+        if (IS_PARALLEL && countElements( element, PARALLEL_MIN_ELEMENTS) < PARALLEL_MIN_ELEMENTS)
+            IS_PARALLEL = false;
+
+        return IS_PARALLEL && childCount >= PARALLEL_MIN_CHILDREN;
+    }
+
+    template <typename WriteChunk>
+    void writeInParallel( int chunkCount, WriteChunk writeChunk)   // writeChunk( JsonWriter& writer, int chunk) writes the
+    {                                                               // children of one chunk. The texts are joined in order.
+        QVector<QByteArray> texts( chunkCount);
+        QByteArray* outputs = texts.data();
+        std::atomic<int> next( 0);
+        QSemaphore finished;
+        StringStyle style = STYLE;
+        bool convertToCodePoints = CONVERT_TO_CODE_POINTS;          // Thread local, so they're handed over.
+        bool cacheFragments = CACHE_FRAGMENTS;                      // (The children of one element are separate subtrees, so
+                                                                    // threads never store the same fragment, see Fragment.)
+        std::function<void()> work = [&]()
+        {
+            bool wasConverting = CONVERT_TO_CODE_POINTS;
+            bool wasCaching = CACHE_FRAGMENTS;
+            CONVERT_TO_CODE_POINTS = convertToCodePoints;
+            CACHE_FRAGMENTS = cacheFragments;
+
+            for (int chunk = next++; chunk < chunkCount; chunk = next++)
+            {
+                JsonWriter writer( style);
+                writeChunk( writer, chunk);
+                outputs[ chunk] = writer.text();
+            }
+            CONVERT_TO_CODE_POINTS = wasConverting;
+            CACHE_FRAGMENTS = wasCaching;
+        };
+
+        QThreadPool* pool = QThreadPool::globalInstance();          // Only idle threads are used, and this thread works
+        int started = 0;                                            // too, so it never waits for a task that isn't running.
+
+        while (started + 1 < qMin( chunkCount, pool->maxThreadCount()))
+        {
+            WriterTask* task = new WriterTask( work, finished);
+
+            if (!pool->tryStart( task))
+            {
+                delete task;
+                break;
+            }
+            ++started;
+        }
+
+        work();
+        finished.acquire( started);
+
+        for (const QByteArray& text : texts)
+        {
+            BUFFER.append( text);
+            flushIfFull();
+        }
+    }
+
+    template <typename WriteRange>
+    void writeChildrenInParallel( int count, WriteRange writeRange)    // writeRange( JsonWriter& writer, int first, int last)
+    {
+        int threadCount = qMax( 1, QThreadPool::globalInstance()->maxThreadCount());
+        int roundSize = count;
+
+        if (DEVICE != nullptr)                                          // In 16 rounds, so only a part of the text is held.
+            roundSize = qMax( int( PARALLEL_MIN_CHILDREN), (count + 15) / 16);
+
+        for (int first = 0; first < count; first += roundSize)
+        {
+            int last = qMin( count, first + roundSize);
+            int chunkSize = (last - first + 4 * threadCount - 1) / (4 * threadCount);     // A few chunks per thread, to even
+            int chunkCount = (last - first + chunkSize - 1) / chunkSize;                // out their sizes.
+
+            writeInParallel( chunkCount, [&]( JsonWriter& writer, int chunk)
+            {
+                writeRange( writer, first + chunk * chunkSize, qMin( last, first + (chunk + 1) * chunkSize));
+            });
+        }
+    }
+
+    void writeMember( QMap<QString, JsonType*>::const_iterator it, bool isFirst, int indentation)
+    {
+        if (!isFirst)
+            BUFFER.append( (STYLE == StringStyle::Readable) ? ",\n" : ",");
+
+        if (STYLE == StringStyle::Readable)
+            writeIndent( indentation);
+
+        writeString( it.key());
+        BUFFER.append( (STYLE == StringStyle::Readable) ? ": " : ":");
+        write( it.value(), indentation + 1);
+        flushIfFull();
+    }
+
+    void writeElement( JsonArray* array, int index, int indentation)
+    {
+        if (index > 0)
+            BUFFER.append(',');
+
+        if (STYLE == StringStyle::Readable)
+        {
+            BUFFER.append('\n');
+            writeIndent( indentation);
+        }
+
+        JsonType* element = array->at( index);
+
+        if (element == nullptr)
+            writePacked( array, index);
+        else
+            write( element, indentation + 1);
+        flushIfFull();
+    }
+
+    void writeObject( JsonObject* object, int indentation)
+    {
+        BUFFER.append('{');
+
+        if (STYLE == StringStyle::Readable)
+            BUFFER.append('\n');
+
+        const QMap<QString, JsonType*>& map = object->MAP;
+        bool wasParallel = IS_PARALLEL;
+
+        if (isParallelHere( object, map.size()))
+        {
+            QVector<QMap<QString, JsonType*>::const_iterator> members;     // So a chunk can start anywhere.
+            members.reserve( map.size());
+
+            for (auto it = map.cbegin(); it != map.cend(); ++it)
+                members.append( it);
+
+            writeChildrenInParallel( map.size(), [&]( JsonWriter& writer, int first, int last)
+            {
+                for (int i = first; i < last; ++i)
+                    writer.writeMember( members.at(i), i == 0, indentation);
+            });
+        } else {
+            for (auto it = map.cbegin(); it != map.cend(); ++it)
+                writeMember( it, it == map.cbegin(), indentation);
+        }
+        IS_PARALLEL = wasParallel;
+
+        if (STYLE == StringStyle::Readable)
+        {
+            BUFFER.append('\n');
+            writeIndent( indentation - 1);
+        }
+        BUFFER.append('}');
+    }
+
+    void writeArray( JsonArray* array, int indentation)
+    {
+        BUFFER.append('[');
+        int count = array->size();
+        bool wasParallel = IS_PARALLEL;
+
+        if (isParallelHere( array, count))
+        {
+            writeChildrenInParallel( count, [&]( JsonWriter& writer, int first, int last)
+            {
+                for (int i = first; i < last; ++i)
+                    writer.writeElement( array, i, indentation);
+            });
+        } else {
+            for (int i = 0; i < count; ++i)
+                writeElement( array, i, indentation);
+        }
+        IS_PARALLEL = wasParallel;
+
+        if (STYLE == StringStyle::Readable)
+        {
+            BUFFER.append('\n');
+            writeIndent( indentation - 1);
+        }
+        BUFFER.append(']');
+    }
+
+public:
+    JsonWriter( StringStyle style, QIODevice* device = nullptr, int sizeHint = 0)      // sizeHint: the expected size of the text.
+        : DEVICE( device), STYLE( style), SIZE_HINT( sizeHint){}
+
+    void write( JsonType* element, int indentation = 1)             // CONVERT_TO_CODE_POINTS and CACHE_FRAGMENTS must be set.
+    {
+        if (element->hasType == Type::Value)
+        {
+            writeValue( static_cast<JsonValue*>(element)->VALUE);
+            return;
+        }
+
+        Fragment* fragments = (element->hasType == Type::Object) ? static_cast<JsonObject*>(element)->FRAGMENTS
+                                                                 : static_cast<JsonArray*>(element)->FRAGMENTS;
+        FragmentScope fragment( fragments[ STYLE], element->isShared(), STYLE, indentation);
+
+        if (fragment.isCached())
+        {
+            BUFFER.append( fragment.text());                        // Shares the fragment, if nothing came before it.
+            return;
+        }
+
+        if (BUFFER.isEmpty() && DEVICE == nullptr && SIZE_HINT > 0) // The buffer grows only once, if the hint is right.
+            BUFFER.reserve( SIZE_HINT);
+
+        int start = BUFFER.size();
+
+        if (element->hasType == Type::Object)
+            writeObject( static_cast<JsonObject*>(element), indentation);
+        else
+            writeArray( static_cast<JsonArray*>(element), indentation);
+
+        if (DEVICE == nullptr && fragment.isCacheable())
+            fragment.store( BUFFER.mid( start));                    // The root's fragment shares the buffer.
+    }
+
+    bool flush()                                                    // Writes out the rest of the text. False if the
+    {                                                               // device failed.
+        if (DEVICE != nullptr && !BUFFER.isEmpty())
+        {
+            if (DEVICE->write( BUFFER) != BUFFER.size())
+                HAS_ERROR = true;
+            BUFFER.clear();
+            BUFFER.reserve( CHUNK_SIZE + CHUNK_SIZE / 4);
+        }
+        return !HAS_ERROR;
+    }
+
+    void setParallel( bool parallel)                                // Large objects and arrays are split into chunks of
+    {                                                               // children, which are written on QThreadPool threads
+        IS_PARALLEL = parallel;                                     // into their own buffers. The text is the same.
+    }
+
+    QByteArray& text()                                              // What's been written, without a device.
+    {
+        return BUFFER;
+    }
+};
+
+inline QString JsonValue::toString( StringStyle style, int indentation)
+{
+    JsonWriter writer( style);
+    writer.write( this, indentation);
+    return QString::fromUtf8( writer.text());
+}
+
+inline QString JsonObject::toString( StringStyle style, int indentation)
+{
+    JsonWriter writer( style);
+    writer.write( this, indentation);
+    return QString::fromUtf8( writer.text());
+}
+
+inline QString JsonArray::toString( StringStyle style, int indentation)
+{
+    JsonWriter writer( style);
+    writer.write( this, indentation);
+    return QString::fromUtf8( writer.text());
+}
+
+// ---------------------------------------------------------
+
+// A JsonNode is a read-only view of one element, and JsonChildren iterates over the (key, node)
+// pairs of an object or array without building a list of keys or walking from the root again.
+// The key is a QString for objects and an int for arrays; neither allocates inside a QVariant.
+// Packed elements and holes of arrays have no element of their own, so their node holds the array
+// and the index, and element() is nullptr. Nodes and iterators are only valid until the document is changed.
+
+class JsonChildren;
+
+class JsonNode
+{
+private:
+    JsonType* ELEMENT = nullptr;
+    JsonArray* ARRAY = nullptr;                             // Elements of arrays are looked up when used.
+    int INDEX = -1;
+
+public:
+    JsonNode(){}
+
+    JsonNode( JsonType* element) : ELEMENT(element){}
+
+    JsonNode( JsonArray* array, int index) : ARRAY(array), INDEX(index){}
+
+    JsonType* element() const                               // nullptr for a packed element or a hole.
+    {
+        return (ARRAY != nullptr) ? ARRAY->at( INDEX) : ELEMENT;
+    }
+
+    inline JsonChildren children() const;
+
+    bool exists() const
+    {
+        return (ARRAY != nullptr || ELEMENT != nullptr);
+    }
+
+    bool isArray() const
+    {
+        return (type() == Type::Array);
+    }
+
+    bool isObject() const
+    {
+        return (type() == Type::Object);
+    }
+
+    bool isValue() const
+    {
+        return (type() == Type::Value);
+    }
+
+    int size() const
+    {
+        if (!exists())
+            return -1;
+
+        JsonType* found = element();
+        return (found == nullptr) ? 1 : found->size();
+    }
+
+    Type type() const
+    {
+        if (ARRAY != nullptr)
+            return ARRAY->typeAt( INDEX);
+
+        return (ELEMENT != nullptr) ? ELEMENT->hasType : Type::Null;
+    }
+
+    QVariant value( const QVariant& defaultValue = QVariant()) const
+    {
+        if (type() != Type::Value)
+            return defaultValue;
+
+        if (ARRAY != nullptr)
+            return ARRAY->valueAt( INDEX);
+
+        return static_cast<JsonValue*>(ELEMENT)->VALUE;
+    }
+};
+
+static JsonNode childNode( JsonType* parent, const QVariant& key)  // The node at key in parent, which may be nullptr.
+{
+    if (parent == nullptr)
+        return JsonNode();
+
+    if (parent->hasType == Type::Array)
+        return parent->contains( key) ? JsonNode( static_cast<JsonArray*>(parent), key.toInt()) : JsonNode();
+
+    return JsonNode( parent->value( key));
+}
+
+static quint64 nodeHash( const JsonNode& node)                      // See JsonType::contentHash(). 0 if the node doesn't exist.
+{
+    if (!node.exists())
+        return 0;
+
+    JsonType* element = node.element();
+    return (element == nullptr) ? valueHash( node.value()) : element->contentHash();
+}
+
+class JsonChildIterator
+{
+private:
+    JsonType* PARENT = nullptr;
+    QMap<QString, JsonType*>::const_iterator IT;            // Objects.
+    int INDEX = 0;                                          // Arrays.
+
+public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef std::pair<QVariant, JsonNode> value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const value_type* pointer;
+    typedef value_type reference;
+
+    JsonChildIterator(){}
+
+    JsonChildIterator( JsonType* parent, QMap<QString, JsonType*>::const_iterator it) : PARENT(parent), IT(it){}
+
+    JsonChildIterator( JsonType* parent, int index) : PARENT(parent), INDEX(index){}
+
+    value_type operator * () const
+    {
+        if (PARENT->hasType == Type::Object)
+            return value_type( IT.key(), JsonNode( IT.value()));
+        return value_type( INDEX, JsonNode( static_cast<JsonArray*>(PARENT), INDEX));
+    }
+
+    JsonChildIterator& operator ++ ()
+    {
+        if (PARENT->hasType == Type::Object)
+            ++IT;
+        else
+            ++INDEX;
+        return *this;
+    }
+
+    JsonChildIterator operator ++ (int)
+    {
+        JsonChildIterator previous = *this;
+        ++(*this);
+        return previous;
+    }
+
+    bool operator == ( const JsonChildIterator& other) const
+    {
+        if (PARENT == nullptr || PARENT->hasType != Type::Object)
+            return (PARENT == other.PARENT && INDEX == other.INDEX);
+        return (PARENT == other.PARENT && IT == other.IT);
+    }
+
+    bool operator != ( const JsonChildIterator& other) const
+    {
+        return !(*this == other);
+    }
+};
+
+class JsonChildren
+{
+private:
+    JsonType* PARENT = nullptr;                             // Values have no children, and are treated as nullptr.
+
+public:
+    JsonChildren( JsonType* parent)
+    {
+        if (parent != nullptr && parent->hasType != Type::Value)
+            PARENT = parent;
+    }
+
+    JsonChildIterator begin() const
+    {
+        if (PARENT != nullptr && PARENT->hasType == Type::Object)
+            return JsonChildIterator( PARENT, static_cast<JsonObject*>(PARENT)->MAP.constBegin());
+        return JsonChildIterator( PARENT, 0);
+    }
+
+    JsonChildIterator end() const
+    {
+        if (PARENT != nullptr && PARENT->hasType == Type::Object)
+            return JsonChildIterator( PARENT, static_cast<JsonObject*>(PARENT)->MAP.constEnd());
+        return JsonChildIterator( PARENT, (PARENT == nullptr) ? 0 : PARENT->size());
+    }
+
+    template <typename Callback>
+    void forEach( Callback callback) const                  // callback( const QVariant& key, const JsonNode& node)
+    {
+        if (PARENT == nullptr)
+            return;
+
+        if (PARENT->hasType == Type::Object)
+        {
+            const QMap<QString, JsonType*>& map = static_cast<JsonObject*>(PARENT)->MAP;
+
+            for (auto it = map.constBegin(); it != map.constEnd(); ++it)
+                callback( QVariant( it.key()), JsonNode( it.value()));
+        } else {
+            JsonArray* array = static_cast<JsonArray*>(PARENT);
+            int size = array->size();
+
+            for (int i = 0; i < size; ++i)
+                callback( QVariant( i), JsonNode( array, i));
+        }
+    }
+
+    int size() const
+    {
+        return (PARENT == nullptr) ? 0 : PARENT->size();
+    }
+};
+
+inline JsonChildren JsonNode::children() const
+{
+    return JsonChildren( exists() ? element() : nullptr);
+}
+
+// A Snapshot is an immutable version of a document. It shares the elements of the document,
+// which the Editor copies before changing them, so it's cheap to create, and it can be read
+// from other threads while the document is being changed. The elements are deleted when the
+// last Snapshot or Editor holding them lets go of them.
+// A single Snapshot object must not be assigned to while another thread is reading it;
+// give each reader its own copy.
+
+class Snapshot
+{
+    friend class Editor;                                                // See Editor::diff().
+
+private:
+    JsonType* DATA = 0;
+
+    JsonNode node( const QVariantList& keys) const                      // Doesn't cache anything, so readers on
+    {                                                                   // different threads don't interfere.
+        if (keys.isEmpty())
+            return JsonNode( DATA);
+
+        JsonType* parent = DATA;
+
+        for (int i = 0; i < keys.size() - 1 && parent != nullptr; ++i)
+            parent = parent->value( keys.at(i));
+
+        return childNode( parent, keys.last());
+    }
+
+    JsonType* getPointer( const QVariantList& keys) const               // nullptr for a packed element or a hole, see node().
+    {
+        return node( keys).element();
+    }
+
+public:
+    Snapshot() : DATA( new JsonObject()){}
+
+    Snapshot( JsonType* data) : DATA( retain( data)){}
+
+    Snapshot( const Snapshot& other) : DATA( retain( other.DATA)){}
+
+    Snapshot& operator = ( const Snapshot& other)
+    {
+        JsonType* previous = DATA;
+        DATA = retain( other.DATA);
+        release( previous);
+        return *this;
+    }
+
+    ~Snapshot()
+    {
+        release( DATA);
+    }
+
+    JsonChildren children( const QVariantList& keys) const
+    {
+        return JsonChildren( getPointer( keys));
+    }
+
+    bool exists( const QVariantList& keys) const
+    {
+        return node( keys).exists();
+    }
+
+    template <typename Callback>
+    void forEach( const QVariantList& keys, Callback callback) const   // callback( const QVariant& key, const JsonNode& node)
+    {
+        children( keys).forEach( callback);
+    }
+
+    quint64 hash( const QVariantList& keys = {}) const                 // Safe from any thread, see JsonObject::HASH.
+    {
+        return nodeHash( node( keys));
+    }
+
+    bool isArray( const QVariantList& keys) const
+    {
+        return (type( keys) == Type::Array);
+    }
+
+    bool isNullValue( const QVariantList& keys) const
+    {
+        return (isValue( keys) && value( keys).isNull());
+    }
+
+    bool isObject( const QVariantList& keys) const
+    {
+        return (type( keys) == Type::Object);
+    }
+
+    bool isValue( const QVariantList& keys) const
+    {
+        return (type( keys) == Type::Value);
+    }
+
+    QVariantList keys( const QVariantList& keys) const
+    {
+        JsonType* element = getPointer( keys);
+
+        if (element == nullptr)
+            return QVariantList();
+        return element->keys();
+    }
+
+    int size( const QVariantList& keys = {}) const
+    {
+        return node( keys).size();
+    }
+
+    QString toString( StringStyle style = StringStyle::Readable, bool convertToCodePoints = false, const QVariantList& keys = {}) const
+    {
+        CONVERT_TO_CODE_POINTS = convertToCodePoints;                   // Thread local.
+        JsonType* element = getPointer( keys);
+
+        if ( element == nullptr || element->hasType == Type::Value)
+            return QString("{}");
+
+        return element->toString( style, 1);
+    }
+
+    Type type( const QVariantList& keys) const
+    {
+        return node( keys).type();
+    }
+
+    QVariant value( const QVariantList& keys, const QVariant& defaultValue = QVariant()) const
+    {
+        return node( keys).value( defaultValue);
+    }
+
+    bool write( QIODevice* device, StringStyle style = StringStyle::Readable, bool convertToCodePoints = false, const QVariantList& keys = {},
+                bool parallel = false) const                            // Like Editor::write(), from any thread.
+    {
+        JsonNode found = node( keys);
+
+        if (!found.exists())
+            return false;
+
+        JsonValue value( found.value());                                // Written if there's no element, see JsonNode.
+        CONVERT_TO_CODE_POINTS = convertToCodePoints;                   // Thread local. Fragments aren't used, since
+        CACHE_FRAGMENTS = false;                                        // the root of a Snapshot is shared.
+        JsonWriter writer( style, device);
+        writer.setParallel( parallel);
+        writer.write( (found.element() != nullptr) ? found.element() : &value);
+        return writer.flush();
+    }
+};
+
+// ---------------------------------------------------------
+
+// A Batch records changes, which Editor::apply() validates and then performs all at once.
+
+class BatchOperation
+{
+public:
+    enum Type {SET_VALUE, SET_EMPTY_ARRAY, SET_EMPTY_OBJECT, APPEND, PREPEND, REMOVE};
+    Type TYPE = SET_VALUE;
+    QVariantList KEYS;
+    QVariant VALUE;
+    BatchOperation(){}
+    BatchOperation( Type type, const QVariantList& keys, const QVariant& value = QVariant())
+        :TYPE(type), KEYS(keys), VALUE(value){}
+
+    int groupKeyCount() const                                           // Operations are grouped by the location they change.
+    {                                                                   // A removal changes the parent.
+        if (TYPE == REMOVE)
+            return qMax( 0, KEYS.size() - 1);
+        return KEYS.size();
+    }
+};
+
+class Batch
+{
+public:
+    QList<BatchOperation> OPERATIONS;
+
+    void append( const QVariantList& keys, const QVariant& value)
+    {
+        OPERATIONS.append( BatchOperation( BatchOperation::APPEND, keys, value));
+    }
+
+    void clear()
+    {
+        OPERATIONS.clear();
+    }
+
+    bool isEmpty() const
+    {
+        return OPERATIONS.isEmpty();
+    }
+
+    void prepend( const QVariantList& keys, const QVariant& value)
+    {
+        OPERATIONS.append( BatchOperation( BatchOperation::PREPEND, keys, value));
+    }
+
+    void remove( const QVariantList& keys)
+    {
+        OPERATIONS.append( BatchOperation( BatchOperation::REMOVE, keys));
+    }
+
+    void setEmptyArray( const QVariantList& keys)
+    {
+        OPERATIONS.append( BatchOperation( BatchOperation::SET_EMPTY_ARRAY, keys));
+    }
+
+    void setEmptyObject( const QVariantList& keys)
+    {
+        OPERATIONS.append( BatchOperation( BatchOperation::SET_EMPTY_OBJECT, keys));
+    }
+
+    void setNull( const QVariantList& keys)
+    {
+        OPERATIONS.append( BatchOperation( BatchOperation::SET_VALUE, keys));
+    }
+
+    void setValue( const QVariantList& keys, const QVariant& value)
+    {
+        OPERATIONS.append( BatchOperation( BatchOperation::SET_VALUE, keys, value));
+    }
+
+    int size() const
+    {
+        return OPERATIONS.size();
+    }
+};
+
+// ---------------------------------------------------------
+
+// An index of an array of objects: the positions of its elements by the value of one of their fields.
+// The Editor keeps it up to date while the document changes. Positions are stored relative to OFFSET,
+// so elements inserted or removed at the front don't move the others; elsewhere, the shorter side
+// of the change is moved.
+
+class ArrayIndex
+{
+public:
+    ArrayIndex(){}
+
+    ArrayIndex( const QVariantList& arrayKeys, const QVariantList& fieldKeys) : ARRAY_KEYS( arrayKeys), FIELD_KEYS( fieldKeys){}
+
+    QVariantList ARRAY_KEYS;
+    QVariantList FIELD_KEYS;                                            // Relative to an element of the array.
+    QMultiHash<QString, int> POSITIONS;                                 // Field value (see hashKey()) -> stored position.
+    QHash<int, QString> HASH_KEYS;                                      // Stored position -> field value.
+    int OFFSET = 0;                                                     // Position = stored position + OFFSET.
+    bool IS_VALID = false;                                              // Rebuilt at the next lookup, when false.
+
+    static QString hashKey( const QVariant& value)                      // Equal JSON values get equal keys, fx. 1 and 1.0,
+    {                                                                   // but 1 and "1" don't. Numbers are keyed like
+        if (isNumber( value))                                           // valuesAreEqual() compares them.
+        {
+            NumberKey number( value);
+
+            if (number.IS_INTEGER)
+                return (number.IS_NEGATIVE ? "n-" : "n") + QString::number( number.MAGNITUDE);
+            return "d" + QString::number( number.DOUBLE, 'g', 17);
+        }
+
+        switch (static_cast<QMetaType::Type>(value.type()))
+        {
+        case QMetaType::Bool:
+            return value.toBool() ? "true" : "false";
+        case QMetaType::UnknownType:
+            return "null";
+        default:
+            return "s" + value.toString();
+        }
+    }
+
+    void insert( int position, const QString& hashKey)
+    {
+        POSITIONS.insert( hashKey, position - OFFSET);
+        HASH_KEYS.insert( position - OFFSET, hashKey);
+    }
+
+    void remove( int position)
+    {
+        auto it = HASH_KEYS.find( position - OFFSET);
+
+        if (it == HASH_KEYS.end())
+            return;
+
+        POSITIONS.remove( it.value(), position - OFFSET);
+        HASH_KEYS.erase( it);
+    }
+
+    void shift( int position, int offset)                               // Moves the entry at position by offset, if there is one.
+    {
+        auto it = HASH_KEYS.find( position - OFFSET);
+
+        if (it == HASH_KEYS.end())
+            return;
+
+        QString key = it.value();
+        HASH_KEYS.erase( it);
+        POSITIONS.remove( key, position - OFFSET);
+        POSITIONS.insert( key, position + offset - OFFSET);
+        HASH_KEYS.insert( position + offset - OFFSET, key);
+    }
+
+    void splice( int from, int removeCount, int insertCount, int size)  // removeCount elements from from were replaced by
+    {                                                                   // insertCount elements, which aren't indexed yet.
+        for (int i = from; i < from + removeCount; ++i)                 // size is the size of the array afterwards.
+            remove( i);
+
+        int offset = insertCount - removeCount;
+        int end = from + removeCount;                                   // The first element after the change, before it.
+
+        if (offset == 0)
+            return;
+
+        if (from <= size - from - insertCount)                          // Fewer elements before the change: they're moved
+        {                                                               // back, and OFFSET moves the rest forward.
+            if (offset > 0)
+                for (int i = 0; i < from; ++i)
+                    shift( i, -offset);
+            else
+                for (int i = from - 1; i >= 0; --i)
+                    shift( i, -offset);
+            OFFSET += offset;
+        } else {                                                        // Moved in an order that never overwrites an entry.
+            if (offset > 0)
+                for (int i = size - insertCount + removeCount - 1; i >= end; --i)
+                    shift( i, offset);
+            else
+                for (int i = end; i < size - insertCount + removeCount; ++i)
+                    shift( i, offset);
+        }
+    }
+
+    void clear()
+    {
+        POSITIONS.clear();
+        HASH_KEYS.clear();
+        OFFSET = 0;
+    }
+
+    int find( const QVariant& value) const                              // The first position, or -1.
+    {
+        QString key = hashKey( value);
+        int result = -1;
+
+        for (auto it = POSITIONS.constFind( key); it != POSITIONS.cend() && it.key() == key; ++it)
+            if (result == -1 || it.value() + OFFSET < result)
+                result = it.value() + OFFSET;
+
+        return result;
+    }
+};
+
+// ---------------------------------------------------------
+
+// Objects and arrays are equal if their content is, see valuesAreEqual(). Different hashes settle it
+// at once, and the hashes are remembered, so comparing unchanged subtrees again is cheap.
+
+static bool nodesAreEqual( const JsonNode& node1, const JsonNode& node2);
+
+static bool contentEquals( JsonType* element1, JsonType* element2)
+{
+    if (element1 == element2 && element1->hasType != Type::Value)
+        return true;
+
+    if (element1->hasType != element2->hasType)
+        return false;
+
+    if (element1->hasType != Type::Value && element1->contentHash() != element2->contentHash())
+        return false;
+
+    switch (element1->hasType)
+    {
+    case Type::Object:
+    {
+        const QMap<QString, JsonType*>& map1 = static_cast<JsonObject*>(element1)->MAP;
+        const QMap<QString, JsonType*>& map2 = static_cast<JsonObject*>(element2)->MAP;
+
+        if (map1.size() != map2.size())
+            return false;
+
+        for (auto it1 = map1.constBegin(), it2 = map2.constBegin(); it1 != map1.constEnd(); ++it1, ++it2)
+            if (it1.key() != it2.key() || !contentEquals( it1.value(), it2.value()))
+                return false;
+
+        return true;
+    }
+    case Type::Array:
+    {
+        JsonArray* array1 = static_cast<JsonArray*>(element1);
+        JsonArray* array2 = static_cast<JsonArray*>(element2);
+
+        if (array1->size() != array2->size())
+            return false;
+
+        for (int i = 0; i < array1->size(); ++i)
+            if (!nodesAreEqual( JsonNode( array1, i), JsonNode( array2, i)))
+                return false;
+
+        return true;
+    }
+    default:
+        return valuesAreEqual( static_cast<JsonValue*>(element1)->VALUE, static_cast<JsonValue*>(element2)->VALUE);
+    }
+}
+
+static bool nodesAreEqual( const JsonNode& node1, const JsonNode& node2)   // Also packed elements and holes, by value.
+{                                                                           // Two missing nodes are equal.
+    if (node1.type() != node2.type())
+        return false;
+
+    if (node1.type() == Type::Value)
+        return valuesAreEqual( node1.value(), node2.value());
+
+    return !node1.exists() || contentEquals( node1.element(), node2.element());
+}
+
+static JsonType* holdNode( const JsonNode& node)                    // A reference for a new holder. Values are copied, so the
+{                                                                   // holder can change them, and packed elements get an element.
+    if (node.type() == Type::Value)
+        return new JsonValue( node.value());
+    return retain( node.element());
+}
+
+static JsonType* holdElement( JsonType* element)
+{
+    return holdNode( JsonNode( element));
+}
+
+// ---------------------------------------------------------
+
+// A JsonPatch is a list of RFC 6902 operations. Locations are JSON Pointers (RFC 6901), like
+// "/orders/0/qty". The values are elements that are shared with the documents they came from.
+
+class PatchOperation
+{
+public:
+    enum Type {ADD, REMOVE, REPLACE, MOVE, COPY, TEST};
+    Type TYPE = ADD;
+    QString PATH;
+    QString FROM;                                                   // MOVE and COPY.
+    JsonType* VALUE = nullptr;                                      // ADD, REPLACE and TEST.
+
+    PatchOperation( Type type, const QString& path, JsonType* value = nullptr, const QString& from = QString())
+        : TYPE(type), PATH(path), FROM(from), VALUE(value){}        // Takes over the value.
+
+    PatchOperation( const PatchOperation& other)
+        : TYPE(other.TYPE), PATH(other.PATH), FROM(other.FROM), VALUE( retain( other.VALUE)){}
+
+    PatchOperation& operator = ( const PatchOperation& other)
+    {
+        JsonType* previous = VALUE;
+        TYPE = other.TYPE;
+        PATH = other.PATH;
+        FROM = other.FROM;
+        VALUE = retain( other.VALUE);
+        release( previous);
+        return *this;
+    }
+
+    ~PatchOperation()
+    {
+        release( VALUE);
+    }
+};
+
+class JsonPatch
+{
+public:
+    QList<PatchOperation> OPERATIONS;
+
+    static QString escapeKey( const QString& key)                   // For a key in a JSON Pointer.
+    {
+        QString result = key;
+        result.replace('~', "~0");
+        result.replace('/', "~1");
+        return result;
+    }
+
+    static QString pointer( const QVariantList& keys)               // The JSON Pointer to the location of the keys.
+    {
+        QString result;
+
+        for (const QVariant& key : keys)
+        {
+            result.append('/');
+            result.append( (key.type() == QVariant::Int) ? QString::number( key.toInt()) : escapeKey( key.toString()));
+        }
+        return result;
+    }
+
+    static bool splitPointer( const QString& pointer, QStringList& segments)
+    {
+        segments.clear();
+
+        if (pointer.isEmpty())                                      // The whole document.
+            return true;
+
+        if (!pointer.startsWith('/'))
+            return false;
+
+        for (QString segment : pointer.mid(1).split('/'))
+        {
+            segment.replace("~1", "/");
+            segment.replace("~0", "~");
+            segments.append( segment);
+        }
+        return true;
+    }
+
+    void add( const QVariantList& keys, const QVariant& value)
+    {
+        OPERATIONS.append( PatchOperation( PatchOperation::ADD, pointer( keys), new JsonValue( value)));
+    }
+
+    void clear()
+    {
+        OPERATIONS.clear();
+    }
+
+    void copy( const QVariantList& keysFrom, const QVariantList& keysTo)
+    {
+        OPERATIONS.append( PatchOperation( PatchOperation::COPY, pointer( keysTo), nullptr, pointer( keysFrom)));
+    }
+
+    bool isEmpty() const
+    {
+        return OPERATIONS.isEmpty();
+    }
+
+    void move( const QVariantList& keysFrom, const QVariantList& keysTo)
+    {
+        OPERATIONS.append( PatchOperation( PatchOperation::MOVE, pointer( keysTo), nullptr, pointer( keysFrom)));
+    }
+
+    bool read( JsonType* element)                                   // Reads an RFC 6902 document: an array of operation objects.
+    {
+        static const QStringList names = {"add", "remove", "replace", "move", "copy", "test"};
+        OPERATIONS.clear();
+
+        if (element == nullptr || element->hasType != Type::Array)
+            return false;
+
+        JsonArray* array = static_cast<JsonArray*>(element);
+
+        for (int i = 0; i < array->size(); ++i)
+        {
+            JsonType* entry = array->at(i);
+
+            if (entry == nullptr || entry->hasType != Type::Object)
+                break;
+
+            const QMap<QString, JsonType*>& map = static_cast<JsonObject*>(entry)->MAP;
+            JsonType* op = map.value("op", nullptr);
+            JsonType* path = map.value("path", nullptr);
+            JsonType* from = map.value("from", nullptr);
+            JsonType* value = map.value("value", nullptr);
+
+            if (op == nullptr || path == nullptr || op->hasType != Type::Value || path->hasType != Type::Value)
+                break;
+
+            int type = names.indexOf( static_cast<JsonValue*>(op)->VALUE.toString());
+            bool needsFrom = (type == PatchOperation::MOVE || type == PatchOperation::COPY);
+            bool needsValue = (type == PatchOperation::ADD || type == PatchOperation::REPLACE || type == PatchOperation::TEST);
+
+            if (type == -1 || (needsFrom && (from == nullptr || from->hasType != Type::Value)) || (needsValue && value == nullptr))
+                break;
+
+            OPERATIONS.append( PatchOperation( PatchOperation::Type( type), static_cast<JsonValue*>(path)->VALUE.toString(),
+                                               needsValue ? holdElement( value) : nullptr,
+                                               needsFrom ? static_cast<JsonValue*>(from)->VALUE.toString() : QString()));
+        }
+
+        if (OPERATIONS.size() != array->size())
+        {
+            OPERATIONS.clear();
+            return false;
+        }
+        return true;
+    }
+
+    void remove( const QVariantList& keys)
+    {
+        OPERATIONS.append( PatchOperation( PatchOperation::REMOVE, pointer( keys)));
+    }
+
+    void replace( const QVariantList& keys, const QVariant& value)
+    {
+        OPERATIONS.append( PatchOperation( PatchOperation::REPLACE, pointer( keys), new JsonValue( value)));
+    }
+
+    int size() const
+    {
+        return OPERATIONS.size();
+    }
+
+    void test( const QVariantList& keys, const QVariant& value)
+    {
+        OPERATIONS.append( PatchOperation( PatchOperation::TEST, pointer( keys), new JsonValue( value)));
+    }
+
+    QString toString( StringStyle style = StringStyle::Compact, bool convertToCodePoints = false) const
+    {
+        static const char* names[] = {"add", "remove", "replace", "move", "copy", "test"};
+        JsonArray* root = new JsonArray();
+
+        for (const PatchOperation& operation : OPERATIONS)
+        {
+            JsonObject* entry = new JsonObject();
+            entry->MAP.insert( "op", new JsonValue( QString( names[ operation.TYPE])));
+            entry->MAP.insert( "path", new JsonValue( operation.PATH));
+
+            if (operation.TYPE == PatchOperation::MOVE || operation.TYPE == PatchOperation::COPY)
+                entry->MAP.insert( "from", new JsonValue( operation.FROM));
+
+            if (operation.VALUE != nullptr)
+                entry->MAP.insert( "value", retain( operation.VALUE));
+
+            root->ARRAY.append( entry);
+        }
+
+        CONVERT_TO_CODE_POINTS = convertToCodePoints;
+        QString result = root->toString( style, 1);
+        release( root);
+        return result;
+    }
+};
+
+// Finds the operations that turn one element into another. Shared elements are skipped without
+// looking at them, and so are elements with equal hashes. In arrays, the unchanged elements at
+// both ends are matched, so inserting or removing in the middle gives only add or remove operations.
+
+class JsonDiff
+{
+private:
+    JsonPatch& PATCH;
+    QString POINTER;                                                // The location of the current element.
+
+    void record( PatchOperation::Type type, JsonType* value = nullptr)
+    {
+        PATCH.OPERATIONS.append( PatchOperation( type, POINTER, value));
+    }
+
+    bool isSame( JsonType* element1, JsonType* element2)
+    {
+        return contentEquals( element1, element2);
+    }
+
+    bool elementsAreSame( JsonArray* array1, int index1, JsonArray* array2, int index2)
+    {
+        return nodesAreEqual( JsonNode( array1, index1), JsonNode( array2, index2));
+    }
+
+    void diffArrayElement( JsonArray* source, JsonArray* target, int index)
+    {
+        JsonNode node1( source, index);
+        JsonNode node2( target, index);
+
+        if (node1.type() == Type::Value || node2.type() == Type::Value)    // Packed elements and holes have no element.
+        {
+            if (!nodesAreEqual( node1, node2))
+                record( PatchOperation::REPLACE, holdNode( node2));
+            return;
+        }
+        diffElements( node1.element(), node2.element());
+    }
+
+    void diffObjects( JsonObject* source, JsonObject* target)       // Both maps are sorted, so they're merged in one pass.
+    {
+        auto it1 = source->MAP.constBegin();
+        auto it2 = target->MAP.constBegin();
+        int length = POINTER.size();
+
+        while (it1 != source->MAP.constEnd() || it2 != target->MAP.constEnd())
+        {
+            bool isRemoved = (it2 == target->MAP.constEnd() || (it1 != source->MAP.constEnd() && it1.key() < it2.key()));
+            bool isAdded = !isRemoved && (it1 == source->MAP.constEnd() || it2.key() < it1.key());
+
+            POINTER.append('/');
+            POINTER.append( JsonPatch::escapeKey( isRemoved ? it1.key() : it2.key()));
+
+            if (isRemoved)
+                record( PatchOperation::REMOVE);
+            else if (isAdded)
+                record( PatchOperation::ADD, holdElement( it2.value()));
+            else
+                diffElements( it1.value(), it2.value());
+
+            POINTER.truncate( length);
+
+            if (!isAdded)
+                ++it1;
+            if (!isRemoved)
+                ++it2;
+        }
+    }
+
+    void diffArrays( JsonArray* source, JsonArray* target)
+    {
+        int size1 = source->size();
+        int size2 = target->size();
+        int prefix = 0;
+        int suffix = 0;
+
+        while (prefix < size1 && prefix < size2 && elementsAreSame( source, prefix, target, prefix))
+            ++prefix;
+
+        while (suffix < size1 - prefix && suffix < size2 - prefix && elementsAreSame( source, size1 - 1 - suffix, target, size2 - 1 - suffix))
+            ++suffix;
+
+        int changed1 = size1 - prefix - suffix;                     // The elements in between are compared by position.
+        int changed2 = size2 - prefix - suffix;
+        int common = qMin( changed1, changed2);
+        int length = POINTER.size();
+
+        for (int i = prefix; i < prefix + common; ++i)
+        {
+            POINTER.append('/');
+            POINTER.append( QString::number(i));
+            diffArrayElement( source, target, i);
+            POINTER.truncate( length);
+        }
+
+        for (int i = prefix + changed1 - 1; i >= prefix + common; --i)     // From the end, so the positions stay valid.
+        {
+            POINTER.append('/');
+            POINTER.append( QString::number(i));
+            record( PatchOperation::REMOVE);
+            POINTER.truncate( length);
+        }
+
+        for (int i = prefix + common; i < prefix + changed2; ++i)
+        {
+            POINTER.append('/');
+            POINTER.append( QString::number(i));
+            record( PatchOperation::ADD, holdNode( JsonNode( target, i)));
+            POINTER.truncate( length);
+        }
+    }
+
+public:
+    JsonDiff( JsonPatch& patch) : PATCH(patch){}
+
+    void diffElements( JsonType* source, JsonType* target)
+    {
+        if (source->hasType != target->hasType)
+        {
+            record( PatchOperation::REPLACE, holdElement( target));
+            return;
+        }
+
+        switch (source->hasType)
+        {
+        case Type::Object:
+            if (!isSame( source, target))
+                diffObjects( static_cast<JsonObject*>(source), static_cast<JsonObject*>(target));
+            break;
+        case Type::Array:
+            if (!isSame( source, target))
+                diffArrays( static_cast<JsonArray*>(source), static_cast<JsonArray*>(target));
+            break;
+        default:
+            if (!valuesAreEqual( static_cast<JsonValue*>(source)->VALUE, static_cast<JsonValue*>(target)->VALUE))
+                record( PatchOperation::REPLACE, holdElement( target));
+        }
+    }
+};
+
+// ---------------------------------------------------------
+
+class Editor
+{
+private:
+    JsonType* DATA = 0;
 
-        return INSERTED_ELEMENT;
+    // The prefix cache remembers the objects and arrays found along the last resolved path,
+    // so a path that shares a prefix with it doesn't have to be looked up from the root again.
+    // Whatever deletes or shifts an object or array must increase STRUCTURE_VERSION,
+    // which invalidates the cache.
+
+    QVector<QVariant> CACHE_KEYS;
+    QVector<JsonType*> CACHE_ELEMENTS;                                  // CACHE_ELEMENTS[i] is located at the keys CACHE_KEYS[0..i].
+    quint64 CACHE_VERSION = 0;
+    quint64 STRUCTURE_VERSION = 1;
+
+    QList<ArrayIndex> INDEXES;                                          // See createIndex().
+    enum IndexedChange {CHANGED, SPLICED};
+
+    int LAST_SIZE[2] = {0, 0};                                          // Of the document's text, per StringStyle. See serialize().
+    bool IS_PARALLEL = false;                                           // See setParallel().
+
+    static bool keysAreEqual( const QVariant& key1, const QVariant& key2)
+    {
+        if (key1.type() != key2.type())                                 // QVariant would otherwise consider 3 and "3" equal.
+            return false;
+
+        if (key1.type() == QVariant::Int)
+            return key1.toInt() == key2.toInt();
+
+        return key1 == key2;
     }
 
-    JsonType* insertStrong( const QVariant& key, JsonType* fresh_element)
+    JsonType* cachedAncestor( const QVariantList& keys, int keyCount, int& depth)   // The deepest cached element that is located
+    {                                                                               // at some of the first keyCount keys.
+        if (CACHE_VERSION != STRUCTURE_VERSION)
+        {
+            CACHE_KEYS.clear();
+            CACHE_ELEMENTS.clear();
+            CACHE_VERSION = STRUCTURE_VERSION;
+        }
+
+        int limit = qMin( keyCount, CACHE_KEYS.size());
+        depth = 0;
+
+        while (depth < limit && keysAreEqual( keys.at( depth), CACHE_KEYS.at( depth)))
+            ++depth;
+
+        return (depth == 0) ? DATA : CACHE_ELEMENTS.at( depth - 1);
+    }
+
+    void cacheElement( int depth, const QVariant& key, JsonType* element)          // Caches the element located at keys[0..depth].
     {
-        if (!isValidKey( key))      // Can I just assume that it's valid?
+        if (CACHE_KEYS.size() > depth)
         {
-            qWarning("JsonWax-insert error: invalid key.");
-            delete fresh_element;
-            return 0;
+            CACHE_KEYS.resize( depth);
+            CACHE_ELEMENTS.resize( depth);
         }
+        CACHE_KEYS.append( key);
+        CACHE_ELEMENTS.append( element);
+    }
 
-        if (!insertBase( key, fresh_element))
+    JsonType* getPointer( const QVariantList& keys, int keyCount)                   // Uses the first keyCount keys. nullptr for
+    {                                                                               // a packed element or a hole, see node().
+        int depth;
+        JsonType* element = cachedAncestor( keys, keyCount, depth);                 // Sets the starting point.
+
+        for (int i = depth; i < keyCount; ++i)
         {
-            delete INSERTED_ELEMENT;
-            ARRAY[ key.toInt()] = fresh_element;
+            element = element->value( keys.at(i));
+
+            if (element == nullptr)
+                break;
+
+            if (element->hasType != Type::Value)                                    // Only objects and arrays are cached.
+                cacheElement( i, keys.at(i), element);
         }
-        return fresh_element;
+        return element;
     }
 
-    void setValue( const QVariant& key, const QVariant& value)    // Key is required to be an int.
+    void detachRoot()                                                   // Copy on write: the root is about to change.
     {
-        if (!isValidKey( key))
-            return;
+        if (DATA->isShared())
+        {
+            JsonType* root = DATA->clone();
+            release( DATA);
+            DATA = root;
+            ++STRUCTURE_VERSION;
+        }
+        DATA->markDirty();
+    }
 
-        int intkey = key.toInt();
-        inflate( intkey + 1);
+    JsonType* writableAncestor( const QVariantList& keys, int keyCount, int& depth) // Like cachedAncestor(), but nothing from the root
+    {                                                                               // down to the result is shared, so it can be changed.
+        detachRoot();
+        JsonType* element = cachedAncestor( keys, keyCount, depth);
 
-        if (ARRAY[ intkey]->hasType != Type::Value)
+        for (int i = 0; i < depth; ++i)
         {
-            delete ARRAY.at( intkey);
-            ARRAY[ intkey] = new JsonValue(value);
-        } else {
-            ARRAY[ intkey]->setValue( {}, value);
+            if (CACHE_ELEMENTS.at(i)->isShared())
+            {
+                depth = i;
+                element = (depth == 0) ? DATA : CACHE_ELEMENTS.at( depth - 1);
+                break;
+            }
+            CACHE_ELEMENTS.at(i)->markDirty();                          // Everything on the way to a change is dirty.
         }
+
+        return element;
     }
 
-    JsonType* value( const QVariant& key)
+    JsonType* getWritablePointer( const QVariantList& keys, int keyCount)           // Like getPointer(), but shared elements on the way
+    {                                                                               // are replaced by clones.
+        int depth;
+        JsonType* element = writableAncestor( keys, keyCount, depth);
+
+        for (int i = depth; i < keyCount; ++i)
+        {
+            JsonType* child = element->value( keys.at(i));
+
+            if (child == nullptr)
+                return nullptr;
+
+            if (child->isShared())
+                child = element->insertStrong( keys.at(i), child->clone());
+
+            child->markDirty();
+
+            if (child->hasType != Type::Value)
+                cacheElement( i, keys.at(i), child);
+
+            element = child;
+        }
+        return element;
+    }
+
+    JsonType* insertParents( const QVariantList& keys)                  // Finds or creates the parent of the last key.
     {
-        if (contains( key))
-            return ARRAY.at( key.toInt());
-        return nullptr;
+        int depth;
+        JsonType* parent = writableAncestor( keys, keys.size() - 1, depth);
+
+        if (depth > 0 && !keyMatchesJsonType( keys.at( depth), parent)) // The cached element can't contain the next key,
+        {                                                               // so it must be replaced below.
+            --depth;
+            parent = (depth == 0) ? DATA : CACHE_ELEMENTS.at( depth - 1);
+        }
+
+        for (int i = depth; i < keys.size() - 1; ++i)                   // All but the last key.
+        {
+            JsonType* fresh_element = createJsonTypeForKey( keys.at( i + 1));   // This object could be deleted immediately below, which is a waste.
+            JsonType* existing = INDEXES.isEmpty() ? nullptr : parent->value( keys.at(i));
+            JsonType* child = parent->insertWeak( keys.at(i), fresh_element);   // Reuses existing arrays and objects (deletes fresh_element if unused).
+
+            if (child == nullptr)                                       // Abort in case of failure -- This really can't happen if the jsontype
+                return nullptr;                                         // was created specifically for the key. Can it?
+
+            if (existing != nullptr && child != existing)               // Replaced, so the indexes of arrays in it are stale.
+                invalidateIndexes( keys.mid( 0, i + 1));
+
+            if (child->isShared())                                      // Copy on write.
+                child = parent->insertStrong( keys.at(i), child->clone());
+
+            child->markDirty();
+            cacheElement( i, keys.at(i), child);                        // If an element was replaced, the cache is cut off right here.
+            parent = child;
+        }
+        return parent;
     }
 
-    bool contains( const QVariant& key)
+    static int compareKeys( const QVariant& key1, const QVariant& key2)        // Orders numbers before strings.
     {
-        if (isValidKey(key) && key.toInt() < ARRAY.size())
-            return true;
-        return false;
+        if (key1.type() != key2.type())
+            return (key1.type() == QVariant::Int) ? -1 : 1;
+
+        if (key1.type() == QVariant::Int)
+            return key1.toInt() - key2.toInt();
+
+        return QString::compare( key1.toString(), key2.toString());
     }
 
-    bool remove( const QVariant& key)
+    static bool isValidKey( const QVariant& key)
     {
-        if (!contains( key))
-            return false;
-        delete ARRAY.at( key.toInt());
-        ARRAY.removeAt( key.toInt());
-        return true;
+        return (key.type() == QVariant::String || (key.type() == QVariant::Int && key.toInt() >= 0));
     }
 
-    bool removeWeak( const QVariant& key)
+    static bool isValidOperation( const BatchOperation& operation)
     {
-        if (key.isNull())
-            ARRAY[ key.toInt()] = new JsonValue();
+        for (const QVariant& key : operation.KEYS)
+            if (!isValidKey( key))
+                return false;
 
-        if (!contains( key))
+        if (operation.TYPE == BatchOperation::SET_VALUE && operation.KEYS.isEmpty())     // You can't save a value to root.
             return false;
-        ARRAY[ key.toInt()] = new JsonValue();
+
         return true;
     }
 
-    int size()
-    {
-        return ARRAY.size();
-    }
-};
+    static QVector<int> groupedOrder( const QList<BatchOperation>& operations)  // Sorts the operations by location, so the operations on
+    {                                                                           // the same parent follow each other and share its lookup.
+        QVector<int> order;                                                     // It only does so if the order doesn't matter.
+        order.reserve( operations.size());
 
-// ---------------------------------------------------------
+        for (int i = 0; i < operations.size(); ++i)
+            order.append(i);
 
-class Editor
-{
-private:
-    JsonType* DATA = 0;
+        auto isLess = [&operations]( int a, int b) -> bool
+        {
+            const BatchOperation& operationA = operations.at(a);
+            const BatchOperation& operationB = operations.at(b);
+            int countA = operationA.groupKeyCount();
+            int countB = operationB.groupKeyCount();
+
+            for (int i = 0; i < countA && i < countB; ++i)
+            {
+                int comparison = compareKeys( operationA.KEYS.at(i), operationB.KEYS.at(i));
+                if (comparison != 0)
+                    return comparison < 0;
+            }
+            return countA < countB;
+        };
+        std::stable_sort( order.begin(), order.end(), isLess);                  // Operations on the same location keep their order.
+
+        for (int i = 1; i < order.size(); ++i)                                  // Neighbours reveal every conflict: a location inside another
+        {                                                                       // one, or an object and an array at the same location.
+            const BatchOperation& previous = operations.at( order.at( i - 1));
+            const BatchOperation& current = operations.at( order.at(i));
+            int countA = previous.groupKeyCount();
+            int countB = current.groupKeyCount();
+            int common = 0;
+
+            while (common < countA && common < countB && keysAreEqual( previous.KEYS.at( common), current.KEYS.at( common)))
+                ++common;
+
+            bool isSameLocation = (common == countA && common == countB);
+            bool isConflict = !isSameLocation && (common == countA || common == countB ||
+                                                  previous.KEYS.at( common).type() != current.KEYS.at( common).type());
+            if (isConflict)
+            {
+                for (int j = 0; j < order.size(); ++j)                          // Fall back to the recorded order.
+                    order[j] = j;
+                break;
+            }
+        }
+        return order;
+    }
 
     JsonType* createJsonTypeForKey( const QVariant& key) // Will provide the correct JsonType* object.
     {
@@ -583,131 +3118,422 @@ private:
         }
     }
 
-    bool keyMatchesJsonType( const QVariant& key, JsonType* jsonType)
-    {
-        switch( key.type())
+    bool keyMatchesJsonType( const QVariant& key, JsonType* jsonType)
+    {
+        switch( key.type())
+        {
+        case QVariant::String:
+            if (jsonType->hasType == Type::Object)
+                return true;
+            return false;
+        case QVariant::Int:
+            if (jsonType->hasType == Type::Array)
+                return true;
+            return false;
+        default:
+            return false;
+        }
+    }
+
+    JsonArray* writableArray( const QVariantList& keys)                                     // Finds or creates the array at keys, ready to be changed.
+    {                                                                                       // Anything else at that location is replaced.
+        if (keys.isEmpty())
+        {
+            if (DATA->hasType != Type::Array)
+            {
+                release( DATA);
+                DATA = new JsonArray();
+                ++STRUCTURE_VERSION;
+            }
+            detachRoot();
+            return static_cast<JsonArray*>(DATA);
+        }
+
+        JsonType* parent = insertParents( keys);
+
+        if (!keyMatchesJsonType( keys.first(), DATA))                                      // Don't keep anything cached below a root
+            ++STRUCTURE_VERSION;                                                            // that was looked up with the wrong kind of key.
+
+        if (parent == nullptr)                                                              // Abort if location doesn't exist.
+            return nullptr;
+
+        JsonType* child = parent->value( keys.last());
+
+        if ((child == nullptr) || (child->hasType != Type::Array))
+        {
+            child = parent->insertStrong( keys.last(), new JsonArray());
+            ++STRUCTURE_VERSION;
+        } else if (child->isShared()) {                                                     // Copy on write.
+            child = parent->insertStrong( keys.last(), child->clone());
+            ++STRUCTURE_VERSION;
+        }
+        child->markDirty();
+        return static_cast<JsonArray*>(child);
+    }
+
+    void appendPrepend( const QVariantList& keys, const QVariant& value, bool isAppend)
+    {
+        JsonArray* array = writableArray( keys);
+
+        if (array == nullptr)
+            return;
+
+        if (isAppend)
+        {
+            array->appendValue( value);
+            updateIndexes( keys, SPLICED, array->size() - 1, 0, 1);
+        } else {
+            array->prependValue( value);
+            ++STRUCTURE_VERSION;                                                            // The existing elements have moved.
+            updateIndexes( keys, SPLICED, 0, 0, 1);
+        }
+    }
+
+    JsonNode fieldOf( JsonType* array, int position, const QVariantList& fieldKeys)    // The field of an element.
+    {
+        JsonNode field = childNode( array, position);
+
+        for (int i = 0; i < fieldKeys.size() && field.exists(); ++i)
+            field = childNode( field.element(), fieldKeys.at(i));
+
+        return field;
+    }
+
+    void indexElement( ArrayIndex& index, JsonType* array, int position)
+    {
+        index.remove( position);
+        JsonNode field = fieldOf( array, position, index.FIELD_KEYS);
+
+        if (field.type() == Type::Value)
+            index.insert( position, ArrayIndex::hashKey( field.value()));
+    }
+
+    void rebuildIndex( ArrayIndex& index)
+    {
+        index.clear();
+        index.IS_VALID = true;
+        JsonType* array = getPointer( index.ARRAY_KEYS);
+
+        if (array == nullptr || array->hasType != Type::Array)
+            return;
+
+        for (int i = 0; i < array->size(); ++i)
+            indexElement( index, array, i);
+    }
+
+    static bool keyListsAreEqual( const QVariantList& keys1, const QVariantList& keys2)
+    {
+        if (keys1.size() != keys2.size())
+            return false;
+
+        for (int i = 0; i < keys1.size(); ++i)
+            if (!keysAreEqual( keys1.at(i), keys2.at(i)))
+                return false;
+
+        return true;
+    }
+
+    ArrayIndex* findIndex( const QVariantList& arrayKeys, const QVariantList& fieldKeys)
+    {
+        for (ArrayIndex& index : INDEXES)
+            if (keyListsAreEqual( index.ARRAY_KEYS, arrayKeys) && keyListsAreEqual( index.FIELD_KEYS, fieldKeys))
+                return &index;
+        return nullptr;
+    }
+
+    void invalidateIndexes()
+    {
+        for (ArrayIndex& index : INDEXES)
+            index.IS_VALID = false;
+    }
+
+    void invalidateIndexes( const QVariantList& keys)                   // Those of the arrays at keys, or inside it.
+    {
+        for (ArrayIndex& index : INDEXES)
+            if (index.ARRAY_KEYS.size() >= keys.size() && keyListsAreEqual( index.ARRAY_KEYS.mid( 0, keys.size()), keys))
+                index.IS_VALID = false;
+    }
+
+    void updateIndexes( const QVariantList& keys, IndexedChange change = CHANGED,  // Called after the location at keys changed,
+                        int from = 0, int removeCount = 0, int insertCount = 0)     // or, when SPLICED, after removeCount elements
+    {                                                                               // from from, in the array at keys, were replaced
+                                                                                    // by insertCount elements.
+        for (ArrayIndex& index : INDEXES)
+        {
+            if (!index.IS_VALID)
+                continue;
+
+            int arrayKeyCount = index.ARRAY_KEYS.size();
+            int common = 0;
+
+            while (common < keys.size() && common < arrayKeyCount && keysAreEqual( keys.at( common), index.ARRAY_KEYS.at( common)))
+                ++common;
+
+            if (common < keys.size() && common < arrayKeyCount)                 // Somewhere else.
+                continue;
+
+            if (keys.size() <= arrayKeyCount)                                   // The array itself, or one of its parents.
+            {
+                JsonType* array = getPointer( index.ARRAY_KEYS);
+
+                if (change == SPLICED && keys.size() == arrayKeyCount && array != nullptr && array->hasType == Type::Array)
+                {
+                    index.splice( from, removeCount, insertCount, array->size());  // Moves the positions after it.
+
+                    for (int i = from; i < from + insertCount; ++i)
+                        indexElement( index, array, i);
+                } else {
+                    index.IS_VALID = false;
+                }
+                continue;
+            }
+
+            bool isField = true;                                                // Inside an element: does it change the field?
+
+            for (int i = arrayKeyCount + 1; i < keys.size() && i - arrayKeyCount - 1 < index.FIELD_KEYS.size(); ++i)
+                if (!keysAreEqual( keys.at(i), index.FIELD_KEYS.at( i - arrayKeyCount - 1)))
+                {
+                    isField = false;
+                    break;
+                }
+
+            JsonType* array = getPointer( index.ARRAY_KEYS);
+
+            if (array == nullptr || array->hasType != Type::Array)              // The array was replaced on the way.
+                index.IS_VALID = false;
+            else if (isField && keys.at( arrayKeyCount).type() == QVariant::Int)
+                indexElement( index, array, keys.at( arrayKeyCount).toInt());
+        }
+    }
+
+    bool resolvePointer( const QString& pointer, QVariantList& keys, bool isAdd)   // Converts a JSON Pointer to keys, in one walk.
+    {                                                                               // The location must exist or, when adding, its parent.
+        QStringList segments;
+
+        if (!JsonPatch::splitPointer( pointer, segments))
+            return false;
+
+        JsonType* element = DATA;
+        keys.clear();
+
+        for (int i = 0; i < segments.size(); ++i)
+        {
+            const QString& segment = segments.at(i);
+            bool isLast = (i == segments.size() - 1);
+
+            if (element->hasType == Type::Object)
+                keys.append( segment);
+            else if (element->hasType == Type::Array)
+            {
+                int size = element->size();
+                bool isEnd = (isAdd && isLast && segment == "-");          // "-" is after the last element.
+                bool isIndex = true;
+                int index = isEnd ? size : segment.toInt( &isIndex);
+
+                if (!isIndex || index < 0 || segment.startsWith('+') || (segment.size() > 1 && segment.startsWith('0')))
+                    return false;
+
+                if (index > size || (index == size && !(isAdd && isLast)))
+                    return false;
+
+                keys.append( index);
+            }
+            else
+                return false;
+
+            if (!isLast)
+            {
+                element = element->value( keys.last());
+
+                if (element == nullptr)
+                    return false;
+            }
+            else if (!isAdd && !element->contains( keys.last()))
+                return false;
+        }
+        return true;
+    }
+
+    bool putElement( const QVariantList& keys, JsonType* element, bool isAdd)  // Takes over element. Adding to an array
+    {                                                                           // inserts it, instead of replacing.
+        if (keys.isEmpty() && element->hasType == Type::Value)
+        {
+            release( element);
+            return false;
+        }
+
+        if (isAdd && !keys.isEmpty() && keys.last().type() == QVariant::Int && keys.last().toInt() < getPointer( keys, keys.size() - 1)->size())
+        {
+            QVariantList parentKeys = keys.mid( 0, keys.size() - 1);
+
+            if (element->hasType == Type::Value)                        // Inserted as a value, so a packed array stays packed.
+            {
+                splice( parentKeys, keys.last().toInt(), 0, {static_cast<JsonValue*>(element)->VALUE});
+                release( element);
+                return true;
+            }
+            splice( parentKeys, keys.last().toInt(), 0, {QVariant()});                         // Makes room.
+        }
+
+        insert( keys, element);
+        return true;
+    }
+
+    bool applyOperation( const PatchOperation& operation)
+    {
+        QVariantList keys;
+        QVariantList keysFrom;
+
+        switch (operation.TYPE)
+        {
+        case PatchOperation::ADD:
+            return resolvePointer( operation.PATH, keys, true) && putElement( keys, holdElement( operation.VALUE), true);
+        case PatchOperation::REMOVE:
+            if (!resolvePointer( operation.PATH, keys, false))
+                return false;
+            remove( keys);
+            return true;
+        case PatchOperation::REPLACE:
+            return resolvePointer( operation.PATH, keys, false) && putElement( keys, holdElement( operation.VALUE), false);
+        case PatchOperation::MOVE: case PatchOperation::COPY:
+        {
+            if (!resolvePointer( operation.FROM, keysFrom, false))
+                return false;
+
+            if (operation.TYPE == PatchOperation::MOVE)
+            {
+                if (operation.PATH == operation.FROM)
+                    return true;
+
+                if (operation.PATH.startsWith( operation.FROM + '/'))   // Can't be moved into itself.
+                    return false;
+            }
+
+            JsonType* element = holdNode( node( keysFrom));
+
+            if (operation.TYPE == PatchOperation::MOVE)
+                remove( keysFrom);
+
+            if (!resolvePointer( operation.PATH, keys, true))
+            {
+                release( element);
+                return false;
+            }
+            return putElement( keys, element, true);
+        }
+        case PatchOperation::TEST:
+            return resolvePointer( operation.PATH, keys, false) && nodesAreEqual( JsonNode( operation.VALUE), node( keys));
+        default:
+            return false;
+        }
+    }
+
+    bool isOwned( const QVariantList& keys)                             // Fragments below keys may be used, see Fragment:
+    {                                                                   // only if nothing above is shared.
+        bool result = true;
+        JsonType* ancestor = DATA;
+
+        for (int i = 0; i < keys.size() && ancestor != nullptr && result; ++i)
         {
-        case QVariant::String:
-            if (jsonType->hasType == Type::Object)
-                return true;
-            return false;
-        case QVariant::Int:
-            if (jsonType->hasType == Type::Array)
-                return true;
-            return false;
-        default:
-            return false;
+            result = !ancestor->isShared();
+            ancestor = ancestor->value( keys.at(i));
         }
+        return result;
     }
 
-    void appendPrepend( const QVariantList& keys, const QVariant& value, bool isAppend)
+    QByteArray serialize( const QVariantList& keys, JsonType* element, StringStyle style, bool convertToCodePoints)
+    {                                                                   // Reuses the fragments of unchanged objects and arrays.
+        bool isRoot = (element == DATA);
+        int sizeHint = isRoot ? LAST_SIZE[ style] + LAST_SIZE[ style] / 8 : 0;     // Cheaper than a pass that estimates the size.
+
+        CONVERT_TO_CODE_POINTS = convertToCodePoints;
+        CACHE_FRAGMENTS = isOwned( keys);
+        JsonWriter writer( style, nullptr, sizeHint);
+        writer.setParallel( IS_PARALLEL);
+        writer.write( element);
+        CACHE_FRAGMENTS = false;
+
+        if (isRoot)
+            LAST_SIZE[ style] = writer.text().size();
+        return writer.text();
+    }
+
+    void replaceMismatchedRoot( const QVariant& key)                    // The root must be able to contain the first key.
     {
-        if (keys.isEmpty())
+        if (!keyMatchesJsonType( key, DATA))
         {
-            if (DATA->hasType != Type::Array)
-            {
-                delete DATA;
-                DATA = new JsonArray();
-            }
-            if (isAppend)
-                static_cast<JsonArray*>(DATA)->ARRAY.append( new JsonValue(value));
-            else
-                static_cast<JsonArray*>(DATA)->ARRAY.prepend( new JsonValue(value));
-            return;
+            release( DATA);
+            DATA = createJsonTypeForKey( key);
+            ++STRUCTURE_VERSION;
+            invalidateIndexes();
         }
+    }
 
-        JsonType* parent = DATA;
-        for (int i = 0; i < keys.size() - 1; ++i)
+    void insertValue( const QVariantList& keys, QVariant value)        // Like insert(), but no element is created for the value.
+    {                                                                   // The parent stores it, and reuses an existing value element
+        if (keys.isEmpty())                                             // (a packed array stays packed).
         {
-            parent = parent->insertWeak( keys.at(i), createJsonTypeForKey( keys.at( i + 1)));
-
-            if (parent == nullptr)                                                          // Abort if location doesn't exist.
-                return;
+            qWarning("JsonWax-insert error: you can't save a value to root.");  // Root can't be set to a value. Nothing should happen.
+            return;
         }
 
-        JsonType* child = parent->value( keys.last());
+        replaceMismatchedRoot( keys.first());                           // The root element may be of a wrong type.
 
-        if ((child == nullptr) || (child->hasType != Type::Array))
+        JsonType* parent = insertParents( keys);
+
+        if (parent == nullptr)
         {
-            parent = parent->insertStrong( keys.last(), new JsonArray());
-            parent->setValue( 0, value);
-        } else {
-            if (isAppend)
-                static_cast<JsonArray*>(child)->ARRAY.append( new JsonValue(value));
-            else
-                static_cast<JsonArray*>(child)->ARRAY.prepend( new JsonValue(value));
+            qWarning("JsonWax-insert error: invalid key.");
+            return;
         }
-    }
-
-    bool copyData( JsonType* jsonFrom, Editor& jsonTo, QVariantList& keysTo)
-    {
-        if (jsonFrom == nullptr)
-            return false;
 
-        if (jsonFrom->hasType == Type::Value)                               // If it's a Value.
-        {
-            QVariant sourceValue = static_cast<JsonValue*>(jsonFrom)->VALUE;
-            JsonType* jsonValue = new JsonValue( sourceValue);
-            jsonTo.insert( keysTo, jsonValue);
+        JsonType* existing = parent->value( keys.last());
 
-        } else if (jsonFrom->size() == 0) {                                 // If it's not a Value, it could be an empty Array or Object.
-            switch( jsonFrom->hasType)
-            {
-            case Type::Object: jsonTo.setEmptyObject( keysTo);  break;
-            case Type::Array:  jsonTo.setEmptyArray( keysTo);   break;
-            default: break;     // Can't happen. We've determined it's not a Value.
-            }
-        } else {                                                            // Else it's a non-empty Array or Object.
-            for (const QVariant& key : jsonFrom->keys())                    // Go through each of its children recursively.
-            {
-                keysTo.append( key);
-                copyData( jsonFrom->value( key), jsonTo, keysTo);
-            }
-        }
-        if (!keysTo.isEmpty())
-            keysTo.removeLast();
+        if (existing != nullptr && existing->hasType != Type::Value)    // An object or array is about to be deleted.
+            ++STRUCTURE_VERSION;
 
-        return true;
+        parent->setValue( keys.last(), std::move( value));
+        updateIndexes( keys);
     }
 
     void insert( const QVariantList& keys, JsonType* input)             // This was the most difficult-to-create function.
     {
-        if (keys.isEmpty())
+        if (input->hasType == Type::Value)
         {
-            if (input->hasType == Type::Value)                          // Root can't be set to a value. Nothing should happen.
-            {
-                qWarning("JsonWax-insert error: you can't save a value to root.");
-                delete input;
-                return;
-            }
+            JsonValue* inputValue = static_cast<JsonValue*>(input);
+            QVariant value = inputValue->isShared() ? inputValue->VALUE : std::move( inputValue->VALUE);
+            release( input);
+            insertValue( keys, std::move( value));
+            return;
+        }
 
-            delete DATA;
+        if (keys.isEmpty())
+        {
+            release( DATA);
             DATA = input;
+            ++STRUCTURE_VERSION;
+            invalidateIndexes();
             return;
         }
 
-        if (!keyMatchesJsonType( keys.first(), DATA))                   // The root element is of a wrong type.
+        replaceMismatchedRoot( keys.first());                           // The root element may be of a wrong type.
+
+        JsonType* parent = insertParents( keys);
+
+        if (parent == nullptr)
         {
-            delete DATA;
-            DATA = createJsonTypeForKey( keys.first());
+            qWarning("JsonWax-insert error: invalid key.");
+            release( input);
+            return;
         }
 
-        JsonType* parent = DATA;
-        JsonType* fresh_element = nullptr;
+        JsonType* existing = parent->value( keys.last());
 
-        for (int i = 0; i < keys.size() - 1; ++i)                       // All but the last key.
-        {
-            fresh_element = createJsonTypeForKey( keys.at( i + 1));     // This object could be deleted immediately below, which is a waste.
-            parent = parent->insertWeak( keys.at(i), fresh_element);    // Reuses existing arrays and objects (deletes fresh_element if unused).
+        if (existing != nullptr && existing->hasType != Type::Value)    // An object or array is about to be deleted.
+            ++STRUCTURE_VERSION;
 
-            if (parent == nullptr)                                      // Abort in case of failure -- This really can't happen if the jsontype
-            {
-                qWarning("JsonWax-insert error: invalid key.");
-                return;                                                 // was created specifically for the key. Can it?
-            }
-        }
         parent->insertStrong( keys.last(), input);                      // Overwrites the last location.
-        return;
+        updateIndexes( keys);
     }
 
 public:
@@ -716,9 +3542,11 @@ public:
         DATA = new JsonObject();
     }
 
+    Editor( JsonType* data) : DATA( data){}                                     // Takes over data, fx. from BinaryReader.
+
     ~Editor()
     {
-        delete DATA;
+        release( DATA);
         DATA = 0;
     }
 
@@ -730,23 +3558,149 @@ public:
         return getPointer(keys)->size() - 1;
     }
 
+    bool apply( const Batch& batch)                                         // Either all of the operations are performed, or none of them.
+    {
+        for (const BatchOperation& operation : batch.OPERATIONS)           // Everything is validated before anything is changed,
+            if (!isValidOperation( operation))                              // so the batch can't fail halfway through.
+            {
+                qWarning("JsonWax-apply error: invalid operation in batch. Nothing was changed.");
+                return false;
+            }
+
+        for (int i : groupedOrder( batch.OPERATIONS))                       // Consecutive operations below the same parent
+        {                                                                   // find it in the prefix cache.
+            const BatchOperation& operation = batch.OPERATIONS.at(i);
+
+            switch (operation.TYPE)
+            {
+            case BatchOperation::SET_VALUE:         setValue( operation.KEYS, operation.VALUE);             break;
+            case BatchOperation::SET_EMPTY_ARRAY:   setEmptyArray( operation.KEYS);                         break;
+            case BatchOperation::SET_EMPTY_OBJECT:  setEmptyObject( operation.KEYS);                        break;
+            case BatchOperation::APPEND:            appendPrepend( operation.KEYS, operation.VALUE, true);  break;
+            case BatchOperation::PREPEND:           appendPrepend( operation.KEYS, operation.VALUE, false); break;
+            case BatchOperation::REMOVE:            remove( operation.KEYS);                                break;
+            }
+        }
+        return true;
+    }
+
+    bool applyPatch( const JsonPatch& patch)                                    // Either all of the operations are performed, or none of them.
+    {
+        JsonType* backup = retain( DATA);                                       // The first change detaches the root from the backup.
+
+        for (int i = 0; i < patch.OPERATIONS.size(); ++i)
+            if (!applyOperation( patch.OPERATIONS.at(i)))
+            {
+                qWarning("JsonWax-applyPatch error: operation %d failed at \"%s\". Nothing was changed.",
+                         i, patch.OPERATIONS.at(i).PATH.toStdString().c_str());
+                release( DATA);
+                DATA = backup;
+                ++STRUCTURE_VERSION;
+                invalidateIndexes();
+                return false;
+            }
+
+        release( backup);
+        return true;
+    }
+
+    JsonChildren children( const QVariantList& keys)                            // The (key, node) pairs of the object or array at keys.
+    {
+        return JsonChildren( getPointer( keys));
+    }
+
     void clear()
     {
-        delete DATA;
+        release( DATA);
         DATA = new JsonObject();
+        ++STRUCTURE_VERSION;
+        invalidateIndexes();
+    }
+
+    void compact( const QVariantList& keys)                                     // Rebuilds the object or array at keys without unused capacity.
+    {                                                                           // Its elements are allocated one after another, in order.
+        JsonType* element = getWritablePointer( keys, keys.size());
+
+        if (element == nullptr || element->hasType == Type::Value)
+            return;
+
+        JsonType* result = element->compacted();
+
+        if (keys.isEmpty())
+        {
+            release( DATA);
+            DATA = result;
+        } else {
+            getWritablePointer( keys, keys.size() - 1)->insertStrong( keys.last(), result);
+        }
+        ++STRUCTURE_VERSION;
     }
 
     void copy( const QVariantList& keysFrom, JsonWaxInternals::Editor* editor, const QVariantList& keysTo) // Copy from this to a position in another Editor.
     {
-        QVariantList tempKeysTo;
-        Editor tempEditor;
-        JsonType* jsonFrom = getPointer(keysFrom);
+        JsonNode from = node( keysFrom);
 
-        if (jsonFrom == nullptr || (jsonFrom->hasType == Type::Value && keysTo.isEmpty()))      // This is because you can't copy a Value to root.
+        if (!from.exists() || (from.type() == Type::Value && keysTo.isEmpty()))                 // This is because you can't copy a Value to root.
             return;
 
-        if (copyData( jsonFrom, tempEditor, tempKeysTo))                                        // Copy into tempEditor
-            tempEditor.move({}, editor, keysTo);                                                // Move to destination (overwrite if keysTo already exists).
+        if (from.type() == Type::Value)                                                         // Only the value is copied (an element of a
+        {                                                                                       // packed array has no element).
+            editor->insertValue( keysTo, from.value());
+            return;
+        }
+
+        ++STRUCTURE_VERSION;                                                                    // The cached elements below it become shared.
+        editor->insert( keysTo, retain( from.element()));                                             // Both places share the data, until one of them
+    }                                                                                           // is changed (overwrite if keysTo already exists).
+
+    void createIndex( const QVariantList& arrayKeys, const QVariantList& fieldKeys)            // Indexes the array of objects at arrayKeys by the value
+    {                                                                                           // at fieldKeys in each of its elements. See findBy().
+        if (findIndex( arrayKeys, fieldKeys) != nullptr)
+            return;
+
+        INDEXES.append( ArrayIndex( arrayKeys, fieldKeys));
+        rebuildIndex( INDEXES.last());
+    }
+
+    JsonPatch diff( Editor* target)                                             // The operations that turn this document into target.
+    {
+        JsonPatch patch;
+
+        if (DATA != target->DATA)
+            JsonDiff( patch).diffElements( DATA, target->DATA);
+
+        return patch;
+    }
+
+    JsonPatch diff( const Snapshot& base)                                       // The operations that turn base into this document.
+    {                                                                           // Only the parts changed since base are walked.
+        JsonPatch patch;
+
+        if (base.DATA != DATA)
+            JsonDiff( patch).diffElements( base.DATA, DATA);
+
+        return patch;
+    }
+
+    void dropIndex( const QVariantList& arrayKeys, const QVariantList& fieldKeys)
+    {
+        for (int i = 0; i < INDEXES.size(); ++i)
+            if (keyListsAreEqual( INDEXES.at(i).ARRAY_KEYS, arrayKeys) && keyListsAreEqual( INDEXES.at(i).FIELD_KEYS, fieldKeys))
+            {
+                INDEXES.removeAt(i);
+                return;
+            }
+    }
+
+    bool equals( const QVariantList& keys, Editor* other, const QVariantList& otherKeys)    // Compares the elements at keys and otherKeys.
+    {
+        return nodesAreEqual( node( keys), other->node( otherKeys));
+    }
+
+    template <class T, class... Args>
+    void emplace( const QVariantList& keys, Args&&... args)                                     // Constructs a T from the arguments, and stores it.
+    {
+        insertValue( keys, QVariant::fromValue( T( std::forward<Args>(args)...)));
     }
 
     bool exists( const QVariantList& keys)
@@ -754,34 +3708,70 @@ public:
         if (keys.isEmpty())                                                                     // The root object always exists.
             return true;
 
-        JsonType* element = getPointer( keys.mid(0, keys.size() - 1));                          // Uses all keys except the last.
+        JsonType* element = getPointer( keys, keys.size() - 1);                                 // Uses all keys except the last.
 
         if (element == nullptr)
             return false;
         return (element->contains( keys.last())) ? true : false;
     }
 
-    JsonType* getPointer( const QVariantList& keys)
-    {
-        JsonType* element = DATA;                                                               // Sets the starting point.
+    int findBy( const QVariantList& arrayKeys, const QVariantList& fieldKeys, const QVariant& value)  // The position of the first element
+    {                                                                                                   // whose field equals value, or -1.
+        ArrayIndex* index = findIndex( arrayKeys, fieldKeys);                                           // O(1) with an index.
 
-        for (int i = 0; i < keys.size(); ++i)
+        if (index != nullptr)
         {
-            element = element->value( keys.at(i));
+            if (!index->IS_VALID)
+                rebuildIndex( *index);
+            return index->find( value);
+        }
 
-            if (element == nullptr)
-                break;
+        JsonType* array = getPointer( arrayKeys);                                                       // Without an index: a linear scan.
+
+        if (array == nullptr || array->hasType != Type::Array)
+            return -1;
+
+        QString key = ArrayIndex::hashKey( value);
+
+        for (int i = 0; i < array->size(); ++i)
+        {
+            JsonNode field = fieldOf( array, i, fieldKeys);
+
+            if (field.type() == Type::Value && ArrayIndex::hashKey( field.value()) == key)
+                return i;
         }
-        return element;
+        return -1;
     }
 
-    bool isArray( const QVariantList& keys)
+    template <typename Callback>
+    void forEach( const QVariantList& keys, Callback callback)                  // callback( const QVariant& key, const JsonNode& node)
+    {                                                                           // for every child, without copying the keys.
+        children( keys).forEach( callback);
+    }
+
+    JsonType* getPointer( const QVariantList& keys)
     {
-        JsonType* element = getPointer( keys);
+        return getPointer( keys, keys.size());
+    }
 
-        if (element != nullptr && element->hasType == Type::Array)
-            return true;
-        return false;
+    quint64 hash( const QVariantList& keys)                                     // Equal content has equal hashes, 0 if nothing is at keys.
+    {
+        return nodeHash( node( keys));
+    }
+
+    QList<ArrayIndex> indexes() const
+    {
+        return INDEXES;
+    }
+
+    void insertRange( const QVariantList& keys, int at, const QVariantList& values)    // Inserts the values before position at. Creates
+    {                                                                                   // the array, like append() does.
+        splice( keys, at, 0, values);
+    }
+
+    bool isArray( const QVariantList& keys)
+    {
+        return (node( keys).type() == Type::Array);
     }
 
     bool isNullValue( const QVariantList& keys)
@@ -793,20 +3783,12 @@ public:
 
     bool isObject( const QVariantList& keys)
     {
-        JsonType* element = getPointer( keys);
-
-        if (element != nullptr && element->hasType == Type::Object)
-            return true;
-        return false;
+        return (node( keys).type() == Type::Object);
     }
 
     bool isValue( const QVariantList& keys)
     {
-        JsonType* element = getPointer( keys);
-
-        if (element != nullptr && element->hasType == Type::Value)
-            return true;
-        return false;
+        return (node( keys).type() == Type::Value);
     }
 
     QVariantList keys( const QVariantList& keys)
@@ -818,52 +3800,83 @@ public:
         return element->keys();
     }
 
+    qint64 memoryUsage( const QVariantList& keys)                              // Shared elements are counted in every place they're used.
+    {                                                                           // Packed elements and holes have no memory of their own.
+        JsonType* element = getPointer( keys);
+
+        if (element == nullptr)
+            return 0;
+        return element->memoryUsage();
+    }
+
     void move( const QVariantList& keysFrom, Editor* editorTo, const QVariantList& keysTo)
     {
-        QVariantList keysFrom_short = keysFrom.mid( 0, keysFrom.length() - 1);  // Keys except the last.
-        JsonType* parent = getPointer( keysFrom_short);
-        JsonType* child = getPointer( keysFrom);
+        JsonNode from = node( keysFrom);
+
+        if (!from.exists())
+            return;
 
-        if (child == nullptr)
+        if (from.type() == Type::Value && keysTo.isEmpty())                     // A value can't be set to root. Abort and quit.
             return;
 
-        if (child->hasType == Type::Value && keysTo.isEmpty())                  // A value can't be set to root. Abort and quit.
+        if (from.type() == Type::Value)                                         // Only the value is moved (an element of a packed
+        {                                                                       // array has no element).
+            QVariant value = from.value();
+            JsonType* parent = getWritablePointer( keysFrom, keysFrom.size() - 1);
+
+            if (parent->hasType == Type::Array)
+                parent->setValue( keysFrom.last(), QVariant());                 // Replace with null in array.
+            else
+                parent->remove( keysFrom.last());
+
+            updateIndexes( keysFrom);
+            editorTo->insertValue( keysTo, std::move( value));
             return;
+        }
+
+        JsonType* child = from.element();
 
         // Remove from source.
         if (keysFrom.isEmpty())
+        {
             DATA = new JsonObject();                                            // Not deleting.
-        else
-            parent->removeWeak( keysFrom.last());                               // Remove from map, or replace with null in array
-                                                                                // (the weak version doesn't 'delete' the data).
+        } else {
+            getWritablePointer( keysFrom, keysFrom.size() - 1)                  // Keys except the last. Remove from map, or replace
+                    ->removeWeak( keysFrom.last());                             // with null in array (the weak version doesn't 'delete'
+        }                                                                       // the data). A cloned parent shares the same child.
+        ++STRUCTURE_VERSION;
+        updateIndexes( keysFrom);
+
         // Put in destination.
         if (keysTo.isEmpty())
         {
-            delete editorTo->DATA;
+            release( editorTo->DATA);
             editorTo->DATA = child;
+            ++editorTo->STRUCTURE_VERSION;
         } else {
             editorTo->insert( keysTo, child);
         }
     }
 
+    JsonNode node( const QVariantList& keys)                                    // Also finds packed elements and holes,
+    {                                                                           // which getPointer() doesn't.
+        if (keys.isEmpty())
+            return JsonNode( DATA);
+
+        return childNode( getPointer( keys, keys.size() - 1), keys.last());
+    }
+
     void popFirst( const QVariantList& keys, int removeTimes)                   // Removes first element of array.
     {
-        JsonType* element = getPointer( keys);
-
-        if (element != nullptr)
-            if (element->hasType == Type::Array)
-                for (int i = 0; i < removeTimes; ++i)
-                    element->remove(0);
+        removeRange( keys, 0, removeTimes);
     }
 
     void popLast( const QVariantList& keys, int removeTimes)                    // Removes last element of array.
     {
         JsonType* element = getPointer( keys);
 
-        if (element != nullptr)
-            if (element->hasType == Type::Array)
-                for (int i = 0; i < removeTimes; ++i)
-                    element->remove( element->size() - 1);
+        if (element != nullptr && element->hasType == Type::Array)
+            removeRange( keys, qMax( 0, element->size() - removeTimes), removeTimes);
     }
 
     void prepend( const QVariantList& keys, const QVariant& value)
@@ -875,16 +3888,32 @@ public:
     {
         if (keys.isEmpty())
         {
-            delete DATA;
+            release( DATA);
             DATA = new JsonObject();
+            ++STRUCTURE_VERSION;
+            invalidateIndexes();
             return;
         }
 
-        JsonType* element = getPointer( keys.mid(0, keys.size() - 1));          // Uses all keys except the last.
+        JsonType* element = getWritablePointer( keys, keys.size() - 1);         // Uses all keys except the last.
 
         if (element == nullptr)
             return;
-        element->remove( keys.last());
+
+        if (element->remove( keys.last()))
+        {
+            ++STRUCTURE_VERSION;
+
+            if (element->hasType == Type::Array)
+                updateIndexes( keys.mid( 0, keys.size() - 1), SPLICED, keys.last().toInt(), 1, 0);
+            else
+                updateIndexes( keys);
+        }
+    }
+
+    void removeRange( const QVariantList& keys, int from, int count)            // Removes up to count elements, starting at from.
+    {
+        splice( keys, from, count, {});
     }
 
     void setEmptyArray( const QVariantList& keys)
@@ -897,68 +3926,117 @@ public:
         insert( keys, new JsonObject);
     }
 
+    void setIndexes( const QList<ArrayIndex>& indexes)                          // They're rebuilt when they're used.
+    {
+        INDEXES = indexes;
+        invalidateIndexes();
+    }
+
+    void setParallel( bool parallel)                                            // See JsonWriter::setParallel().
+    {
+        IS_PARALLEL = parallel;
+    }
+
     void setValue( const QVariantList& keys, const QVariant& value)
     {
-        insert( keys, new JsonValue(value));
+        insertValue( keys, value);
     }
 
-    int size( const QVariantList& keys)
+    void setValue( const QVariantList& keys, QVariant&& value)                  // The value is moved, not copied.
     {
-        JsonType* element = getPointer( keys);
+        insertValue( keys, std::move( value));
+    }
 
-        if (element == nullptr)
-            return -1;
-        return element->size();
+    int size( const QVariantList& keys)
+    {
+        return node( keys).size();
     }
 
-    QByteArray toByteArray( const QVariantList& keys, StringStyle style, bool convertToCodePoints)
+    Snapshot snapshot()
     {
-        CONVERT_TO_CODE_POINTS = convertToCodePoints;
+        return Snapshot( DATA);                                                 // The next change detaches the root.
+    }
 
-        if (keys.isEmpty())
-            return DATA->toString( style, 1).toUtf8();
+    void splice( const QVariantList& keys, int from, int removeCount, const QVariantList& values)  // Replaces removeCount elements,
+    {                                                                                               // starting at from, with the values.
+        if (from < 0 || removeCount < 0)                                                            // One lookup and one shift.
+        {
+            qWarning("JsonWax-splice error: invalid range.");
+            return;
+        }
 
-        JsonType* element = getPointer( keys);
+        JsonArray* array;
 
-        if ( element == nullptr)
-            return QByteArray();
+        if (values.isEmpty())                                                   // Only removing: an array must exist already.
+        {
+            JsonType* element = getWritablePointer( keys, keys.size());
+
+            if (element == nullptr || element->hasType != Type::Array || from >= element->size() || removeCount == 0)
+                return;
+            array = static_cast<JsonArray*>(element);
+        } else {
+            array = writableArray( keys);
 
-        return element->toString( style, 1).toUtf8();
+            if (array == nullptr)
+                return;
+        }
+
+        int sizeBefore = array->size();
+        int start = qMin( from, sizeBefore);                                    // Nulls fill any gap up to from.
+        int removed = qMax( 0, qMin( removeCount, sizeBefore - from));
+
+        array->splice( from, removeCount, values);
+        ++STRUCTURE_VERSION;                                                    // The existing elements may have moved.
+        updateIndexes( keys, SPLICED, start, removed, array->size() - sizeBefore + removed);
     }
 
-    QString toString( StringStyle style, bool convertToCodePoints, const QVariantList& keys)
+    QByteArray toByteArray( const QVariantList& keys, StringStyle style, bool convertToCodePoints)
     {
-        CONVERT_TO_CODE_POINTS = convertToCodePoints;
+        JsonNode found = node( keys);
 
-        if (keys.isEmpty())
-            return DATA->toString( style, 1);
+        if (!found.exists())
+            return QByteArray();
 
-        JsonType* element = getPointer( keys);
+        JsonValue value( found.value());                                // Written if there's no element, see JsonNode.
+        return serialize( keys, (found.element() != nullptr) ? found.element() : &value, style, convertToCodePoints);
+    }
+
+    QString toString( StringStyle style, bool convertToCodePoints, const QVariantList& keys)
+    {
+        JsonType* element = keys.isEmpty() ? DATA : getPointer( keys);
 
         if ( element == nullptr || element->hasType == Type::Value)
             return QString("{}");
 
-        return element->toString( style, 1);
+        return QString::fromUtf8( serialize( keys, element, style, convertToCodePoints));
     }
 
     Type type( const QVariantList& keys)
     {
-        JsonType* element = getPointer( keys);
-
-        if ( element == nullptr)
-            return Type::Null;
-
-        return element->hasType;
+        return node( keys).type();
     }
 
     QVariant value( const QVariantList& keys, const QVariant& defaultValue)
     {
-        JsonType* element = getPointer( keys);
+        return node( keys).value( defaultValue);                        // The default value, unless it's a value.
+    }
 
-        if (element == nullptr || element->hasType != Type::Value)      // Return default value if the found JsonType is not of type Value.
-            return defaultValue;                                        // (Root can't have a value, since it's either an Object or Array.)
+    bool write( QIODevice* device, const QVariantList& keys, StringStyle style, bool convertToCodePoints)
+    {                                                                   // The same text as toByteArray(), streamed in chunks.
+        JsonNode found = node( keys);                                   // False if nothing is there, or the device failed.
+
+        if (!found.exists())
+            return false;
+
+        JsonValue value( found.value());                                // Written if there's no element, see JsonNode.
+        CONVERT_TO_CODE_POINTS = convertToCodePoints;
+        CACHE_FRAGMENTS = isOwned( keys);
 
-        return static_cast<JsonValue*>(element)->VALUE;                 // Else cast to JsonValue and return its VALUE.
+        JsonWriter writer( style, device);
+        writer.setParallel( IS_PARALLEL);
+        writer.write( (found.element() != nullptr) ? found.element() : &value);
+        CACHE_FRAGMENTS = false;
+        return writer.flush();
     }
 };
 }
@@ -0,0 +1,435 @@
+#ifndef JSONWAX_NUMBERS_H
+#define JSONWAX_NUMBERS_H
+
+/* Original author: Nikolai S | https://github.com/doublejim
+ *
+ * You may use this file under the terms of any of these licenses:
+ * GNU General Public License version 2.0       https://www.gnu.org/licenses/gpl-2.0.html
+ * GNU General Public License version 3         https://www.gnu.org/licenses/gpl-3.0.html
+ */
+
+#include <QByteArray>
+#include <QLocale>
+#include <cmath>
+#include <cstring>
+
+// Numbers are written as text straight into a char buffer, without a QString in between.
+// Doubles get the fewest digits that read back as the same double (Grisu3, by Florian Loitsch:
+// "Printing Floating-Point Numbers Quickly and Accurately with Integers", 2010. It gives up on about
+// 1% of doubles, which Qt converts instead), and floats the fewest that read back as the same float.
+// The layout is the one QVariant::toString() uses, so saved files keep their text: the decimal form,
+// unless the number is below 1e-4 or the exponent form is shorter (by Qt's count), fx. 5540, 0.94,
+// 100000, 0.0001, 1e+6, 5e+15, 1e-5, -9e+8, -4e-68 and -0.
+
+namespace JsonWaxInternals {
+
+static const int NUMBER_BUFFER_SIZE = 32;                           // Enough for any number.
+
+static int formatUnsigned( char* buffer, quint64 value)             // Returns the length. Two digits per division.
+{
+    static const char pairs[] = "00010203040506070809101112131415161718192021222324252627282930313233343536373839404142434445464748495051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899";
+    char text[20];
+    char* start = text + 20;
+
+    while (value >= 100)
+    {
+        int index = int( value % 100) * 2;
+        value /= 100;
+        *--start = pairs[ index + 1];
+        *--start = pairs[ index];
+    }
+
+    if (value >= 10)
+    {
+        *--start = pairs[ value * 2 + 1];
+        *--start = pairs[ value * 2];
+    } else {
+        *--start = char('0' + value);
+    }
+
+    int length = int( text + 20 - start);
+    memcpy( buffer, start, size_t( length));
+    return length;
+}
+
+static int formatInteger( char* buffer, qint64 value)
+{
+    if (value < 0)
+    {
+        *buffer = '-';
+        return 1 + formatUnsigned( buffer + 1, 0 - quint64( value));
+    }
+    return formatUnsigned( buffer, quint64( value));
+}
+
+class DiyFp                                                         // A floating point number with a 64 bit significand.
+{
+public:
+    quint64 F;
+    int E;
+
+    DiyFp( quint64 f, int e) : F( f), E( e){}
+
+    explicit DiyFp( double value)
+    {
+        quint64 bits;
+        memcpy( &bits, &value, sizeof(bits));
+        int biasedExponent = int( (bits >> 52) & 0x7ff);
+        quint64 significand = bits & 0x000fffffffffffffULL;
+
+        if (biasedExponent != 0)
+        {
+            F = significand + 0x0010000000000000ULL;                // The hidden bit.
+            E = biasedExponent - 1075;
+        } else {                                                    // Subnormal.
+            F = significand;
+            E = -1074;
+        }
+    }
+
+    DiyFp operator - ( const DiyFp& other) const
+    {
+        return DiyFp( F - other.F, E);
+    }
+
+    DiyFp operator * ( const DiyFp& other) const                   // The upper 64 bits of the product, rounded.
+    {
+        const quint64 mask = 0xffffffffULL;
+        quint64 a = F >> 32, b = F & mask, c = other.F >> 32, d = other.F & mask;
+        quint64 ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+        quint64 middle = (bd >> 32) + (ad & mask) + (bc & mask) + (1ULL << 31);
+        return DiyFp( ac + (ad >> 32) + (bc >> 32) + (middle >> 32), E + other.E + 64);
+    }
+
+    DiyFp normalized() const                                        // The highest bit set.
+    {
+        DiyFp result = *this;
+
+        while ((result.F & 0x8000000000000000ULL) == 0)
+        {
+            result.F <<= 1;
+            --result.E;
+        }
+        return result;
+    }
+
+    void boundaries( DiyFp& minus, DiyFp& plus) const               // Halfway to the neighbouring doubles, normalized
+    {                                                               // to the same exponent.
+        plus = DiyFp( (F << 1) + 1, E - 1).normalized();
+        minus = (F == 0x0010000000000000ULL) ? DiyFp( (F << 2) - 1, E - 2)     // The gap below a power of two is smaller.
+                                             : DiyFp( (F << 1) - 1, E - 1);
+        minus.F <<= minus.E - plus.E;
+        minus.E = plus.E;
+    }
+};
+
+static DiyFp cachedPower( int exponent, int& decimalExponent)       // A power of ten c, so that the exponent of
+{                                                                   // c * 2^exponent is in [-60, -32].
+    static const quint64 significands[] = {
+        0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL, 0xcf42894a5dce35eaULL,
+        0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL, 0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL,
+        0xbe5691ef416bd60cULL, 0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+        0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL, 0xc21094364dfb5637ULL,
+        0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL, 0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL,
+        0xb23867fb2a35b28eULL, 0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+        0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL, 0xb5b5ada8aaff80b8ULL,
+        0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL, 0x964e858c91ba2655ULL, 0xdff9772470297ebdULL,
+        0xa6dfbd9fb8e5b88fULL, 0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+        0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL, 0xaa242499697392d3ULL,
+        0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL, 0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL,
+        0x9c40000000000000ULL, 0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+        0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL, 0x9f4f2726179a2245ULL,
+        0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL, 0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL,
+        0x924d692ca61be758ULL, 0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+        0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL, 0x952ab45cfa97a0b3ULL,
+        0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL, 0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL,
+        0x88fcf317f22241e2ULL, 0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+        0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL, 0x8bab8eefb6409c1aULL,
+        0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL, 0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL,
+        0x80444b5e7aa7cf85ULL, 0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+        0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL
+    };
+    static const short exponents[] = {
+        -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954, -927,
+        -901, -874, -847, -821, -794, -768, -741, -715, -688, -661, -635, -608,
+        -582, -555, -529, -502, -475, -449, -422, -396, -369, -343, -316, -289,
+        -263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30,
+        56, 83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+        375, 402, 428, 455, 481, 508, 534, 561, 588, 614, 641, 667,
+        694, 720, 747, 774, 800, 827, 853, 880, 907, 933, 960, 986,
+        1013, 1039, 1066
+    };
+
+    double estimate = (-61 - exponent) * 0.30102999566398114 + 347;   // log10(2). Positive, so the ceiling is simple.
+    int k = int( estimate);
+
+    if (estimate - k > 0.0)
+        ++k;
+
+    int index = (k >> 3) + 1;                                       // The table has every 8th power, from 10^-348.
+    decimalExponent = -(-348 + index * 8);
+    return DiyFp( significands[ index], exponents[ index]);
+}
+
+static bool roundWeed( char* digits, int length, quint64 distanceTooHighW, quint64 unsafeInterval, quint64 rest,
+                       quint64 tenKappa, quint64 unit)                  // Moves the last digit as close to the exact value as it
+{                                                                       // can go. False if the digits can't be proven to be the
+    quint64 smallDistance = distanceTooHighW - unit;                    // closest ones.
+    quint64 bigDistance = distanceTooHighW + unit;
+
+    while (rest < smallDistance && unsafeInterval - rest >= tenKappa
+           && (rest + tenKappa < smallDistance || smallDistance - rest >= rest + tenKappa - smallDistance))
+    {
+        --digits[ length - 1];
+        rest += tenKappa;
+    }
+
+    if (rest < bigDistance && unsafeInterval - rest >= tenKappa
+        && (rest + tenKappa < bigDistance || bigDistance - rest > rest + tenKappa - bigDistance))
+        return false;
+
+    return (2 * unit <= rest) && (rest <= unsafeInterval - 4 * unit);
+}
+
+static bool grisu3( double value, char* digits, int& length, int& decimalExponent)     // value = digits * 10^decimalExponent.
+{                                                                                       // value must be positive and finite.
+    static const quint32 powersOf10[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000};
+    DiyFp v( value);                                                                    // False for the few values where it
+    DiyFp minus( 0, 0), plus( 0, 0);                                                    // isn't sure to have the fewest digits.
+    v.boundaries( minus, plus);
+
+    int powerExponent;
+    DiyFp power = cachedPower( plus.E, powerExponent);
+    DiyFp w = v.normalized() * power;
+    DiyFp low = minus * power;
+    DiyFp high = plus * power;
+
+    quint64 unit = 1;                                                   // The products are off by less than one unit, so
+    DiyFp tooLow( low.F - unit, low.E);                                 // only digits inside the interval narrowed by one
+    DiyFp tooHigh( high.F + unit, high.E);                              // unit on each side are safe.
+    quint64 unsafeInterval = (tooHigh - tooLow).F;
+    DiyFp one( 1ULL << -w.E, w.E);
+    quint32 integral = quint32( tooHigh.F >> -one.E);                   // Below 10^10.
+    quint64 fraction = tooHigh.F & (one.F - 1);
+    int kappa = 1;
+
+    while (kappa < 10 && integral >= powersOf10[ kappa])
+        ++kappa;
+
+    length = 0;
+
+    while (kappa > 0)                                                   // The digits of the integral part.
+    {
+        quint32 divisor = powersOf10[ kappa - 1];
+        digits[ length++] = char('0' + integral / divisor);
+        integral %= divisor;
+        --kappa;
+        quint64 rest = (quint64( integral) << -one.E) + fraction;
+
+        if (rest < unsafeInterval)
+        {
+            decimalExponent = powerExponent + kappa;
+            return roundWeed( digits, length, (tooHigh - w).F, unsafeInterval, rest, quint64( divisor) << -one.E, unit);
+        }
+    }
+
+    for (;;)                                                            // The digits of the fraction.
+    {
+        fraction *= 10;
+        unit *= 10;
+        unsafeInterval *= 10;
+        digits[ length++] = char('0' + (fraction >> -one.E));
+        fraction &= one.F - 1;
+        --kappa;
+
+        if (fraction < unsafeInterval)
+        {
+            decimalExponent = powerExponent + kappa;
+            return roundWeed( digits, length, (tooHigh - w).F * unit, unsafeInterval, fraction, one.F, unit);
+        }
+    }
+}
+
+static int digitsOf( const QByteArray& text, char* digits, int& decimalExponent)    // Of "d.ddde+X". Returns the number
+{                                                                                   // of digits, without trailing zeros.
+    int e = text.indexOf('e');
+    int length = 0;
+
+    for (int i = 0; i < e; ++i)
+        if (text.at(i) != '.' && text.at(i) != '-')
+            digits[ length++] = text.at(i);
+
+    decimalExponent = text.mid( e + 1).toInt() - (length - 1);
+
+    while (length > 1 && digits[ length - 1] == '0')
+    {
+        --length;
+        ++decimalExponent;
+    }
+    return length;
+}
+
+static int shortestDigits( double value, char* digits, int& decimalExponent)   // Returns the number of digits. Uses
+{                                                                               // Qt's exact (and slower) conversion
+    int length;                                                                 // where Grisu3 gives up.
+
+    if (grisu3( value, digits, length, decimalExponent))
+    {
+        while (length > 1 && digits[ length - 1] == '0')
+        {
+            --length;
+            ++decimalExponent;
+        }
+        return length;
+    }
+
+    return digitsOf( QByteArray::number( value, 'e', QLocale::FloatingPointShortest), digits, decimalExponent);
+}
+
+static int shortestFloatDigits( float value, char* digits, int& decimalExponent)  // Returns the number of digits. Nine
+{                                                                                   // digits always read back as the
+    QByteArray text;                                                                // same float.
+
+    for (int precision = 1; precision <= 9; ++precision)
+    {
+        text = QByteArray::number( double( value), 'e', precision - 1);
+
+        if (text.toFloat() == value)
+            break;
+    }
+    return digitsOf( text, digits, decimalExponent);
+}
+
+static int layoutDigits( char* buffer, const char* digits, int length, int exponent)    // Writes digits * 10^exponent as
+{                                                                                       // QVariant::toString() does.
+    char* out = buffer;                                                                 // Returns the length.
+    int point = length + exponent;                                  // The position of the decimal point in the digits.
+    int scientificExponent = point - 1;
+    int absoluteExponent = (scientificExponent < 0) ? -scientificExponent : scientificExponent;
+    int cutoff = 6;                                                 // Qt's QLocaleData::doubleToString(): below 1e-4 the
+                                                                    // exponent form is used, and from 1 on whichever
+    if (point > 0)                                                  // form it counts as shorter.
+        cutoff = length + 4 + ((point > 100) ? 2 : 1) + ((length > point) ? 1 : 0);
+
+    if (scientificExponent >= -4 && scientificExponent < cutoff)
+    {
+        if (point <= 0)                                             // 0.000ddd
+        {
+            *out++ = '0';
+            *out++ = '.';
+            memset( out, '0', size_t( -point));
+            out += -point;
+            memcpy( out, digits, size_t( length));
+            out += length;
+        } else if (point < length) {                                // ddd.ddd
+            memcpy( out, digits, size_t( point));
+            out += point;
+            *out++ = '.';
+            memcpy( out, digits + point, size_t( length - point));
+            out += length - point;
+        } else {                                                    // ddd000
+            memcpy( out, digits, size_t( length));
+            memset( out + length, '0', size_t( point - length));
+            out += point;
+        }
+    } else {                                                        // d.ddde+X, without leading zeros in X.
+        *out++ = digits[ 0];
+
+        if (length > 1)
+        {
+            *out++ = '.';
+            memcpy( out, digits + 1, size_t( length - 1));
+            out += length - 1;
+        }
+        *out++ = 'e';
+        *out++ = (scientificExponent < 0) ? '-' : '+';
+        out += formatUnsigned( out, quint64( absoluteExponent));
+    }
+    return int( out - buffer);
+}
+
+static int formatSpecial( char* buffer, double value)               // nan, inf and 0, with their signs. Returns the length,
+{                                                                   // or 0 for other numbers.
+    if (std::isnan( value))
+    {
+        memcpy( buffer, "nan", 3);
+        return 3;
+    }
+
+    int sign = std::signbit( value) ? 1 : 0;                        // Also for -0.
+
+    if (sign == 1)
+        buffer[ 0] = '-';
+
+    if (std::isinf( value))
+    {
+        memcpy( buffer + sign, "inf", 3);
+        return sign + 3;
+    }
+
+    if (value == 0)
+    {
+        buffer[ sign] = '0';
+        return sign + 1;
+    }
+    return 0;
+}
+
+static int formatDouble( char* buffer, double value)                // Returns the length. buffer must have room for
+{                                                                   // NUMBER_BUFFER_SIZE chars.
+    int special = formatSpecial( buffer, value);
+
+    if (special > 0)
+        return special;
+
+    char* out = buffer;
+
+    if (value < 0)
+    {
+        *out++ = '-';
+        value = -value;
+    }
+
+    char digits[ 20];
+    int length;
+    int exponent;
+
+    if (value < 9007199254740992.0 && value == std::floor( value))  // Exact integers below 2^53: their own digits are the
+    {                                                               // shortest, without trailing zeros.
+        length = formatUnsigned( digits, quint64( value));
+        exponent = 0;
+
+        while (digits[ length - 1] == '0')
+        {
+            --length;
+            ++exponent;
+        }
+    } else {
+        length = shortestDigits( value, digits, exponent);
+    }
+    return int( out - buffer) + layoutDigits( out, digits, length, exponent);
+}
+
+static int formatFloat( char* buffer, float value)                  // Like formatDouble(), with the fewest digits for a float,
+{                                                                   // so 0.1f is written as 0.1.
+    int special = formatSpecial( buffer, value);
+
+    if (special > 0)
+        return special;
+
+    char* out = buffer;
+
+    if (value < 0)
+    {
+        *out++ = '-';
+        value = -value;
+    }
+
+    char digits[ 20];
+    int exponent;
+    int length = shortestFloatDigits( value, digits, exponent);
+    return int( out - buffer) + layoutDigits( out, digits, length, exponent);
+}
+}
+
+#endif // JSONWAX_NUMBERS_H
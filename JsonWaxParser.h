@@ -9,6 +9,7 @@
  */
 
 #include <QByteArray>
+#include <QIODevice>
 #include <QVariantList>
 #include <QDebug>
 #include "JsonWaxEditor.h"
@@ -61,6 +62,10 @@ public:
 private:
     Editor* EDITOR = 0;
     const QByteArray* BYTES;
+    QIODevice* DEVICE = nullptr;                                                // Read in chunks into BUFFER, see hasMore().
+    QByteArray BUFFER;
+    int DROPPED = 0;                                                            // Bytes read from DEVICE, and dropped from BUFFER.
+    static const int CHUNK_SIZE = 65536;
 
     QVariantList KEYS;                                                          // [Editor]
     int POS_A, POSITION, SIZE;                                                  // [Editor]
@@ -130,12 +135,20 @@ private:
 
             if (NUMBER_CONTAINS_DOT_OR_E)
             {
-                result = bytesResult.toDouble();
+                double number = bytesResult.toDouble();
+                result = (number == 0) ? 0.0 : number;                              // -0.0 is read as 0, like -0 is.
             } else if (bytesResult.size() > 9) {
-                if (bytesResult.toLongLong() > 2147483647 || bytesResult.toLongLong() < -2147483647)
-                    result = bytesResult.toLongLong();
+                bool isLongLong;
+                qlonglong number = bytesResult.toLongLong( &isLongLong);
+                bool isUnsigned = false;
+                qulonglong unsignedNumber = isLongLong ? 0 : bytesResult.toULongLong( &isUnsigned);
+
+                if (!isLongLong)                                                    // Too large for a qlonglong.
+                    result = isUnsigned ? QVariant( unsignedNumber) : QVariant( bytesResult.toDouble());
+                else if (number > 2147483647 || number < -2147483647)
+                    result = number;
                 else
-                    result = bytesResult.toInt();
+                    result = int( number);
             } else {
                 result = bytesResult.toInt();
             }
@@ -157,10 +170,31 @@ private:
         EDITOR->setValue( KEYS, value);
     }
 
+    bool hasMore()                                                              // Whether there's a byte at POSITION. When reading from
+    {                                                                           // DEVICE, the next chunk is read, and the bytes before
+        if (hasMore())                                                    // POS_A and POSITION are dropped. The value that's being
+            return true;                                                        // read is kept, until it's saved.
+        if (DEVICE == nullptr)
+            return false;
+
+        int drop = qMin( POS_A, POSITION);
+        BUFFER.remove( 0, drop);
+        POS_A -= drop;
+        POSITION -= drop;
+        DROPPED += drop;
+
+        for (EscapedCharacter& ch : ESCAPED_CHARACTERS)
+            ch.POS -= drop;
+
+        BUFFER.append( DEVICE->read( CHUNK_SIZE));
+        SIZE = BUFFER.size();
+        return hasMore();
+    }
+
     bool error( ErrorCode code)
     {
         LAST_ERROR = code;
-        LAST_ERROR_POS = POSITION;
+        LAST_ERROR_POS = DROPPED + POSITION;
         ERROR_REPORTED = true;
         return false;
     }
@@ -168,7 +202,7 @@ private:
     bool checkHex(int length)
     {
         int iteration = 0;
-        while ( POSITION < SIZE && iteration < length)
+        while (iteration < length && hasMore())
             switch (BYTES->at( POSITION++))
             {
             case '0': case '1': case '2': case '3': case '4': case '5': case '6': case '7': case '8': case '9':
@@ -186,7 +220,7 @@ private:
 
     bool number8()     // Acceptable position.
     {
-        while (POSITION < SIZE)
+        while (hasMore())
         {
             switch (BYTES->at( POSITION++))
             {
@@ -202,7 +236,7 @@ private:
 
     bool number7()     // Acceptable position.
     {
-        while (POSITION < SIZE)
+        while (hasMore())
         {
             switch (BYTES->at( POSITION++))
             {
@@ -221,7 +255,7 @@ private:
 
     bool number6()     // Acceptable position.
     {
-        while (POSITION < SIZE)
+        while (hasMore())
         {
             switch (BYTES->at( POSITION++))
             {
@@ -243,7 +277,7 @@ private:
 
     bool number5()
     {
-        while (POSITION < SIZE)
+        while (hasMore())
         {
             switch (BYTES->at( POSITION++))
             {
@@ -259,7 +293,7 @@ private:
 
     bool number4()
     {
-        while (POSITION < SIZE)
+        while (hasMore())
         {
             switch (BYTES->at( POSITION++))
             {
@@ -277,7 +311,7 @@ private:
 
     bool number3()
     {
-        while (POSITION < SIZE)
+        while (hasMore())
         {
             switch (BYTES->at( POSITION++))
             {
@@ -293,7 +327,7 @@ private:
 
     bool number2()      // Acceptable position.
     {
-        while (POSITION < SIZE)
+        while (hasMore())
         {
             switch (BYTES->at( POSITION++))
             {
@@ -313,7 +347,7 @@ private:
 
     bool number1()
     {
-        while (POSITION < SIZE)
+        while (hasMore())
         {
             switch (BYTES->at( POSITION++))
             {
@@ -333,7 +367,7 @@ private:
     {
         NUMBER_CONTAINS_DOT_OR_E = false;
 
-        while (POSITION < SIZE)
+        while (hasMore())
         {
             switch (BYTES->at( POSITION++))
             {
@@ -366,7 +400,7 @@ private:
 
     void skipSpace()
     {
-        while ( POSITION < SIZE )
+        while ( hasMore() )
             if (BYTES->at( POSITION) == ' ' || BYTES->at( POSITION) == '\n' || BYTES->at( POSITION) == '\r' || BYTES->at( POSITION) == '\t')
             {
                 ++POSITION;
@@ -379,7 +413,7 @@ private:
     bool expectChar( QChar character)
     {
         skipSpace();
-        while ( POSITION < SIZE )
+        while ( hasMore() )
         {
             if (BYTES->at( POSITION++) == character)
                 return true;
@@ -393,7 +427,7 @@ private:
     {
         int matchPos = 1;
 
-        while ( POSITION < SIZE )
+        while ( hasMore() )
         {
             if (BYTES->at( POSITION++) == toExpect.at( matchPos))
             {
@@ -421,7 +455,7 @@ private:
                 if (verifyValue())
                 {
                     skipSpace();
-                    while ( POSITION < SIZE )
+                    while ( hasMore() )
                     {
                         switch ( BYTES->at( POSITION++))
                         {
@@ -446,10 +480,10 @@ private:
 
     bool verifyObject()
     {
-        while ( POSITION < SIZE )
+        while ( hasMore() )
         {
             skipSpace();
-            if (POSITION < SIZE)
+            if (hasMore())
             {
                 switch (BYTES->at( POSITION))
                 {
@@ -482,7 +516,7 @@ private:
             KEYS.removeLast();                                          // For combining Parser with Editor.
 
             skipSpace();
-            while ( POSITION < SIZE )
+            while ( hasMore() )
             {
                 switch( BYTES->at( POSITION))
                 {
@@ -506,7 +540,7 @@ private:
     bool verifyArray()
     {
         skipSpace();
-        while ( POSITION < SIZE )
+        while ( hasMore() )
         {
             switch( BYTES->at( POSITION))
             {
@@ -526,11 +560,13 @@ private:
         ESCAPED_CHARACTERS.clear();                                     // For combining Parser with Editor.
         CONTAINS_ESCAPED_CHARACTERS = false;                            // For combining Parser with Editor.
 
-        while ( POSITION < SIZE )
+        while ( hasMore() )
         {
             switch ( BYTES->at( POSITION++))                            // The loop is looking for backspace or "
             {
             case '\\':
+                if (!hasMore())
+                    return error( SUDDEN_END_OF_DOCUMENT);
                 switch ( BYTES->at( POSITION++))                        // Inner test.
                 {
                 case '\"': case '\\': case '/': case 'b': case 'f': case 'n': case 'r': case 't':
@@ -563,7 +599,7 @@ private:
     {
         skipSpace();
         POS_A = POSITION;                                               // [Editor]
-        while ( POSITION < SIZE )
+        while ( hasMore() )
         {
             switch ( BYTES->at( POSITION++))
             {
@@ -615,25 +651,18 @@ private:
         return error( SUDDEN_END_OF_DOCUMENT);
     }
 
-public:
-    Editor* getEditorObject()
-    {
-        return EDITOR;
-    }
-
-    bool isWellformed( const QByteArray& bytes)
+    bool parse()
     {
         POSITION = 0;
-        BYTES = &bytes;
-        SIZE = bytes.size();
-
+        POS_A = 0;
+        DROPPED = 0;
         EDITOR = new Editor();                                          // The editor is deleted in JsonWax.h
         KEYS.clear();                                                   // [Editor]
 
-        while (POSITION < SIZE)
+        while (hasMore())
         {
             skipSpace();
-            switch( bytes.at( POSITION++))
+            switch( BYTES->at( POSITION++))
             {
             case '{':
                 if (!verifyObject())
@@ -648,7 +677,7 @@ public:
             }
 
             skipSpace();
-            if (POSITION < SIZE)
+            if (hasMore())
             {
                 return error( CHARACTER_AFTER_END_OF_DOCUMENT);
             }
@@ -659,6 +688,32 @@ public:
         }
         return error( SUDDEN_END_OF_DOCUMENT);
     }
+
+public:
+    Editor* getEditorObject()
+    {
+        return EDITOR;
+    }
+
+    bool isWellformed( const QByteArray& bytes)
+    {
+        DEVICE = nullptr;
+        BYTES = &bytes;
+        SIZE = bytes.size();
+        return parse();
+    }
+
+    bool isWellformed( QIODevice* device)                               // Reads device in chunks, so only about one chunk of the
+    {                                                                   // text is held in memory at a time.
+        DEVICE = device;
+        BUFFER.clear();
+        BYTES = &BUFFER;
+        SIZE = 0;
+        bool result = parse();
+        DEVICE = nullptr;
+        BUFFER.clear();
+        return result;
+    }
 };
 }
 
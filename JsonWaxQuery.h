@@ -0,0 +1,782 @@
+#ifndef JSONWAX_QUERY_H
+#define JSONWAX_QUERY_H
+
+/* Original author: Nikolai S | https://github.com/doublejim
+ *
+ * You may use this file under the terms of any of these licenses:
+ * GNU General Public License version 2.0       https://www.gnu.org/licenses/gpl-2.0.html
+ * GNU General Public License version 3         https://www.gnu.org/licenses/gpl-3.0.html
+ */
+
+#include <QString>
+#include <QVariantList>
+#include "JsonWaxEditor.h"
+
+namespace JsonWaxInternals {
+
+class JsonPathOperand
+{
+public:
+    bool IS_PATH = false;                               // A path relative to the element: @.a.b or @['a'][0].
+    QVariantList KEYS;
+    QVariant LITERAL;                                   // Otherwise a number, a string, true, false or null.
+};
+
+class JsonPathComparison
+{
+public:
+    enum Operator {EXISTS, EQUAL, NOT_EQUAL, LESS, LESS_OR_EQUAL, GREATER, GREATER_OR_EQUAL};
+
+    JsonPathOperand LEFT;
+    Operator OPERATOR = EXISTS;                         // EXISTS has no right operand: [?(@.isbn)].
+    JsonPathOperand RIGHT;
+};
+
+class JsonPathStep
+{
+public:
+    enum Selector {BY_NAME, ALL, BY_KEYS, BY_SLICE, BY_FILTER};
+
+    Selector SELECTOR = BY_NAME;
+    bool IS_RECURSIVE = false;                          // The step was written with "..".
+    QString NAME;
+    QVariantList KEYS;                                  // Names and indexes of a union: ['a','b'] or [0,-1].
+    int START = 0;
+    int END = 0;
+    int STEP = 1;
+    bool HAS_START = false;
+    bool HAS_END = false;
+    QList<QList<JsonPathComparison>> FILTER;            // Matches if all the comparisons of any of the lists are true.
+};
+
+// Walks the elements of a document along the steps of a JsonPath, and hands every match to the visitor.
+// The keys of the current element are kept on a stack, so they're only copied when a match is found.
+// Matches are handed over as JsonNodes, since packed elements and holes have no element of their own.
+
+template <typename Visitor>
+class JsonPathWalker
+{
+private:
+    const QList<JsonPathStep>& STEPS;
+    Visitor& VISITOR;
+    bool TRACK_KEYS;
+    QVariantList KEYS;
+
+    void enter( const JsonNode& child, const QVariant& key, int stepIndex)
+    {
+        if (TRACK_KEYS)
+            KEYS.append( key);
+
+        walk( child, stepIndex);
+
+        if (TRACK_KEYS)
+            KEYS.removeLast();
+    }
+
+    void select( JsonType* element, const JsonPathStep& step, int next)
+    {
+        if (element->hasType == Type::Object)
+        {
+            const QMap<QString, JsonType*>& map = static_cast<JsonObject*>(element)->MAP;
+
+            switch (step.SELECTOR)
+            {
+            case JsonPathStep::BY_NAME:
+            {
+                auto it = map.constFind( step.NAME);
+                if (it != map.constEnd())
+                    enter( JsonNode( it.value()), it.key(), next);
+                break;
+            }
+            case JsonPathStep::BY_KEYS:
+                for (const QVariant& key : step.KEYS)
+                {
+                    if (key.type() != QVariant::String)
+                        continue;
+
+                    auto it = map.constFind( key.toString());
+                    if (it != map.constEnd())
+                        enter( JsonNode( it.value()), it.key(), next);
+                }
+                break;
+            case JsonPathStep::ALL: case JsonPathStep::BY_FILTER:
+                for (auto it = map.constBegin(); it != map.constEnd(); ++it)
+                    if (step.SELECTOR == JsonPathStep::ALL || matches( JsonNode( it.value()), step.FILTER))
+                        enter( JsonNode( it.value()), it.key(), next);
+                break;
+            default:                                    // Slices only select from arrays.
+                break;
+            }
+        }
+        else if (element->hasType == Type::Array)
+        {
+            JsonArray* array = static_cast<JsonArray*>(element);
+            int size = array->size();
+
+            switch (step.SELECTOR)
+            {
+            case JsonPathStep::BY_KEYS:
+                for (const QVariant& key : step.KEYS)
+                {
+                    if (key.type() != QVariant::Int)
+                        continue;
+
+                    int index = (key.toInt() < 0) ? size + key.toInt() : key.toInt();
+                    if (index >= 0 && index < size)
+                        enter( JsonNode( array, index), index, next);
+                }
+                break;
+            case JsonPathStep::ALL: case JsonPathStep::BY_FILTER:
+                for (int i = 0; i < size; ++i)
+                    if (step.SELECTOR == JsonPathStep::ALL || matches( JsonNode( array, i), step.FILTER))
+                        enter( JsonNode( array, i), i, next);
+                break;
+            case JsonPathStep::BY_SLICE:
+            {
+                int start, end;
+                sliceBounds( step, size, start, end);
+
+                if (step.STEP > 0)
+                    for (int i = start; i < end; i += step.STEP)
+                        enter( JsonNode( array, i), i, next);
+                else
+                    for (int i = start; i > end; i += step.STEP)
+                        enter( JsonNode( array, i), i, next);
+                break;
+            }
+            default:                                    // Names only select from objects.
+                break;
+            }
+        }
+    }
+
+    void descend( JsonType* element, int stepIndex)    // Applies a recursive step to every object and array below element.
+    {
+        if (element->hasType == Type::Object)
+        {
+            const QMap<QString, JsonType*>& map = static_cast<JsonObject*>(element)->MAP;
+
+            for (auto it = map.constBegin(); it != map.constEnd(); ++it)
+                if (it.value()->hasType != Type::Value)
+                    enter( JsonNode( it.value()), it.key(), stepIndex);
+        }
+        else if (element->hasType == Type::Array)
+        {
+            JsonArray* array = static_cast<JsonArray*>(element);
+
+            if (array->PACKING != JsonArray::NOT_PACKED)        // Only values.
+                return;
+
+            for (int i = 0; i < array->size(); ++i)
+            {
+                JsonType* child = array->at(i);
+                if (child != nullptr && child->hasType != Type::Value)
+                    enter( JsonNode( child), i, stepIndex);
+            }
+        }
+    }
+
+    static void sliceBounds( const JsonPathStep& step, int size, int& start, int& end)
+    {
+        if (step.STEP > 0)
+        {
+            start = !step.HAS_START ? 0 : (step.START < 0 ? qMax( 0, size + step.START) : qMin( step.START, size));
+            end = !step.HAS_END ? size : (step.END < 0 ? qMax( 0, size + step.END) : qMin( step.END, size));
+        } else {
+            start = !step.HAS_START ? size - 1 : (step.START < 0 ? qMax( -1, size + step.START) : qMin( step.START, size - 1));
+            end = !step.HAS_END ? -1 : (step.END < 0 ? qMax( -1, size + step.END) : qMin( step.END, size - 1));
+        }
+    }
+
+    static JsonNode locate( JsonNode node, const QVariantList& keys)  // The node at the keys, relative to node.
+    {
+        for (int i = 0; i < keys.size() && node.exists(); ++i)
+            node = childNode( node.element(), keys.at(i));
+
+        return node;
+    }
+
+    static bool operandValue( const JsonNode& node, const JsonPathOperand& operand, QVariant& value)
+    {
+        if (!operand.IS_PATH)
+        {
+            value = operand.LITERAL;
+            return true;
+        }
+
+        JsonNode found = locate( node, operand.KEYS);
+
+        if (found.type() != Type::Value)                // Objects and arrays can only be tested for existence.
+            return false;
+
+        value = found.value();
+        return true;
+    }
+
+    static bool compare( const QVariant& left, JsonPathComparison::Operator op, const QVariant& right)
+    {
+        int order;
+
+        if (isNumber( left) && isNumber( right))
+        {
+            double a = left.toDouble();
+            double b = right.toDouble();
+            order = (a < b) ? -1 : (a > b) ? 1 : 0;
+        }
+        else if (left.type() == QVariant::String && right.type() == QVariant::String)
+            order = QString::compare( left.toString(), right.toString());
+        else if (left.type() == right.type() && (left.type() == QVariant::Bool || left.isNull()))
+        {
+            bool isEqual = left.isNull() || left.toBool() == right.toBool();
+            return (op == JsonPathComparison::EQUAL) ? isEqual : (op == JsonPathComparison::NOT_EQUAL) ? !isEqual : false;
+        }
+        else                                            // Different types are never equal, and have no order.
+            return op == JsonPathComparison::NOT_EQUAL;
+
+        switch (op)
+        {
+        case JsonPathComparison::EQUAL:             return order == 0;
+        case JsonPathComparison::NOT_EQUAL:         return order != 0;
+        case JsonPathComparison::LESS:              return order < 0;
+        case JsonPathComparison::LESS_OR_EQUAL:     return order <= 0;
+        case JsonPathComparison::GREATER:           return order > 0;
+        case JsonPathComparison::GREATER_OR_EQUAL:  return order >= 0;
+        default:                                    return false;
+        }
+    }
+
+    static bool holds( const JsonNode& node, const JsonPathComparison& comparison)
+    {
+        if (comparison.OPERATOR == JsonPathComparison::EXISTS)
+            return locate( node, comparison.LEFT.KEYS).exists();
+
+        QVariant left, right;
+
+        if (!operandValue( node, comparison.LEFT, left) || !operandValue( node, comparison.RIGHT, right))
+            return false;
+
+        return compare( left, comparison.OPERATOR, right);
+    }
+
+    static bool matches( const JsonNode& node, const QList<QList<JsonPathComparison>>& filter)
+    {
+        for (const QList<JsonPathComparison>& comparisons : filter)
+        {
+            bool allHold = true;
+
+            for (const JsonPathComparison& comparison : comparisons)
+                if (!holds( node, comparison))
+                {
+                    allHold = false;
+                    break;
+                }
+
+            if (allHold)
+                return true;
+        }
+        return false;
+    }
+
+public:
+    JsonPathWalker( const QList<JsonPathStep>& steps, Visitor& visitor, bool trackKeys)
+        : STEPS(steps), VISITOR(visitor), TRACK_KEYS(trackKeys){}
+
+    void walk( const JsonNode& node, int stepIndex)
+    {
+        if (stepIndex == STEPS.size())
+        {
+            VISITOR( node, static_cast<const QVariantList&>(KEYS));
+            return;
+        }
+
+        JsonType* element = node.element();                // Values have no children.
+
+        if (element == nullptr || element->hasType == Type::Value)
+            return;
+
+        const JsonPathStep& step = STEPS.at( stepIndex);
+        select( element, step, stepIndex + 1);
+
+        if (step.IS_RECURSIVE)
+            descend( element, stepIndex);
+    }
+};
+
+// A JsonPath is a JSONPath expression compiled into a list of steps. Compile it once and run it
+// as often as needed. Running it walks the objects and arrays of the document directly.
+//
+// Supported syntax:
+//     $                   The root.
+//     .name ['name']      A member of an object. ['a','b'] selects several.
+//     [0] [-1] [0,2]      Elements of an array, counted from the end when negative.
+//     [start:end:step]    A slice of an array, like in Python.
+//     .* [*]              All members or elements.
+//     ..name ..*          Recursive descent: the step is applied at every depth.
+//     [?(filter)]         The members or elements for which the filter is true. A filter compares
+//                         paths relative to the element (@.qty, @['a b'][0], or just @) and literals
+//                         with == != < <= > >=, combined with && and ||. A path alone tests existence.
+
+class JsonPath
+{
+public:
+    enum ErrorCode {OK, EXPECTED_DOLLAR, EXPECTED_NAME, EXPECTED_CLOSING_SQUARE_BRACKET, EXPECTED_PARENTHESIS,
+                    INVALID_INDEX, INVALID_LITERAL, INVALID_FILTER, UNEXPECTED_CHARACTER};
+
+private:
+    QString PATH;
+    int POSITION = 0;
+    QList<JsonPathStep> STEPS;
+    ErrorCode LAST_ERROR = OK;
+    int LAST_ERROR_POS = -1;
+
+    bool error( ErrorCode code)
+    {
+        LAST_ERROR = code;
+        LAST_ERROR_POS = POSITION;
+        STEPS.clear();
+        return false;
+    }
+
+    QChar peek()
+    {
+        return (POSITION < PATH.size()) ? PATH.at( POSITION) : QChar();
+    }
+
+    void skipSpaces()
+    {
+        while (POSITION < PATH.size() && PATH.at( POSITION).isSpace())
+            ++POSITION;
+    }
+
+    bool consume( const QString& token)
+    {
+        if (PATH.midRef( POSITION, token.size()) != token)
+            return false;
+
+        POSITION += token.size();
+        return true;
+    }
+
+    static bool isNameCharacter( QChar ch)
+    {
+        return ch.isLetterOrNumber() || ch == '_' || ch == '-' || ch == '$';
+    }
+
+    QString parseName()
+    {
+        int start = POSITION;
+
+        while (POSITION < PATH.size() && isNameCharacter( PATH.at( POSITION)))
+            ++POSITION;
+
+        return PATH.mid( start, POSITION - start);
+    }
+
+    bool parseString( QString& output)                  // 'text' or "text". A backslash escapes the next character.
+    {
+        QChar quote = PATH.at( POSITION++);
+
+        while (POSITION < PATH.size())
+        {
+            QChar ch = PATH.at( POSITION++);
+
+            if (ch == quote)
+                return true;
+
+            if (ch == '\\' && POSITION < PATH.size())
+                ch = PATH.at( POSITION++);
+
+            output.append( ch);
+        }
+        return error( INVALID_LITERAL);
+    }
+
+    bool parseInt( int& output, bool& found)
+    {
+        int start = POSITION;
+
+        if (peek() == '-')
+            ++POSITION;
+
+        while (peek().isDigit())
+            ++POSITION;
+
+        found = (POSITION > start);
+
+        if (!found)
+            return true;
+
+        bool isInt;
+        output = PATH.midRef( start, POSITION - start).toInt( &isInt);
+        return isInt ? true : error( INVALID_INDEX);
+    }
+
+    bool parseIndexes( JsonPathStep& step)             // [0], [0,2,-1] or [start:end:step].
+    {
+        int index;
+        bool found;
+
+        if (!parseInt( index, found))
+            return false;
+
+        skipSpaces();
+
+        if (peek() != ':')
+        {
+            if (!found)
+                return error( INVALID_INDEX);
+
+            step.SELECTOR = JsonPathStep::BY_KEYS;
+            step.KEYS.append( index);
+
+            while (consume(","))
+            {
+                skipSpaces();
+                if (!parseInt( index, found))
+                    return false;
+                if (!found)
+                    return error( INVALID_INDEX);
+                step.KEYS.append( index);
+                skipSpaces();
+            }
+            return true;
+        }
+
+        step.SELECTOR = JsonPathStep::BY_SLICE;
+        step.HAS_START = found;
+        step.START = index;
+        ++POSITION;
+        skipSpaces();
+
+        if (!parseInt( step.END, step.HAS_END))
+            return false;
+
+        skipSpaces();
+
+        if (consume(":"))
+        {
+            skipSpaces();
+            if (!parseInt( step.STEP, found))
+                return false;
+            if (!found)
+                step.STEP = 1;
+            if (step.STEP == 0)
+                return error( INVALID_INDEX);
+            skipSpaces();
+        }
+        return true;
+    }
+
+    bool parseOperand( JsonPathOperand& operand)
+    {
+        skipSpaces();
+        QChar ch = peek();
+
+        if (ch == '@')
+        {
+            ++POSITION;
+            operand.IS_PATH = true;
+
+            while (true)
+            {
+                if (consume("."))
+                {
+                    QString name = parseName();
+                    if (name.isEmpty())
+                        return error( EXPECTED_NAME);
+                    operand.KEYS.append( name);
+                }
+                else if (consume("["))
+                {
+                    skipSpaces();
+
+                    if (peek() == '\'' || peek() == '"')
+                    {
+                        QString name;
+                        if (!parseString( name))
+                            return false;
+                        operand.KEYS.append( name);
+                    } else {
+                        int index;
+                        bool found;
+                        if (!parseInt( index, found))
+                            return false;
+                        if (!found)
+                            return error( INVALID_INDEX);
+                        operand.KEYS.append( index);
+                    }
+
+                    skipSpaces();
+                    if (!consume("]"))
+                        return error( EXPECTED_CLOSING_SQUARE_BRACKET);
+                }
+                else
+                    return true;
+            }
+        }
+
+        if (ch == '\'' || ch == '"')
+        {
+            QString text;
+            if (!parseString( text))
+                return false;
+            operand.LITERAL = text;
+            return true;
+        }
+
+        if (consume("true"))
+            operand.LITERAL = true;
+        else if (consume("false"))
+            operand.LITERAL = false;
+        else if (consume("null"))
+            operand.LITERAL = QVariant();
+        else if (ch == '-' || ch.isDigit())
+        {
+            int start = POSITION++;
+            bool isInteger = true;
+
+            while (peek().isDigit() || peek() == '.' || peek() == 'e' || peek() == 'E' || peek() == '+' || peek() == '-')
+            {
+                if (!peek().isDigit())
+                    isInteger = false;
+                ++POSITION;
+            }
+
+            QStringRef number = PATH.midRef( start, POSITION - start);
+            bool isNumber;
+
+            if (isInteger)
+            {
+                qlonglong integer = number.toLongLong( &isNumber);
+                operand.LITERAL = (qlonglong( int( integer)) == integer) ? QVariant( int( integer)) : QVariant( integer);
+            } else
+                operand.LITERAL = number.toDouble( &isNumber);
+
+            if (!isNumber)
+                return error( INVALID_LITERAL);
+        }
+        else
+            return error( INVALID_LITERAL);
+
+        return true;
+    }
+
+    bool parseComparison( JsonPathComparison& comparison)
+    {
+        if (!parseOperand( comparison.LEFT))
+            return false;
+
+        skipSpaces();
+
+        if (consume("=="))      comparison.OPERATOR = JsonPathComparison::EQUAL;
+        else if (consume("!=")) comparison.OPERATOR = JsonPathComparison::NOT_EQUAL;
+        else if (consume("<=")) comparison.OPERATOR = JsonPathComparison::LESS_OR_EQUAL;
+        else if (consume(">=")) comparison.OPERATOR = JsonPathComparison::GREATER_OR_EQUAL;
+        else if (consume("<"))  comparison.OPERATOR = JsonPathComparison::LESS;
+        else if (consume(">"))  comparison.OPERATOR = JsonPathComparison::GREATER;
+        else
+            return comparison.LEFT.IS_PATH ? true : error( INVALID_FILTER);
+
+        return parseOperand( comparison.RIGHT);
+    }
+
+    bool parseFilter( JsonPathStep& step)              // The part between ?( and ).
+    {
+        step.SELECTOR = JsonPathStep::BY_FILTER;
+
+        do {
+            QList<JsonPathComparison> comparisons;
+
+            do {
+                JsonPathComparison comparison;
+                if (!parseComparison( comparison))
+                    return false;
+                comparisons.append( comparison);
+                skipSpaces();
+            } while (consume("&&"));
+
+            step.FILTER.append( comparisons);
+        } while (consume("||"));
+
+        return consume(")") ? true : error( EXPECTED_PARENTHESIS);
+    }
+
+    bool parseBracket( JsonPathStep& step)
+    {
+        ++POSITION;                                     // Skip [.
+        skipSpaces();
+        QChar ch = peek();
+
+        if (ch == '*')
+        {
+            ++POSITION;
+            step.SELECTOR = JsonPathStep::ALL;
+        }
+        else if (ch == '?')
+        {
+            ++POSITION;
+            skipSpaces();
+
+            if (!consume("("))
+                return error( EXPECTED_PARENTHESIS);
+            if (!parseFilter( step))
+                return false;
+        }
+        else if (ch == '\'' || ch == '"')
+        {
+            do {
+                skipSpaces();
+                QString name;
+                if (peek() != '\'' && peek() != '"')
+                    return error( EXPECTED_NAME);
+                if (!parseString( name))
+                    return false;
+                step.KEYS.append( name);
+                skipSpaces();
+            } while (consume(","));
+
+            if (step.KEYS.size() == 1)                  // Same as .name.
+                step.NAME = step.KEYS.takeFirst().toString();
+            else
+                step.SELECTOR = JsonPathStep::BY_KEYS;
+        }
+        else if (ch == '-' || ch == ':' || ch.isDigit())
+        {
+            if (!parseIndexes( step))
+                return false;
+        }
+        else
+            return error( UNEXPECTED_CHARACTER);
+
+        skipSpaces();
+        return consume("]") ? true : error( EXPECTED_CLOSING_SQUARE_BRACKET);
+    }
+
+public:
+    JsonPath()
+    {
+        compile("$");
+    }
+
+    JsonPath( const QString& path)
+    {
+        compile( path);
+    }
+
+    JsonPath( const char* path)
+    {
+        compile( QString::fromUtf8( path));
+    }
+
+    bool compile( const QString& path)
+    {
+        PATH = path;
+        POSITION = 0;
+        STEPS.clear();
+        LAST_ERROR = OK;
+        LAST_ERROR_POS = -1;
+
+        skipSpaces();
+
+        if (!consume("$"))
+            return error( EXPECTED_DOLLAR);
+
+        while (POSITION < PATH.size())
+        {
+            JsonPathStep step;
+
+            if (consume("."))
+            {
+                if (consume("."))
+                    step.IS_RECURSIVE = true;
+
+                if (step.IS_RECURSIVE && peek() == '[')
+                {
+                    if (!parseBracket( step))
+                        return false;
+                }
+                else if (consume("*"))
+                    step.SELECTOR = JsonPathStep::ALL;
+                else
+                {
+                    step.NAME = parseName();
+                    if (step.NAME.isEmpty())
+                        return error( EXPECTED_NAME);
+                }
+            }
+            else if (peek() == '[')
+            {
+                if (!parseBracket( step))
+                    return false;
+            }
+            else
+                return error( UNEXPECTED_CHARACTER);
+
+            STEPS.append( step);
+        }
+        return true;
+    }
+
+    int errorPosition() const
+    {
+        return LAST_ERROR_POS;
+    }
+
+    QString errorToString() const
+    {
+        switch( LAST_ERROR)
+        {
+        case OK:                                return "No errors occured.";
+        case EXPECTED_DOLLAR:                   return "Expected the path to start with $.";
+        case EXPECTED_NAME:                     return "Expected a name.";
+        case EXPECTED_CLOSING_SQUARE_BRACKET:   return "Expected closing square bracket.";
+        case EXPECTED_PARENTHESIS:              return "Expected parenthesis.";
+        case INVALID_INDEX:                     return "Invalid index or slice.";
+        case INVALID_LITERAL:                   return "Invalid literal.";
+        case INVALID_FILTER:                    return "Invalid filter.";
+        case UNEXPECTED_CHARACTER:              return "Unexpected character.";
+        default:                                return "";
+        }
+    }
+
+    template <typename Visitor>
+    void forEach( JsonType* root, Visitor visitor, bool trackKeys = true) const    // visitor( const JsonNode& node, const QVariantList& keys)
+    {                                                                               // for every match. Without trackKeys the keys are empty.
+        if (root == nullptr || !isValid())
+            return;
+
+        JsonPathWalker<Visitor> walker( STEPS, visitor, trackKeys);
+        walker.walk( JsonNode( root), 0);
+    }
+
+    bool isValid() const
+    {
+        return LAST_ERROR == OK;
+    }
+
+    QList<QVariantList> keys( JsonType* root) const    // The keys of every match, which can be used with the rest of the API.
+    {
+        QList<QVariantList> result;
+        forEach( root, [&result]( const JsonNode&, const QVariantList& keys){ result.append( keys); });
+        return result;
+    }
+
+    QString path() const
+    {
+        return PATH;
+    }
+
+    QVariantList values( JsonType* root) const         // The values of the matches. Objects and arrays are left out.
+    {
+        QVariantList result;
+        forEach( root, [&result]( const JsonNode& node, const QVariantList&)
+        {
+            if (node.type() == Type::Value)
+                result.append( node.value());
+        }, false);
+        return result;
+    }
+};
+}
+
+#endif // JSONWAX_QUERY_H
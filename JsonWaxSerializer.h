@@ -379,18 +379,15 @@ inline SpecialTextStream& operator >> (SpecialTextStream &stream, QObject &obj)
     // We find all the subkeys in that location, see if they are stored
     // in the object, and insert them if they are.
 
-    for (QVariant& key : DESERIALIZE_EDITOR->keys({ DESERIALIZE_KEYS}))
+    for (auto child : DESERIALIZE_EDITOR->children( DESERIALIZE_KEYS))
     {
-        int index = obj.metaObject()->indexOfProperty( key.toString().toUtf8());
+        int index = obj.metaObject()->indexOfProperty( child.first.toString().toUtf8());
 
         if (index == -1)
             return stream;
 
         if (obj.metaObject()->property( index).isStored( &obj))
-        {
-            QVariant value = DESERIALIZE_EDITOR->value( DESERIALIZE_KEYS + QVariantList{key}, QVariant());
-            obj.metaObject()->property( index).write( &obj, value);
-        }
+            obj.metaObject()->property( index).write( &obj, child.second.value());
     }
     return stream;
 }
@@ -606,11 +603,11 @@ inline SpecialTextStream& operator << (SpecialTextStream &stream, const QList<T>
 template <class T>
 inline SpecialTextStream& operator >> (SpecialTextStream &stream, QList<T>& list)
 {
-    for (QVariant& key : DESERIALIZE_EDITOR->keys({ DESERIALIZE_KEYS}))
+    for (auto child : DESERIALIZE_EDITOR->children( DESERIALIZE_KEYS))
     {
-        DESERIALIZE_KEYS.append( key);
+        DESERIALIZE_KEYS.append( child.first);
 
-        QString strValue = DESERIALIZE_EDITOR->value( DESERIALIZE_KEYS, QVariant()).toString();
+        QString strValue = child.second.value().toString();
         SpecialTextStream stream2( &strValue, QIODevice::ReadOnly);
         T value;
         stream2 >> value;                                                   // This can be self-referential.
@@ -648,11 +645,12 @@ inline SpecialTextStream& operator << (SpecialTextStream &stream, const QMap<QSt
 template <class T>
 inline SpecialTextStream& operator >> (SpecialTextStream &stream, QMap<QString, T>& map)
 {
-    for (const QVariant& key : DESERIALIZE_EDITOR->keys({ DESERIALIZE_KEYS}))
+    for (auto child : DESERIALIZE_EDITOR->children( DESERIALIZE_KEYS))
     {
+        const QVariant& key = child.first;
         DESERIALIZE_KEYS.append( key.toString());
 
-        QString strValue = DESERIALIZE_EDITOR->value( DESERIALIZE_KEYS, QVariant()).toString();
+        QString strValue = child.second.value().toString();
         SpecialTextStream stream2( &strValue, QIODevice::ReadOnly);
         T value;
         stream2 >> value;                                                   // This can be self-referential.
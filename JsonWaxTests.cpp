@@ -1,4 +1,6 @@
 #include "JsonWaxTests.h"
+#include <cstdlib>
+#include <new>
 
 JsonWaxInternals::SerializerClass1::SerializerClass1(QObject *parent): QObject(parent)
 {
@@ -7,3 +9,20 @@ JsonWaxInternals::SerializerClass1::SerializerClass1(QObject *parent): QObject(p
 JsonWaxInternals::SerializerClass2::SerializerClass2(QObject *parent): QObject(parent)
 {
 }
+
+QAtomicInt JsonWaxInternals::ALLOCATION_COUNT;
+
+void* operator new( std::size_t size)                           // Counts the allocations for the speed test.
+{
+    JsonWaxInternals::ALLOCATION_COUNT.ref();
+    void* memory = std::malloc( size == 0 ? 1 : size);
+
+    if (memory == nullptr)
+        throw std::bad_alloc();
+    return memory;
+}
+
+void operator delete( void* memory) noexcept
+{
+    std::free( memory);
+}
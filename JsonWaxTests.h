@@ -1,4 +1,4 @@
-#ifndef JSONWAX_UNIT_TESTS_H
+﻿#ifndef JSONWAX_UNIT_TESTS_H
 #define JSONWAX_UNIT_TESTS_H
 
 /* Original author: Nikolai S | https://github.com/doublejim
@@ -9,6 +9,7 @@
  */
 
 #include <QElapsedTimer>
+#include <QBuffer>
 #include <QDirIterator>
 #include <QJsonDocument>
 #include <QDebug>
@@ -24,6 +25,9 @@
 #include <QFont>
 #include <QJsonArray>
 #include <QJsonObject>
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+#include <QCborValue>
+#endif
 #include "JsonWax.h"
 
 namespace JsonWaxInternals {
@@ -158,6 +162,8 @@ private:
 
 // ----------------------------------------------------------------
 
+extern QAtomicInt ALLOCATION_COUNT;                                         // Counted by operator new in JsonWaxTests.cpp.
+
 class Tests
 {
 public:
@@ -524,6 +530,645 @@ public:
             qDebug() << "JsonWax vs Qt:" << 100.0 * jsonWaxTimeSpent / qtTimeSpent << "%\n";
         }
 
+        {   // BATCH
+            JsonWax json;
+
+            for (int i = 0; i < 20000; ++i)
+            {
+                json.setValue({"hello","world","this","is","a",i}, 0);
+                json.setValue({"another","place",i}, 0);
+            }
+
+            QElapsedTimer timer;                                        // Alternating between two locations.
+            timer.start();
+            for (int i = 0; i < 20000; ++i)
+            {
+                json.setValue({"hello","world","this","is","a",i}, 1);
+                json.setValue({"another","place",i}, 1);
+            }
+            int separateTimeSpent = timer.nsecsElapsed();
+
+            QElapsedTimer timer2;
+            timer2.start();
+            JsonWax::Batch batch;
+            for (int i = 0; i < 20000; ++i)
+            {
+                batch.setValue({"hello","world","this","is","a",i}, 2);
+                batch.setValue({"another","place",i}, 2);
+            }
+            json.apply( batch);
+            int batchTimeSpent = timer2.nsecsElapsed();
+
+            qDebug() << "----- Batch speed -----";
+            qDebug() << "JsonWax separate setValue spent time:" << separateTimeSpent * 1e-6 << "ms";
+            qDebug() << "JsonWax batch spent time:" << batchTimeSpent * 1e-6 << "ms\n";
+        }
+
+        {   // NUMERIC ARRAY
+            QElapsedTimer timer;
+            timer.start();
+            JsonWax json;
+            for (int i = 0; i < 100000; ++i)
+                json.append({"numbers"}, i * 0.5);
+            qint64 sum = 0;
+            for (int i = 0; i < 100000; ++i)
+                sum += json.value({"numbers",i}).toLongLong();
+            QString text = json.toString( JsonWax::Compact);
+            int jsonWaxTimeSpent = timer.nsecsElapsed();
+
+            if (sum + text.size() == 0)                                 // Just using it for something, to avoid "unused" warning.
+                qDebug() << "";
+
+            qDebug() << "----- Numeric array (append, read, serialize) speed -----";
+            qDebug() << "JsonWax spent time:" << jsonWaxTimeSpent * 1e-6 << "ms\n";
+        }
+
+        {   // QUEUE
+            JsonWax json;
+            for (int i = 0; i < 100000; ++i)
+                json.append({"queue"}, i);
+
+            QElapsedTimer timer;
+            timer.start();
+            for (int i = 0; i < 100000; ++i)
+            {
+                json.popFirst({"queue"}, 1);
+                json.append({"queue"}, i);
+            }
+            int queueTimeSpent = timer.nsecsElapsed();
+
+            QVariantList values;
+            for (int i = 0; i < 50000; ++i)
+                values.append(i);
+
+            QElapsedTimer timer2;
+            timer2.start();
+            json.removeRange({"queue"}, 0, 50000);
+            json.insertRange({"queue"}, 25000, values);
+            int rangeTimeSpent = timer2.nsecsElapsed();
+
+            qDebug() << "----- Queue speed -----";
+            qDebug() << "JsonWax popFirst + append spent time:" << queueTimeSpent * 1e-6 << "ms";
+            qDebug() << "JsonWax removeRange + insertRange spent time:" << rangeTimeSpent * 1e-6 << "ms\n";
+        }
+
+        {   // ALLOCATIONS
+            QVariantList keys = {"values", 0};
+            JsonWax json;
+
+            int before = ALLOCATION_COUNT.load();
+            for (int i = 0; i < 10000; ++i)
+            {
+                keys[1] = QString::number(i);
+                json.setValue( keys, QString("some text"));
+            }
+            int setValueAllocations = ALLOCATION_COUNT.load() - before;
+
+            before = ALLOCATION_COUNT.load();
+            for (int i = 0; i < 10000; ++i)
+            {
+                keys[1] = QString::number(i);
+                json.setValue( keys, QString("other text"));                // Overwrites: reuses the existing elements.
+            }
+            int overwriteAllocations = ALLOCATION_COUNT.load() - before;
+
+            JsonWax subtree;
+            for (int i = 0; i < 10000; ++i)
+                subtree.setValue({"list",i}, QString("text"));
+
+            before = ALLOCATION_COUNT.load();
+            json.moveFrom( std::move( subtree), {"moved"});
+            int moveAllocations = ALLOCATION_COUNT.load() - before;
+
+            qDebug() << "----- Allocations -----";
+            qDebug() << "JsonWax setValue (new keys), allocations per value:" << setValueAllocations / 10000.0;
+            qDebug() << "JsonWax setValue (existing keys), allocations per value:" << overwriteAllocations / 10000.0;
+            qDebug() << "JsonWax moveFrom (10000 values), allocations:" << moveAllocations << "\n";
+        }
+
+        {   // FIND BY FIELD VALUE
+            JsonWax json;
+            for (int i = 0; i < 10000; ++i)
+            {
+                json.setValue({"users",i,"id"}, i * 3);
+                json.setValue({"users",i,"name"}, "name");
+            }
+
+            QElapsedTimer timer;
+            timer.start();
+            int found1 = 0;
+            for (int i = 0; i < 100; ++i)
+            {
+                int target = (i * 97 % 10000) * 3;
+                for (int j = 0; j < json.size({"users"}); ++j)
+                    if (json.value({"users",j,"id"}) == target)
+                    {
+                        found1 += j;
+                        break;
+                    }
+            }
+            int scanTimeSpent = timer.nsecsElapsed();
+
+            QElapsedTimer timer2;
+            timer2.start();
+            json.createIndex({"users"}, {"id"});
+            int found2 = 0;
+            for (int i = 0; i < 100; ++i)
+                found2 += json.findBy({"users"}, {"id"}, (i * 97 % 10000) * 3);
+            int indexTimeSpent = timer2.nsecsElapsed();
+
+            if (found1 != found2)
+                qDebug() << "FAILED: the index found other elements.";
+
+            qDebug() << "----- Find by field value (100 lookups in 10000 elements) -----";
+            qDebug() << "JsonWax linear scan spent time:" << scanTimeSpent * 1e-6 << "ms";
+            qDebug() << "JsonWax createIndex + findBy spent time:" << indexTimeSpent * 1e-6 << "ms\n";
+        }
+
+        {   // JSONPATH QUERY
+            JsonWax json;
+            for (int i = 0; i < 2000; ++i)
+                for (int j = 0; j < 10; ++j)
+                {
+                    json.setValue({"orders",i,"items",j,"sku"}, QString::number(i * 10 + j));
+                    json.setValue({"orders",i,"items",j,"qty"}, (i + j) % 20);
+                }
+
+            QElapsedTimer timer;
+            timer.start();
+            QVariantList skus1;
+            for (const QVariant& order : json.keys({"orders"}))
+                for (const QVariant& item : json.keys({"orders",order,"items"}))
+                    if (json.value({"orders",order,"items",item,"qty"}).toInt() > 10)
+                        skus1.append( json.value({"orders",order,"items",item,"sku"}));
+            int loopTimeSpent = timer.nsecsElapsed();
+
+            QElapsedTimer timer2;
+            timer2.start();
+            JsonWax::JsonPath path("$.orders[*].items[?(@.qty > 10)].sku");
+            QVariantList skus2 = json.queryValues( path);
+            int queryTimeSpent = timer2.nsecsElapsed();
+
+            if (skus1 != skus2)
+                qDebug() << "FAILED: the query found other values.";
+
+            qDebug() << "----- Select 20000 items with a filter -----";
+            qDebug() << "JsonWax keys() and value() loops spent time:" << loopTimeSpent * 1e-6 << "ms";
+            qDebug() << "JsonWax compiled JsonPath spent time:" << queryTimeSpent * 1e-6 << "ms\n";
+        }
+
+        {   // CHILD ITERATION
+            JsonWax json;
+            for (int i = 0; i < 100000; ++i)
+                json.setValue({"values",QString::number(i)}, i);
+
+            QElapsedTimer timer;
+            timer.start();
+            int before = ALLOCATION_COUNT.load();
+            qint64 sum1 = 0;
+            for (const QVariant& key : json.keys({"values"}))
+                sum1 += json.value({"values",key}).toInt();
+            int keysAllocations = ALLOCATION_COUNT.load() - before;
+            int keysTimeSpent = timer.nsecsElapsed();
+
+            QElapsedTimer timer2;
+            timer2.start();
+            before = ALLOCATION_COUNT.load();
+            qint64 sum2 = 0;
+            json.forEach({"values"}, [&sum2]( const QVariant&, const JsonWax::Node& node){ sum2 += node.value().toInt(); });
+            int forEachAllocations = ALLOCATION_COUNT.load() - before;
+            int forEachTimeSpent = timer2.nsecsElapsed();
+
+            if (sum1 != sum2)
+                qDebug() << "FAILED: forEach visited other values.";
+
+            qDebug() << "----- Iterate over 100000 children -----";
+            qDebug() << "JsonWax keys() + value() spent time:" << keysTimeSpent * 1e-6 << "ms, allocations:" << keysAllocations;
+            qDebug() << "JsonWax forEach spent time:" << forEachTimeSpent * 1e-6 << "ms, allocations:" << forEachAllocations << "\n";
+        }
+
+        {   // REPEATED SAVE WITH FEW CHANGES
+            JsonWax json;
+            for (int i = 0; i < 1000; ++i)
+                for (int j = 0; j < 20; ++j)
+                    json.setValue({"records",i,QString("field") + QString::number(j)}, QString("value ") + QString::number(i * j));
+
+            QElapsedTimer timer;
+            timer.start();
+            QString first = json.toString( JsonWax::Readable);
+            int firstTimeSpent = timer.nsecsElapsed();
+
+            QElapsedTimer timer2;
+            timer2.start();
+            for (int i = 0; i < 10; ++i)
+            {
+                json.setValue({"records",i * 97,"field3"}, i);
+                json.toString( JsonWax::Readable);
+            }
+            int repeatedTimeSpent = timer2.nsecsElapsed();
+
+            qDebug() << "----- Repeated toString (20000 values, one change each time) -----";
+            qDebug() << "JsonWax first toString spent time:" << firstTimeSpent * 1e-6 << "ms";
+            qDebug() << "JsonWax later toString, average time:" << repeatedTimeSpent * 1e-7 << "ms\n";
+        }
+
+        {   // DIFF AND PATCH
+            JsonWax previous;
+            for (int i = 0; i < 10000; ++i)
+            {
+                previous.setValue({"records",i,"id"}, i);
+                previous.setValue({"records",i,"name"}, QString("name ") + QString::number(i));
+            }
+            JsonWax current;
+            previous.copy({}, current, {});
+            current.setValue({"records",17,"name"}, "changed");
+            current.setValue({"records",5000,"id"}, -1);
+            current.remove({"records",9000});
+
+            QElapsedTimer timer;
+            timer.start();
+            QByteArray whole = current.toString( JsonWax::Compact).toUtf8();
+            int wholeTimeSpent = timer.nsecsElapsed();
+
+            QElapsedTimer timer2;
+            timer2.start();
+            QByteArray patch = previous.diff( current).toString().toUtf8();
+            previous.applyPatch( patch);
+            int patchTimeSpent = timer2.nsecsElapsed();
+
+            if (previous.toString( JsonWax::Compact) != current.toString( JsonWax::Compact))
+                qDebug() << "FAILED: the patched document is different.";
+
+            qDebug() << "----- Replicate 3 changes in 20000 values -----";
+            qDebug() << "JsonWax whole document:" << whole.size() << "bytes," << wholeTimeSpent * 1e-6 << "ms";
+            qDebug() << "JsonWax diff + applyPatch:" << patch.size() << "bytes," << patchTimeSpent * 1e-6 << "ms\n";
+        }
+
+        {   // COMPARE UNCHANGED DOCUMENTS
+            JsonWax previous;
+            for (int i = 0; i < 10000; ++i)
+            {
+                previous.setValue({"records",i,"id"}, i);
+                previous.setValue({"records",i,"name"}, QString("name ") + QString::number(i));
+            }
+            JsonWax current;
+            previous.copy({}, current, {});
+            current.setValue({"records",5000,"id"}, 5000.0);                 // Changed, but equal.
+            previous.hash();
+            current.hash();
+
+            QElapsedTimer timer;
+            timer.start();
+            bool textsAreEqual = true;
+            for (int i = 0; i < 10; ++i)
+                textsAreEqual = textsAreEqual && (previous.toString( JsonWax::Compact) == current.toString( JsonWax::Compact));
+            int textTimeSpent = timer.nsecsElapsed();
+
+            QElapsedTimer timer2;
+            timer2.start();
+            bool areEqual = true;
+            for (int i = 0; i < 10; ++i)
+                areEqual = areEqual && previous.equals( current) && previous.hash() == current.hash();
+            int equalsTimeSpent = timer2.nsecsElapsed();
+
+            if (!areEqual)
+                qDebug() << "FAILED: the documents are not equal.";
+
+            qDebug() << "----- Compare 20000 values 10 times -----";
+            qDebug() << "JsonWax toString() comparison:" << textTimeSpent * 1e-6 << "ms" << (textsAreEqual ? "(equal)" : "(different)");
+            qDebug() << "JsonWax equals() + hash():" << equalsTimeSpent * 1e-6 << "ms\n";
+        }
+
+        {   // JOURNALED SAVE
+            QString fileName = QDir::tempPath() + "/jsonwax_journal_speed.json";
+            JsonWax json;
+            for (int i = 0; i < 10000; ++i)
+            {
+                json.setValue({"records",i,"id"}, i);
+                json.setValue({"records",i,"name"}, QString("name ") + QString::number(i));
+            }
+            json.saveAs( fileName);
+
+            QElapsedTimer timer;
+            timer.start();
+            for (int i = 0; i < 10; ++i)
+            {
+                json.setValue({"records",i * 997,"name"}, "changed");
+                json.saveAs( fileName);
+            }
+            int wholeTimeSpent = timer.nsecsElapsed();
+
+            json.setJournaled( true);
+            json.loadFile( fileName);
+            QElapsedTimer timer2;
+            timer2.start();
+            for (int i = 0; i < 10; ++i)
+            {
+                json.setValue({"records",i * 997,"id"}, -i);
+                json.save();
+            }
+            int journalTimeSpent = timer2.nsecsElapsed();
+
+            JsonWax loaded( fileName);
+            if (!loaded.equals( json))
+                qDebug() << "FAILED: the journaled file is different.";
+
+            QFile::remove( fileName);
+            QFile::remove( fileName + ".journal");
+            qDebug() << "----- Save 20000 values 10 times, with one change each time -----";
+            qDebug() << "JsonWax saveAs():" << wholeTimeSpent * 1e-6 << "ms";
+            qDebug() << "JsonWax journaled save():" << journalTimeSpent * 1e-6 << "ms\n";
+        }
+
+        {   // LOAD BINARY
+            QString fileName = QDir::tempPath() + "/jsonwax_binary_speed";
+            JsonWax json;
+            for (int i = 0; i < 10000; ++i)
+            {
+                json.setValue({"records",i,"id"}, i);
+                json.setValue({"records",i,"name"}, QString("name ") + QString::number(i));
+                json.setValue({"records",i,"score"}, i * 0.25);
+            }
+            json.saveAs( fileName + ".json");
+            json.saveBinary( fileName + ".jwb");
+
+            JsonWax loaded;
+            QElapsedTimer timer;
+            timer.start();
+            loaded.loadFile( fileName + ".json");
+            int textTimeSpent = timer.nsecsElapsed();
+
+            QElapsedTimer timer2;
+            timer2.start();
+            loaded.loadBinary( fileName + ".jwb");
+            int binaryTimeSpent = timer2.nsecsElapsed();
+
+            if (!loaded.equals( json))
+                qDebug() << "FAILED: the binary document is different.";
+
+            qDebug() << "----- Load 30000 values -----";
+            qDebug() << "JsonWax loadFile():" << QFile( fileName + ".json").size() << "bytes," << textTimeSpent * 1e-6 << "ms";
+            qDebug() << "JsonWax loadBinary():" << QFile( fileName + ".jwb").size() << "bytes," << binaryTimeSpent * 1e-6 << "ms\n";
+            QFile::remove( fileName + ".json");
+            QFile::remove( fileName + ".jwb");
+        }
+
+        {   // CBOR AND MESSAGEPACK
+            JsonWax json;
+            for (int i = 0; i < 10000; ++i)
+            {
+                json.setValue({"records",i,"id"}, i);
+                json.setValue({"records",i,"name"}, QString("name ") + QString::number(i));
+                json.setValue({"records",i,"score"}, i * 0.25);
+            }
+
+            QElapsedTimer timer;
+            timer.start();
+            QByteArray text = json.toString( JsonWax::Compact).toUtf8();
+            JsonWax fromText;
+            fromText.fromByteArray( text);
+            int textTimeSpent = timer.nsecsElapsed();
+
+            QElapsedTimer timer2;
+            timer2.start();
+            QByteArray cbor = json.toCbor();
+            JsonWax fromCbor;
+            fromCbor.fromCbor( cbor);
+            int cborTimeSpent = timer2.nsecsElapsed();
+
+            QElapsedTimer timer3;
+            timer3.start();
+            QByteArray messagePack = json.toMessagePack();
+            JsonWax fromMessagePack;
+            fromMessagePack.fromMessagePack( messagePack);
+            int messagePackTimeSpent = timer3.nsecsElapsed();
+
+            if (!fromCbor.equals( json) || !fromMessagePack.equals( json))
+                qDebug() << "FAILED: the decoded documents are different.";
+
+            qDebug() << "----- Encode and decode 30000 values -----";
+            qDebug() << "JsonWax text:" << text.size() << "bytes," << textTimeSpent * 1e-6 << "ms";
+            qDebug() << "JsonWax CBOR:" << cbor.size() << "bytes," << cborTimeSpent * 1e-6 << "ms";
+            qDebug() << "JsonWax MessagePack:" << messagePack.size() << "bytes," << messagePackTimeSpent * 1e-6 << "ms";
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+            QCborValue value = QCborValue::fromJsonValue( QJsonDocument::fromJson( text).object());
+            QElapsedTimer timer4;
+            timer4.start();
+            QByteArray qtCbor = value.toCbor();
+            QCborValue qtDecoded = QCborValue::fromCbor( qtCbor);
+            int qtTimeSpent = timer4.nsecsElapsed();
+            qDebug() << "QCborValue:" << qtCbor.size() << "bytes," << qtTimeSpent * 1e-6 << "ms\n";
+#endif
+        }
+
+#ifdef JSONWAX_ZLIB
+        {   // COMPRESSED SAVE AND LOAD
+            QString fileName = QDir::tempPath() + "/jsonwax_compressed_speed";
+            JsonWax json;
+            for (int i = 0; i < 10000; ++i)
+            {
+                json.setValue({"records",i,"id"}, i);
+                json.setValue({"records",i,"name"}, QString("name ") + QString::number(i));
+            }
+
+            QElapsedTimer timer;
+            timer.start();
+            json.saveAs( fileName + ".json");
+            json.loadFile( fileName + ".json");
+            int plainTimeSpent = timer.nsecsElapsed();
+
+            QElapsedTimer timer2;
+            timer2.start();
+            json.saveAs( fileName + ".json.gz", JsonWax::Readable, false, true, JsonWax::Gzip);
+            json.loadFile( fileName + ".json.gz");
+            int gzipTimeSpent = timer2.nsecsElapsed();
+
+            qDebug() << "----- Save and load 20000 values -----";
+            qDebug() << "JsonWax uncompressed:" << QFile( fileName + ".json").size() << "bytes," << plainTimeSpent * 1e-6 << "ms";
+            qDebug() << "JsonWax gzip:" << QFile( fileName + ".json.gz").size() << "bytes," << gzipTimeSpent * 1e-6 << "ms\n";
+            QFile::remove( fileName + ".json");
+            QFile::remove( fileName + ".json.gz");
+        }
+#endif
+
+        {   // SAVE BY STREAMING
+            QString fileName = QDir::tempPath() + "/jsonwax_streaming_speed.json";
+            JsonWax json;
+            for (int i = 0; i < 50000; ++i)
+            {
+                json.setValue({"records",i,"id"}, i);
+                json.setValue({"records",i,"name"}, QString("name ") + QString::number(i));
+            }
+
+            QElapsedTimer timer;
+            timer.start();
+            QFile qfile( fileName);
+            qfile.open( QIODevice::WriteOnly);
+            qfile.write( json.toString( JsonWax::Readable).toUtf8());
+            qfile.close();
+            int wholeTimeSpent = timer.nsecsElapsed();
+
+            QElapsedTimer timer2;
+            timer2.start();
+            json.saveAs( fileName);
+            int streamTimeSpent = timer2.nsecsElapsed();
+
+            qDebug() << "----- Save 100000 values -----";
+            qDebug() << "JsonWax whole text, then write:" << wholeTimeSpent * 1e-6 << "ms";
+            qDebug() << "JsonWax saveAs, streamed:" << streamTimeSpent * 1e-6 << "ms," << qfile.size() << "bytes\n";
+            QFile::remove( fileName);
+        }
+
+        {   // SAVE ON ANOTHER THREAD
+            QString fileName = QDir::tempPath() + "/jsonwax_async_speed.json";
+            JsonWax json;
+            for (int i = 0; i < 50000; ++i)
+            {
+                json.setValue({"records",i,"id"}, i);
+                json.setValue({"records",i,"name"}, QString("name ") + QString::number(i));
+            }
+
+            QElapsedTimer timer;
+            timer.start();
+            json.saveAs( fileName);
+            int blockedTimeSpent = timer.nsecsElapsed();
+
+            QElapsedTimer timer2;
+            timer2.start();
+            QFuture<bool> future = json.saveAsync( fileName);
+            json.setValue({"records",0,"id"}, -1);
+            int asyncTimeSpent = timer2.nsecsElapsed();
+            future.waitForFinished();
+
+            qDebug() << "----- Save 100000 values, time until editing can continue -----";
+            qDebug() << "JsonWax saveAs:" << blockedTimeSpent * 1e-6 << "ms";
+            qDebug() << "JsonWax saveAsync:" << asyncTimeSpent * 1e-6 << "ms\n";
+            QFile::remove( fileName);
+        }
+
+        {   // SERIALIZE TO UTF-8
+            QByteArray text = "{\"records\":[";
+            for (int i = 0; i < 20000; ++i)
+                text += "{\"id\":" + QByteArray::number(i) + ",\"name\":\"name " + QByteArray::number(i) + "\",\"tags\":[\"a\",\"b\"]},";
+            text.chop(1);
+            text += "]}";
+
+            JsonWax json;
+            json.fromByteArray( text);
+            QElapsedTimer timer;
+            timer.start();
+            QByteArray bytes = json.toByteArray( JsonWax::Readable);
+            int timeSpent = timer.nsecsElapsed();
+
+            JsonWax json2;
+            json2.fromByteArray( text);
+            QElapsedTimer timer2;
+            timer2.start();
+            QByteArray viaString = json2.toString( JsonWax::Readable).toUtf8();
+            int stringTimeSpent = timer2.nsecsElapsed();
+
+            QJsonDocument doc = QJsonDocument::fromJson( text);
+            QElapsedTimer timer3;
+            timer3.start();
+            QByteArray qtBytes = doc.toJson( QJsonDocument::Indented);
+            int qtTimeSpent = timer3.nsecsElapsed();
+
+            qDebug() << "----- Serialize 20000 records to UTF-8 (" << bytes.size() << "bytes) -----";
+            qDebug() << "JsonWax toByteArray:" << timeSpent * 1e-6 << "ms";
+            qDebug() << "JsonWax toString, then toUtf8:" << stringTimeSpent * 1e-6 << "ms";
+            qDebug() << "QJsonDocument toJson:" << qtTimeSpent * 1e-6 << "ms," << qtBytes.size() << "bytes" << (viaString == bytes ? "" : "(DIFFERENT TEXT)") << "\n";
+        }
+
+        {   // SERIALIZE STRINGS
+            JsonWax json;
+            QString sentence = QString::fromUtf8("The quick brown fox jumps over the lazy dog, \"twice\"\nand then r\xc3\xb8ms away. ");
+            for (int i = 0; i < 20000; ++i)
+                json.setValue({"texts",i}, sentence + QString::number(i) + sentence);
+
+            QElapsedTimer timer;
+            timer.start();
+            QByteArray bytes = json.toByteArray( JsonWax::Compact);
+            int timeSpent = timer.nsecsElapsed();
+
+            json.setValue({"texts",0}, "changed");                    // So the next serialization isn't cached.
+            QElapsedTimer timer2;
+            timer2.start();
+            json.toByteArray( JsonWax::Compact, true);
+            int codePointsTimeSpent = timer2.nsecsElapsed();
+
+            QJsonDocument doc = QJsonDocument::fromJson( bytes);
+            QElapsedTimer timer3;
+            timer3.start();
+            doc.toJson( QJsonDocument::Compact);
+            int qtTimeSpent = timer3.nsecsElapsed();
+
+            qDebug() << "----- Serialize 20000 strings (" << bytes.size() << "bytes) -----";
+            qDebug() << "JsonWax:" << timeSpent * 1e-6 << "ms";
+            qDebug() << "JsonWax with code points:" << codePointsTimeSpent * 1e-6 << "ms";
+            qDebug() << "QJsonDocument:" << qtTimeSpent * 1e-6 << "ms\n";
+        }
+
+        {   // SERIALIZE NUMBERS
+            JsonWax json;
+            quint64 state = 1;
+            for (int i = 0; i < 100000; ++i)
+            {
+                state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+                json.setValue({"doubles",i}, double( state >> 11) / 9007199254740992.0 * 1000.0);
+                json.setValue({"integers",i}, qlonglong( state >> 20) - 8000000000000LL);
+            }
+
+            QElapsedTimer timer;
+            timer.start();
+            QByteArray bytes = json.toByteArray( JsonWax::Compact);
+            int timeSpent = timer.nsecsElapsed();
+
+            QJsonDocument doc = QJsonDocument::fromJson( bytes);
+            QElapsedTimer timer2;
+            timer2.start();
+            doc.toJson( QJsonDocument::Compact);
+            int qtTimeSpent = timer2.nsecsElapsed();
+
+            QElapsedTimer timer3;
+            timer3.start();
+            int length = 0;
+            for (int i = 0; i < 100000; ++i)
+                length += QVariant( json.value({"doubles",i})).toString().size();
+            int variantTimeSpent = timer3.nsecsElapsed();
+
+            qDebug() << "----- Serialize 100000 doubles and 100000 integers (" << bytes.size() << "bytes) -----";
+            qDebug() << "JsonWax:" << timeSpent * 1e-6 << "ms";
+            qDebug() << "QJsonDocument:" << qtTimeSpent * 1e-6 << "ms";
+            qDebug() << "QVariant::toString(), doubles only:" << variantTimeSpent * 1e-6 << "ms," << length << "characters\n";
+        }
+
+        {   // SERIALIZE ON SEVERAL THREADS
+            QByteArray text = "{\"records\":[";
+            for (int i = 0; i < 100000; ++i)
+                text += "{\"id\":" + QByteArray::number(i) + ",\"name\":\"name " + QByteArray::number(i) + "\",\"score\":" + QByteArray::number(i * 0.37) + "},";
+            text.chop(1);
+            text += "]}";
+
+            JsonWax json;
+            json.fromByteArray( text);
+            QElapsedTimer timer;
+            timer.start();
+            QByteArray bytes = json.toByteArray( JsonWax::Readable);
+            int timeSpent = timer.nsecsElapsed();
+
+            JsonWax json2;
+            json2.fromByteArray( text);
+            json2.setParallel( true);
+            QElapsedTimer timer2;
+            timer2.start();
+            QByteArray parallelBytes = json2.toByteArray( JsonWax::Readable);
+            int parallelTimeSpent = timer2.nsecsElapsed();
+
+            qDebug() << "----- Serialize 100000 records (" << bytes.size() << "bytes) on" << QThreadPool::globalInstance()->maxThreadCount() << "threads -----";
+            qDebug() << "JsonWax:" << timeSpent * 1e-6 << "ms";
+            qDebug() << "JsonWax parallel:" << parallelTimeSpent * 1e-6 << "ms" << (parallelBytes == bytes ? "" : "(DIFFERENT TEXT)") << "\n";
+        }
+
         {   // SERIALIZE TO BASE64 BYTE ARRAY.
             QList<QRect> list;
             for (int i = 0; i < 20000; ++i)
@@ -580,6 +1225,12 @@ public:
             int jsonWaxTimeSpent = timer.nsecsElapsed();
             qDebug() << "----- Copy speed -----";
             qDebug() << "JsonWax copy spent time: " << jsonWaxTimeSpent * 1e-6 << "ms";
+
+            QElapsedTimer timer2;
+            timer2.start();
+            json.setValue({"b",0}, -1);                                 // The copy is made here (copy on write).
+            jsonWaxTimeSpent = timer2.nsecsElapsed();
+            qDebug() << "JsonWax first write after copy spent time: " << jsonWaxTimeSpent * 1e-6 << "ms\n";
         }
     }
 
@@ -1387,6 +2038,1086 @@ public:
             checkWax( json, "{}", description, passCount, failCount);
         }
 
+        {
+            JsonWax json;
+            json.setValue({"a","b","c",0}, "first");
+            json.setValue({"a","b","c",1}, "second");
+            QString description = "prefix cache: reading below a cached path.";
+            checkWax( json.value({"a","b","c",1}) == "second", description, passCount, failCount);
+
+            json.setValue({"a","b"}, "flat");
+            description = "prefix cache: replaced ancestor isn't found anymore.";
+            checkWax( json.value({"a","b","c",1}) == QVariant(), description, passCount, failCount);
+            checkWax( json.value({"a","b"}) == "flat", description, passCount, failCount);
+
+            json.setValue({"a","b",0,"x"}, 1);
+            json.setValue({"a","b",1,"x"}, 2);
+            json.prepend({"a","b"}, "front");
+            description = "prefix cache: prepend shifts cached array elements.";
+            checkWax( json.value({"a","b",1,"x"}) == 1, description, passCount, failCount);
+            checkWax( json.value({"a","b",2,"x"}) == 2, description, passCount, failCount);
+
+            json.remove({"a","b",1});
+            description = "prefix cache: remove shifts cached array elements.";
+            checkWax( json.value({"a","b",1,"x"}) == 2, description, passCount, failCount);
+            checkWax( json.exists({"a","b",2}) == false, description, passCount, failCount);
+
+            json.move({"a","b"}, {"z"});
+            json.setValue({"a","b",0}, "new");
+            description = "prefix cache: moved arrays aren't reused.";
+            checkWax( json, QString("{\"a\":{\"b\":[\"new\"]},\"z\":[\"front\",{\"x\":2}]}"), description, passCount, failCount);
+        }
+
+        {
+            JsonWax json;
+            json.setValue({"a","b",0}, 1);
+            json.setValue({"a","b",1}, 2);
+            json.copy({"a"}, {"c"});
+            json.setValue({"a","b",0}, 10);
+            json.append({"c","b"}, 3);
+            QString description = "copy on write: changing the source or the copy doesn't change the other.";
+            checkWax( json, QString("{\"a\":{\"b\":[10,2]},\"c\":{\"b\":[1,2,3]}}"), description, passCount, failCount);
+
+            JsonWax json2;
+            json.copy({"c"}, json2, {"x"});
+            json2.remove({"x","b",0});
+            json.popLast({"c","b"});
+            description = "copy on write: copies between documents are independent.";
+            checkWax( json2, QString("{\"x\":{\"b\":[2,3]}}"), description, passCount, failCount);
+            checkWax( json, QString("{\"a\":{\"b\":[10,2]},\"c\":{\"b\":[1,2]}}"), description, passCount, failCount);
+
+            json.copy({}, {"a","self"});
+            description = "copy on write: copy the root into itself.";
+            checkWax( json, QString("{\"a\":{\"b\":[10,2],\"self\":{\"a\":{\"b\":[10,2]},\"c\":{\"b\":[1,2]}}},\"c\":{\"b\":[1,2]}}"), description, passCount, failCount);
+        }
+
+        {
+            JsonWax json;
+            json.setValue({"config","threads"}, 4);
+            json.setValue({"config","hosts",0}, "alpha");
+            JsonWax::Snapshot snapshot = json.snapshot();
+
+            json.setValue({"config","threads"}, 8);
+            json.append({"config","hosts"}, "beta");
+            json.remove({"config","hosts",0});
+            QString description = "snapshot: isn't changed by later edits.";
+            checkWax( snapshot.value({"config","threads"}) == 4, description, passCount, failCount);
+            checkWax( snapshot.size({"config","hosts"}) == 1, description, passCount, failCount);
+            checkWax( snapshot.toString( JsonWax::Compact) == "{\"config\":{\"hosts\":[\"alpha\"],\"threads\":4}}", description, passCount, failCount);
+            checkWax( json, QString("{\"config\":{\"hosts\":[\"beta\"],\"threads\":8}}"), description, passCount, failCount);
+
+            JsonWax::Snapshot newer = json.snapshot();
+            json.fromByteArray("[]");
+            description = "snapshot: outlives the document it was taken from.";
+            checkWax( newer.value({"config","hosts",0}) == "beta", description, passCount, failCount);
+            checkWax( newer.isArray({"config","hosts"}) && !newer.exists({"config","hosts",1}), description, passCount, failCount);
+        }
+
+        {
+            JsonWax json;
+            json.setValue({"users",0,"name"}, "Ann");
+            JsonWax::Batch batch;
+            batch.setValue({"users",1,"name"}, "Bob");
+            batch.setValue({"stats","count"}, 2);
+            batch.setValue({"users",0,"age"}, 31);
+            batch.append({"log"}, "added Bob");
+            batch.setNull({"stats","last"});
+            QString description = "batch: all operations are applied.";
+            checkWax( json.apply( batch), description, passCount, failCount);
+            checkWax( json, QString("{\"log\":[\"added Bob\"],\"stats\":{\"count\":2,\"last\":null},"
+                                    "\"users\":[{\"age\":31,\"name\":\"Ann\"},{\"name\":\"Bob\"}]}"), description, passCount, failCount);
+
+            qDebug() << "expects error message:";
+            JsonWax::Batch invalidBatch;
+            invalidBatch.setValue({"stats","count"}, 3);
+            invalidBatch.setValue({"users",-1}, "nobody");
+            description = "batch: an invalid operation means nothing is applied.";
+            checkWax( json.apply( invalidBatch) == false, description, passCount, failCount);
+            checkWax( json.value({"stats","count"}) == 2, description, passCount, failCount);
+
+            JsonWax::Batch orderedBatch;
+            orderedBatch.remove({"users",0});
+            orderedBatch.setValue({"users",0,"age"}, 40);
+            orderedBatch.setValue({"stats","count"}, 1);
+            description = "batch: dependent operations keep their order.";
+            checkWax( json.apply( orderedBatch), description, passCount, failCount);
+            checkWax( json, QString("{\"log\":[\"added Bob\"],\"stats\":{\"count\":1,\"last\":null},"
+                                    "\"users\":[{\"age\":40,\"name\":\"Bob\"}]}"), description, passCount, failCount);
+        }
+
+        {
+            JsonWax json;
+            json.fromByteArray("{\"ints\":[1,2,3],\"doubles\":[0.5,1.5],\"flags\":[true,false]}");
+            QString description = "packed arrays: numbers and booleans are read and written unchanged.";
+            checkWax( json, QString("{\"doubles\":[0.5,1.5],\"flags\":[true,false],\"ints\":[1,2,3]}"), description, passCount, failCount);
+            checkWax( json.value({"ints",1}) == 2 && json.value({"doubles",0}) == 0.5, description, passCount, failCount);
+
+            json.prepend({"ints"}, 0);
+            json.remove({"ints",2});
+            json.popFirst({"flags"});
+            json.setValue({"ints",3}, 4);
+            description = "packed arrays: prepend, remove, pop and append.";
+            checkWax( json, QString("{\"doubles\":[0.5,1.5],\"flags\":[false],\"ints\":[0,1,3,4]}"), description, passCount, failCount);
+
+            json.append({"ints"}, "five");
+            json.setValue({"doubles",3}, 2.5);
+            json.setValue({"flags",0,"x"}, true);
+            description = "packed arrays: other types, holes and containers unpack the array.";
+            checkWax( json, QString("{\"doubles\":[0.5,1.5,null,2.5],\"flags\":[{\"x\":true}],\"ints\":[0,1,3,4,\"five\"]}"), description, passCount, failCount);
+
+            json.setValue({"numbers",0}, 7);
+            json.copy({"numbers",0}, {"copied"});
+            json.move({"numbers",0}, {"moved"});
+            description = "packed arrays: copy and move an element.";
+            checkWax( json.value({"copied"}) == 7 && json.value({"moved"}) == 7, description, passCount, failCount);
+            checkWax( json.isNullValue({"numbers",0}), description, passCount, failCount);
+        }
+
+        {
+            JsonWax json;
+            json.insertRange({"queue"}, 0, {1,2,3,4,5,6});
+            json.removeRange({"queue"}, 1, 2);
+            json.insertRange({"queue"}, 2, {7,8});
+            QString description = "ranges: insert and remove a range of a packed array.";
+            checkWax( json, QString("{\"queue\":[1,4,7,8,5,6]}"), description, passCount, failCount);
+
+            json.splice({"queue"}, 1, 3, {"a","b"});
+            json.popFirst({"queue"}, 2);
+            json.prepend({"queue"}, 0);
+            json.popLast({"queue"}, 2);
+            description = "ranges: splice, pop and prepend.";
+            checkWax( json, QString("{\"queue\":[0,\"b\"]}"), description, passCount, failCount);
+
+            json.insertRange({"queue"}, 4, {true});
+            json.removeRange({"queue"}, 1, 100);
+            description = "ranges: out of range positions.";
+            checkWax( json, QString("{\"queue\":[0]}"), description, passCount, failCount);
+
+            for (int i = 0; i < 100; ++i)
+                json.append({"ring"}, i);
+            for (int i = 0; i < 50; ++i)
+            {
+                json.popFirst({"ring"}, 1);
+                json.append({"ring"}, 100 + i);
+            }
+            json.prepend({"ring"}, 49);
+            description = "ranges: using an array as a queue.";
+            checkWax( json.size({"ring"}) == 101 && json.value({"ring",0}) == 49 && json.value({"ring",100}) == 149, description, passCount, failCount);
+        }
+
+        {
+            JsonWax json;
+            json.setValue({"ids",40}, "x");
+            json.setValue({"ids",50,"name"}, "y");
+            QString expected = "[";
+            for (int i = 0; i < 40; ++i)
+                expected.append("null,");
+            expected.append("\"x\",");
+            for (int i = 41; i < 50; ++i)
+                expected.append("null,");
+            expected.append("{\"name\":\"y\"}]");
+            QString description = "sparse arrays: holes are written as nulls.";
+            checkWax( json.toString( JsonWax::Compact, false, {"ids"}) == expected, description, passCount, failCount);
+            checkWax( json.size({"ids"}) == 51 && json.isNullValue({"ids",10}) && json.value({"ids",40}) == "x", description, passCount, failCount);
+
+            json.remove({"ids",0});
+            json.removeRange({"ids"}, 0, 38);
+            json.insertRange({"ids"}, 1, {1,QVariant()});
+            json.setValue({"ids",1}, QVariant());
+            description = "sparse arrays: removing and inserting shifts the elements.";
+            checkWax( json.toString( JsonWax::Compact, false, {"ids"}) == "[null,null,null,\"x\",null,null,null,null,null,null,null,null,null,{\"name\":\"y\"}]",
+                      description, passCount, failCount);
+
+            for (int i = 0; i < 14; ++i)
+                if (json.isNullValue({"ids",i}))
+                    json.setValue({"ids",i}, i);
+            description = "sparse arrays: a filled array is a normal array again.";
+            checkWax( json.toString( JsonWax::Compact, false, {"ids"}) == "[0,1,2,\"x\",4,5,6,7,8,9,10,11,12,{\"name\":\"y\"}]", description, passCount, failCount);
+
+            json.setValue({"big",5000000}, true);
+            description = "sparse arrays: a large index doesn't allocate the nulls before it.";
+            checkWax( json.size({"big"}) == 5000001 && json.value({"big",5000000}) == true, description, passCount, failCount);
+        }
+
+        {
+            JsonWax json;
+            QVariant text = QString("moved");
+            json.setValue({"a"}, std::move( text));
+            json.emplace<QString>({"line"}, 3, QChar('-'));
+            QString description = "move: values are moved or constructed in place.";
+            checkWax( json, QString("{\"a\":\"moved\",\"line\":\"---\"}"), description, passCount, failCount);
+
+            JsonWax part;
+            part.setValue({"x",0}, 1);
+            part.setValue({"y"}, "z");
+            json.moveFrom( std::move( part), {"b"});
+            description = "move: a whole document is moved into a location.";
+            checkWax( json, QString("{\"a\":\"moved\",\"b\":{\"x\":[1],\"y\":\"z\"},\"line\":\"---\"}"), description, passCount, failCount);
+            checkWax( part, QString("{}"), description, passCount, failCount);
+
+            JsonWax::Snapshot snapshot = json.snapshot();
+            json.move({"b","y"}, {"c"});
+            description = "move: moving a value doesn't change a snapshot.";
+            checkWax( snapshot.value({"b","y"}) == "z" && json.value({"c"}) == "z" && !json.exists({"b","y"}), description, passCount, failCount);
+        }
+
+        {
+            JsonWax json;
+            json.setValue({"mixed",0}, "first");
+            for (int i = 0; i < 1000; ++i)
+                json.append({"mixed"}, i);
+            json.remove({"mixed",0});
+            json.setValue({"name"}, "memory");
+            QString before = json.toString( JsonWax::Compact);
+            qint64 listUsage = json.memoryUsage({"mixed"});
+            QString description = "memory usage: is reported for the document and its parts.";
+            checkWax( json.memoryUsage() > listUsage && listUsage > 1000 * qint64(sizeof(int)), description, passCount, failCount);
+
+            json.compact();
+            description = "compact: packs arrays and keeps the content.";
+            checkWax( json.memoryUsage({"mixed"}) < listUsage, description, passCount, failCount);
+            checkWax( json.toString( JsonWax::Compact) == before, description, passCount, failCount);
+
+            JsonWax::Snapshot snapshot = json.snapshot();
+            json.compact();                                             // Shared with the snapshot: nothing to do.
+            json.setValue({"mixed",0}, -1);
+            description = "compact: the document can be changed afterwards.";
+            checkWax( json.value({"mixed",0}) == -1 && snapshot.value({"mixed",0}) == 0, description, passCount, failCount);
+        }
+
+        {
+            JsonWax json;
+            json.fromByteArray("{\"users\":[{\"id\":7,\"name\":\"Ann\"},{\"id\":3,\"name\":\"Bob\"},{\"id\":\"9\"}]}");
+            json.createIndex({"users"}, {"id"});
+            QString description = "index: finds elements by field value.";
+            checkWax( json.findBy({"users"}, {"id"}, 3) == 1 && json.findBy({"users"}, {"id"}, 7.0) == 0, description, passCount, failCount);
+            checkWax( json.findBy({"users"}, {"id"}, 9) == -1 && json.findBy({"users"}, {"id"}, "9") == 2, description, passCount, failCount);
+
+            json.setValue({"users",1,"id"}, 4);
+            json.append({"users"}, 5);
+            json.setValue({"users",4,"id"}, 12);
+            description = "index: follows setValue and append.";
+            checkWax( json.findBy({"users"}, {"id"}, 3) == -1 && json.findBy({"users"}, {"id"}, 4) == 1, description, passCount, failCount);
+            checkWax( json.findBy({"users"}, {"id"}, 12) == 4 && json.findBy({"users"}, {"id"}, 5) == -1, description, passCount, failCount);
+
+            json.remove({"users",0});
+            json.setValue({"users",0,"name"}, "Bill");
+            description = "index: follows remove.";
+            checkWax( json.findBy({"users"}, {"id"}, 4) == 0 && json.findBy({"users"}, {"id"}, 7) == -1, description, passCount, failCount);
+
+            json.fromByteArray("{\"users\":[{\"id\":1}]}");
+            description = "index: is kept for new content.";
+            checkWax( json.findBy({"users"}, {"id"}, 1) == 0, description, passCount, failCount);
+            checkWax( json.findBy({"other"}, {"id"}, 1) == -1, description, passCount, failCount);
+        }
+
+        {
+            JsonWax json;
+            json.fromByteArray("{\"users\":[{\"id\":0},{\"id\":1},{\"id\":2},{\"id\":3},{\"id\":4},"
+                               "{\"id\":5},{\"id\":6},{\"id\":7},{\"id\":8},{\"id\":9}]}");
+            json.createIndex({"users"}, {"id"});
+            json.findBy({"users"}, {"id"}, 0);
+
+            json.prepend({"users"}, 0);
+            json.setValue({"users",0,"id"}, 100);
+            QString description = "index: follows prepend and popFirst.";
+            checkWax( json.findBy({"users"}, {"id"}, 100) == 0 && json.findBy({"users"}, {"id"}, 5) == 6, description, passCount, failCount);
+            json.popFirst({"users"}, 2);
+            checkWax( json.findBy({"users"}, {"id"}, 100) == -1 && json.findBy({"users"}, {"id"}, 0) == -1, description, passCount, failCount);
+            checkWax( json.findBy({"users"}, {"id"}, 1) == 0 && json.findBy({"users"}, {"id"}, 5) == 4, description, passCount, failCount);
+
+            json.splice({"users"}, 6, 1, {0, 0});                       // 1 2 3 4 5 6 50 51 8 9
+            json.setValue({"users",6,"id"}, 50);
+            json.setValue({"users",7,"id"}, 51);
+            description = "index: follows splice, insertRange, removeRange and remove.";
+            checkWax( json.findBy({"users"}, {"id"}, 7) == -1 && json.findBy({"users"}, {"id"}, 51) == 7, description, passCount, failCount);
+            checkWax( json.findBy({"users"}, {"id"}, 6) == 5 && json.findBy({"users"}, {"id"}, 9) == 9, description, passCount, failCount);
+            json.insertRange({"users"}, 1, {0});                        // 1 60 2 3 4 5 6 50 51 8 9
+            json.setValue({"users",1,"id"}, 60);
+            checkWax( json.findBy({"users"}, {"id"}, 1) == 0 && json.findBy({"users"}, {"id"}, 60) == 1, description, passCount, failCount);
+            checkWax( json.findBy({"users"}, {"id"}, 2) == 2 && json.findBy({"users"}, {"id"}, 9) == 10, description, passCount, failCount);
+            json.removeRange({"users"}, 8, 2);                          // 1 60 2 3 4 5 6 50 9
+            json.remove({"users",2});                                   // 1 60 3 4 5 6 50 9
+            checkWax( json.findBy({"users"}, {"id"}, 51) == -1 && json.findBy({"users"}, {"id"}, 8) == -1, description, passCount, failCount);
+            checkWax( json.findBy({"users"}, {"id"}, 2) == -1 && json.findBy({"users"}, {"id"}, 3) == 2, description, passCount, failCount);
+            checkWax( json.findBy({"users"}, {"id"}, 9) == 7 && json.findBy({"users"}, {"id"}, 1) == 0, description, passCount, failCount);
+            checkWax( json.findBy({"users"}, {"id"}, 50) == 6 && json.findBy({"users"}, {"id"}, 60) == 1, description, passCount, failCount);
+
+            json.setValue({"users",3,"id"}, 1e17);
+            json.setValue({"users",4,"id"}, qulonglong(18446744073709551615ULL));
+            description = "index: numbers are found when they're equal.";
+            checkWax( json.findBy({"users"}, {"id"}, qlonglong(100000000000000000)) == 3, description, passCount, failCount);
+            checkWax( json.findBy({"users"}, {"id"}, qlonglong(-1)) == -1, description, passCount, failCount);
+            checkWax( json.findBy({"users"}, {"id"}, 1.5) == -1 && json.findBy({"users"}, {"id"}, 3.0) == 2, description, passCount, failCount);
+        }
+
+        {
+            JsonWax json;
+            json.fromByteArray("{\"users\":[{\"id\":1},{\"id\":2}],\"data\":{\"list\":[{\"id\":3}]}}");
+            json.createIndex({"users"}, {"id"});
+            json.createIndex({"data","list"}, {"id"});
+            QString description = "index: forgets an array that a write below it replaced.";
+            checkWax( json.findBy({"users"}, {"id"}, 2) == 1 && json.findBy({"data","list"}, {"id"}, 3) == 0, description, passCount, failCount);
+            json.setValue({"users","name"}, "x");                       // "users" becomes an object.
+            json.setValue({"data",0}, 1);                               // "data" becomes an array.
+            checkWax( json.findBy({"users"}, {"id"}, 2) == -1 && json.findBy({"data","list"}, {"id"}, 3) == -1, description, passCount, failCount);
+            json.setValue({"users",0,"id"}, 2);
+            checkWax( json.findBy({"users"}, {"id"}, 2) == 0, description, passCount, failCount);
+        }
+
+        {
+            JsonWax json;
+            json.fromByteArray("{\"orders\":[{\"id\":1,\"items\":[{\"sku\":\"a\",\"qty\":5},{\"sku\":\"b\",\"qty\":12}]},"
+                               "{\"id\":2,\"items\":[{\"sku\":\"c\",\"qty\":20},{\"sku\":\"d\"}]}],"
+                               "\"numbers\":[1,2,3,4,5,6],\"store\":{\"book\":{\"sku\":\"e\"}}}");
+            QString description = "query: filters, wildcards and names.";
+            checkWax( json.queryValues("$.orders[*].items[?(@.qty>10)].sku") == QVariantList({"b","c"}), description, passCount, failCount);
+            checkWax( json.query("$.orders[1].items[?(@.qty >= 20 || @.sku == 'd')]") == QList<QVariantList>() << QVariantList({"orders",1,"items",0}) << QVariantList({"orders",1,"items",1}), description, passCount, failCount);
+            checkWax( json.queryValues("$.orders[?(@.id == 2)]..sku") == QVariantList({"c","d"}), description, passCount, failCount);
+            checkWax( json.queryValues("$['orders'][-1].id") == QVariantList({2}), description, passCount, failCount);
+
+            description = "query: recursive descent.";
+            checkWax( json.queryValues("$..sku") == QVariantList({"a","b","c","d","e"}), description, passCount, failCount);
+            checkWax( json.query("$.store..sku") == QList<QVariantList>() << QVariantList({"store","book","sku"}), description, passCount, failCount);
+
+            description = "query: slices, also of packed arrays.";
+            checkWax( json.queryValues("$.numbers[1:4]") == QVariantList({2,3,4}), description, passCount, failCount);
+            checkWax( json.queryValues("$.numbers[::-2]") == QVariantList({6,4,2}), description, passCount, failCount);
+            checkWax( json.queryValues("$.numbers[-2:]") == QVariantList({5,6}), description, passCount, failCount);
+            checkWax( json.queryValues("$.numbers[?(@ > 2 && @ < 5)]") == QVariantList({3,4}), description, passCount, failCount);
+
+            description = "query: a compiled path can be reused, an invalid path matches nothing.";
+            JsonWax::JsonPath path("$.orders[*].items[?(@.qty)].qty");
+            json.setValue({"orders",1,"items",1,"qty"}, 1);
+            checkWax( path.isValid() && json.queryValues( path) == QVariantList({5,12,20,1}), description, passCount, failCount);
+            JsonWax::JsonPath invalid("$.orders[?(@.id ==)]");
+            checkWax( !invalid.isValid() && invalid.keys( nullptr).isEmpty(), description, passCount, failCount);
+        }
+
+        {
+            JsonWax json;
+            json.fromByteArray("{\"b\":2,\"a\":{\"x\":[1,2,3]},\"c\":\"text\"}");
+            QString description = "children: iterates over the (key, node) pairs of an object.";
+            QStringList names;
+            for (auto child : json.children())
+                names << child.first.toString();
+            checkWax( names == QStringList({"a","b","c"}), description, passCount, failCount);
+            checkWax( json.children().size() == 3 && json.children({"c"}).size() == 0, description, passCount, failCount);
+
+            description = "children: nodes of packed and sparse arrays, and nested children.";
+            int sum = 0;
+            for (auto child : json.children({"a","x"}))
+                sum += child.first.toInt() * child.second.value().toInt();
+            checkWax( sum == 0*1 + 1*2 + 2*3, description, passCount, failCount);
+            JsonWax::Node a = (*json.children().begin()).second;
+            checkWax( a.isObject() && (*a.children().begin()).second.isArray(), description, passCount, failCount);
+            json.setValue({"sparse",1000}, "last");
+            int holes = 0;
+            json.forEach({"sparse"}, [&holes]( const QVariant& key, const JsonWax::Node& node)
+            {
+                if (node.value().isNull() && key.toInt() < 1000)
+                    ++holes;
+            });
+            checkWax( holes == 1000 && json.children({"sparse"}).size() == 1001, description, passCount, failCount);
+
+            description = "forEach: doesn't allocate.";
+            for (int i = 0; i < 100; ++i)
+                json.setValue({"numbers",QString::number(i)}, i);
+            json.size({"numbers"});                                         // Fills the lookup cache.
+            int before = ALLOCATION_COUNT.load();
+            sum = 0;
+            json.forEach({"numbers"}, [&sum]( const QVariant&, const JsonWax::Node& node){ sum += node.value().toInt(); });
+            for (auto child : json.children({"numbers"}))
+                sum += child.second.value().toInt();
+            checkWax( ALLOCATION_COUNT.load() == before && sum == 2 * 4950, description, passCount, failCount);
+        }
+
+        {
+            JsonWax json;
+            for (int i = 0; i < 20; ++i)
+            {
+                json.setValue({"groups",i,"name"}, QString::fromUtf8("gr\u00f8up ") + QString::number(i));
+                json.setValue({"groups",i,"values",0}, i);
+                json.setValue({"groups",i,"values",1}, i + 1);
+            }
+            QString description = "fragments: serializing twice gives the same text.";
+            QString readable = json.toString( JsonWax::Readable);
+            QString compact = json.toString( JsonWax::Compact);
+            checkWax( json.toString( JsonWax::Readable) == readable && json.toString( JsonWax::Compact) == compact, description, passCount, failCount);
+
+            description = "fragments: changes are serialized.";
+            json.setValue({"groups",3,"name"}, "changed");
+            json.append({"groups",7,"values"}, 99);
+            json.remove({"groups",11});
+            JsonWax fresh;
+            fresh.fromByteArray( json.toString( JsonWax::Compact).toUtf8());
+            checkWax( json.toString( JsonWax::Compact) == fresh.toString( JsonWax::Compact), description, passCount, failCount);
+            checkWax( json.toString( JsonWax::Readable) == fresh.toString( JsonWax::Readable), description, passCount, failCount);
+            checkWax( json.value({"groups",7,"values",2}) == 99 && json.toString( JsonWax::Compact).contains("\"changed\""), description, passCount, failCount);
+
+            description = "fragments: indentation and code points of subtrees.";
+            checkWax( json.toString( JsonWax::Readable, false, {"groups",2}) == fresh.toString( JsonWax::Readable, false, {"groups",2}), description, passCount, failCount);
+            checkWax( json.toString( JsonWax::Compact, true) == fresh.toString( JsonWax::Compact, true), description, passCount, failCount);
+            checkWax( json.toString( JsonWax::Compact) == fresh.toString( JsonWax::Compact), description, passCount, failCount);
+
+            description = "fragments: changes after a snapshot and a copy.";
+            JsonWax::Snapshot snapshot = json.snapshot();
+            json.copy({"groups",0}, {"copy"});
+            json.setValue({"groups",0,"name"}, "first");
+            json.setValue({"groups",5,"values",0}, -5);
+            fresh.fromByteArray( json.toString( JsonWax::Compact).toUtf8());
+            checkWax( json.toString( JsonWax::Readable) == fresh.toString( JsonWax::Readable), description, passCount, failCount);
+            checkWax( json.value({"copy","name"}) == QString::fromUtf8("gr\u00f8up 0") && snapshot.value({"groups",5,"values",0}) == 5, description, passCount, failCount);
+        }
+
+        {
+            JsonWax source;
+            source.fromByteArray("{\"list\":[1,2,3,4],\"users\":[{\"id\":1},{\"id\":2}],\"a/b\":{\"c~d\":true},\"name\":\"x\"}");
+            JsonWax target;
+            source.copy({}, target, {});
+            target.insertRange({"list"}, 2, {99});
+            target.setValue({"users",1,"id"}, 20);
+            target.remove({"a/b","c~d"});
+            target.setValue({"extra"}, 3.5);
+
+            JsonWax::Patch patch = source.diff( target);
+            QString description = "diff: finds the changes.";
+            checkWax( patch.toString() == "[{\"op\":\"remove\",\"path\":\"/a~1b/c~0d\"},{\"op\":\"add\",\"path\":\"/extra\",\"value\":3.5},"
+                                         "{\"op\":\"add\",\"path\":\"/list/2\",\"value\":99},{\"op\":\"replace\",\"path\":\"/users/1/id\",\"value\":20}]",
+                      description, passCount, failCount);
+
+            description = "applyPatch: gives the same document.";
+            checkWax( source.applyPatch( patch) && source.toString( JsonWax::Compact) == target.toString( JsonWax::Compact), description, passCount, failCount);
+            checkWax( source.diff( target).isEmpty(), description, passCount, failCount);
+
+            description = "applyPatch: reads RFC 6902 documents.";
+            checkWax( source.applyPatch( QByteArray("[{\"op\":\"move\",\"from\":\"/list/0\",\"path\":\"/list/-\"},"
+                                                    "{\"op\":\"copy\",\"from\":\"/users/0\",\"path\":\"/first\"},"
+                                                    "{\"op\":\"test\",\"path\":\"/first\",\"value\":{\"id\":1.0}}]")), description, passCount, failCount);
+            checkWax( source.toString( JsonWax::Compact, false, {"list"}) == "[2,99,3,4,1]" && source.value({"first","id"}) == 1, description, passCount, failCount);
+
+            description = "applyPatch: changes nothing if an operation fails.";
+            QString before = source.toString( JsonWax::Compact);
+            checkWax( !source.applyPatch( QByteArray("[{\"op\":\"remove\",\"path\":\"/name\"},{\"op\":\"test\",\"path\":\"/extra\",\"value\":1}]")), description, passCount, failCount);
+            checkWax( !source.applyPatch( QByteArray("[{\"op\":\"add\",\"path\":\"/list/7\",\"value\":1}]")), description, passCount, failCount);
+            checkWax( !source.applyPatch( QByteArray("{\"op\":\"add\"}")) && source.toString( JsonWax::Compact) == before, description, passCount, failCount);
+
+            description = "diff: different roots, and recorded patches.";
+            JsonWax array;
+            array.setValue({0}, "first");
+            patch = source.diff( array);
+            checkWax( patch.size() == 1 && source.applyPatch( patch) && source.toString( JsonWax::Compact) == "[\"first\"]", description, passCount, failCount);
+            patch.clear();
+            patch.add({1}, "second");
+            patch.replace({0}, 0);
+            patch.test({1}, "second");
+            checkWax( source.applyPatch( patch) && source.toString( JsonWax::Compact) == "[0,\"second\"]", description, passCount, failCount);
+        }
+
+        {
+            JsonWax json;
+            json.fromByteArray("{\"order\":{\"id\":3,\"lines\":[{\"sku\":\"a\",\"qty\":1},{\"sku\":\"b\",\"qty\":2}]},\"tags\":[1,2,3]}");
+            QString description = "hash: stable, and restored when a change is undone.";
+            quint64 hash = json.hash();
+            quint64 linesHash = json.hash({"order","lines"});
+            checkWax( hash != 0 && json.hash() == hash && json.hash({"missing"}) == 0, description, passCount, failCount);
+            json.setValue({"order","lines",1,"qty"}, 5);
+            checkWax( json.hash() != hash && json.hash({"order","lines"}) != linesHash && json.hash({"order","lines",0}) != 0, description, passCount, failCount);
+            json.setValue({"order","lines",1,"qty"}, 2);
+            checkWax( json.hash() == hash && json.hash({"order","lines"}) == linesHash, description, passCount, failCount);
+
+            description = "equals: numbers are compared by value.";
+            JsonWax other;
+            other.fromByteArray("{\"tags\":[1,2,3.0],\"order\":{\"lines\":[{\"qty\":1,\"sku\":\"a\"},{\"qty\":2.0,\"sku\":\"b\"}],\"id\":3}}");
+            checkWax( json.equals( other) && json.hash() == other.hash(), description, passCount, failCount);
+
+            description = "equals: differences are found.";
+            other.setValue({"tags",2}, "3");
+            checkWax( !json.equals( other) && json.equals({"order"}, other, {"order"}), description, passCount, failCount);
+            checkWax( json.equals({"tags",1}, other, {"tags",1}) && !json.equals({"tags",1}, json, {"tags",2}), description, passCount, failCount);
+
+            description = "equals: large integers, and doubles, are compared exactly.";
+            JsonWax numbers;
+            numbers.setValue({"ulonglongMax"}, qulonglong(18446744073709551615ULL));
+            numbers.setValue({"minusOne"}, qlonglong(-1));
+            numbers.setValue({"twoPow53Plus1"}, qlonglong(9007199254740993LL));
+            numbers.setValue({"twoPow53"}, qlonglong(9007199254740992LL));
+            numbers.setValue({"twoPow53Double"}, 9007199254740992.0);
+            numbers.setValue({"1e19"}, qulonglong(10000000000000000000ULL));
+            numbers.setValue({"1e19Double"}, 1e19);
+            numbers.setValue({"five"}, qulonglong(5));
+            numbers.setValue({"fiveInt"}, 5);
+            checkWax( !numbers.equals({"ulonglongMax"}, numbers, {"minusOne"}) && numbers.hash({"ulonglongMax"}) != numbers.hash({"minusOne"}), description, passCount, failCount);
+            checkWax( !numbers.equals({"twoPow53Plus1"}, numbers, {"twoPow53Double"}) && numbers.hash({"twoPow53Plus1"}) != numbers.hash({"twoPow53Double"}), description, passCount, failCount);
+            checkWax( numbers.equals({"twoPow53"}, numbers, {"twoPow53Double"}) && numbers.hash({"twoPow53"}) == numbers.hash({"twoPow53Double"}), description, passCount, failCount);
+            checkWax( numbers.equals({"1e19"}, numbers, {"1e19Double"}) && numbers.hash({"1e19"}) == numbers.hash({"1e19Double"}), description, passCount, failCount);
+            checkWax( numbers.equals({"five"}, numbers, {"fiveInt"}) && numbers.hash({"five"}) == numbers.hash({"fiveInt"}), description, passCount, failCount);
+
+            description = "equals: floats are numbers.";
+            numbers.setValue({"float"}, 1.5f);
+            numbers.setValue({"double"}, 1.5);
+            numbers.setValue({"floatTenth"}, 0.1f);
+            numbers.setValue({"doubleTenth"}, 0.1);
+            checkWax( numbers.equals({"float"}, numbers, {"double"}) && numbers.hash({"float"}) == numbers.hash({"double"}), description, passCount, failCount);
+            checkWax( !numbers.equals({"floatTenth"}, numbers, {"doubleTenth"}) && numbers.hash({"floatTenth"}) != numbers.hash({"doubleTenth"}), description, passCount, failCount);
+
+            description = "equals: copies, and changes deep in a copy.";
+            JsonWax copy;
+            json.copy({}, copy, {});
+            checkWax( json.equals( copy) && copy.hash() == hash, description, passCount, failCount);
+            copy.append({"order","lines",0,"notes"}, "x");
+            checkWax( !json.equals( copy) && copy.hash() != hash && json.hash() == hash, description, passCount, failCount);
+        }
+
+        {
+            QString fileName = QDir::tempPath() + "/jsonwax_journal_test.json";
+            QFile::remove( fileName + ".journal");
+            JsonWax json;
+            for (int i = 0; i < 100; ++i)
+                json.setValue({"list",i}, i);
+            json.setValue({"name"}, "first");
+            json.saveAs( fileName);
+            json.setJournaled( true);
+            QString description = "journal: save() appends the changes.";
+            checkWax( json.loadFile( fileName) && !QFile::exists( fileName + ".journal"), description, passCount, failCount);
+            qint64 fileSize = QFile( fileName).size();
+            json.setValue({"name"}, "second");
+            json.append({"list"}, 100);
+            checkWax( json.save() && QFile( fileName + ".journal").size() > 0 && QFile( fileName).size() == fileSize, description, passCount, failCount);
+            json.remove({"list",0});
+            json.setValue({"extra","nested"}, true);
+            checkWax( json.save() && json.save() && QFile( fileName).size() == fileSize, description, passCount, failCount);
+
+            description = "journal: loadFile() applies the changes.";
+            JsonWax loaded( fileName);
+            checkWax( loaded.equals( json) && loaded.value({"name"}) == "second" && loaded.size({"list"}) == 100, description, passCount, failCount);
+
+            description = "journal: an incomplete last change is dropped.";
+            qint64 journalSize = QFile( fileName + ".journal").size();
+            QFile journal( fileName + ".journal");
+            journal.open( QIODevice::Append);
+            journal.write("[{\"op\":\"remove\",\"pa");
+            journal.close();
+            loaded.loadFile( fileName);
+            checkWax( loaded.equals( json) && QFile( fileName + ".journal").size() == journalSize, description, passCount, failCount);
+
+            description = "journal: compactJournal() writes the whole file.";
+            checkWax( json.compactJournal( JsonWax::Compact) && !QFile::exists( fileName + ".journal"), description, passCount, failCount);
+            json.setValue({"name"}, "third");
+            json.save();
+            loaded.loadFile( fileName);
+            checkWax( loaded.equals( json) && loaded.value({"name"}) == "third", description, passCount, failCount);
+
+            description = "journal: a journal that belongs to another version of the file is moved aside.";
+            json.setJournaled( false);
+            json.setValue({"name"}, "fourth");
+            QFile::copy( fileName + ".journal", fileName + ".old");
+            json.save();
+            QFile::rename( fileName + ".old", fileName + ".journal");
+            loaded.loadFile( fileName);
+            checkWax( loaded.equals( json) && !QFile::exists( fileName + ".journal"), description, passCount, failCount);
+            checkWax( QFile::exists( fileName + ".journal.rejected"), description, passCount, failCount);
+            QFile::remove( fileName + ".journal.rejected");
+
+            description = "journal: a change that can't be applied moves the journal aside.";
+            json.setJournaled( true);
+            json.save();
+            json.setValue({"name"}, "fifth");
+            json.save();
+            journal.open( QIODevice::Append);
+            journal.write("[{\"op\":\"remove\",\"path\":\"/missing\"}]\n");
+            journal.close();
+            checkWax( loaded.loadFile( fileName) && loaded.equals( json), description, passCount, failCount);
+            checkWax( !QFile::exists( fileName + ".journal") && QFile::exists( fileName + ".journal.rejected"), description, passCount, failCount);
+            loaded.setJournaled( true);
+            loaded.setValue({"name"}, "sixth");
+            checkWax( loaded.save() && json.loadFile( fileName) && json.value({"name"}) == "sixth", description, passCount, failCount);
+            QFile::remove( fileName + ".journal.rejected");
+
+            description = "journal: values that change type in text still find their file.";
+            json.setValue({"char"}, QChar('x'));
+            json.setValue({"float"}, 1.25f);
+            json.setValue({"bytes"}, QByteArray("bytes"));
+            json.setValue({"surrogate"}, QString( QChar( 0xD800)));
+            json.saveAs( fileName);
+            json.setValue({"name"}, "seventh");
+            checkWax( json.save() && QFile::exists( fileName + ".journal"), description, passCount, failCount);
+            checkWax( loaded.loadFile( fileName) && loaded.value({"name"}) == "seventh", description, passCount, failCount);
+            QFile::remove( fileName + ".journal");
+            QFile::remove( fileName);
+        }
+
+        {
+            QString fileName = QDir::tempPath() + "/jsonwax_compaction_test.json";
+            QString expected;
+            qint64 fileSize;
+            {
+                JsonWax json;
+                json.setValue({"name"}, "first");
+                json.saveAs( fileName);
+                fileSize = QFile( fileName).size();
+                json.setJournaled( true);
+                json.loadFile( fileName);
+
+                for (int i = 0; i < 50; ++i)
+                {
+                    json.setValue({"name"}, QString("name ") + QString::number(i));
+                    json.save();
+                }
+                expected = json.toString();
+            }                                                           // Waits for the compaction.
+            QString description = "journal: a journal that outgrows its file is folded into it.";
+            JsonWax loaded;
+            checkWax( loaded.loadFile( fileName) && loaded.toString() == expected, description, passCount, failCount);
+            checkWax( QFile( fileName).size() > fileSize && !QFile::exists( fileName + ".journal.rejected"), description, passCount, failCount);
+            QFile::remove( fileName + ".journal");
+            QFile::remove( fileName);
+        }
+
+        {
+            QString fileName = QDir::tempPath() + "/jsonwax_pending_journal_test.json";
+            JsonWax json;
+            json.setValue({"padding"}, QString( 1000, 'x'));             // So the journals don't outgrow the file.
+            json.setValue({"name"}, "first");
+            json.saveAs( fileName);
+            json.setJournaled( true);
+            json.loadFile( fileName);
+            json.setValue({"name"}, "second");
+            json.save();
+            QFile::rename( fileName + ".journal", fileName + ".old");   // The journal a compaction started from,
+            json.saveAs( fileName);                                     // the file it wrote,
+            json.setValue({"name"}, "third");
+            json.save();                                                // and the journal it wrote for that file,
+            QFile::rename( fileName + ".journal", fileName + ".journal.pending");
+            QFile::rename( fileName + ".old", fileName + ".journal");   // before the journals were swapped.
+            QString description = "journal: the journal of an interrupted compaction is used.";
+            JsonWax loaded;
+            checkWax( loaded.loadFile( fileName) && loaded.value({"name"}) == "third", description, passCount, failCount);
+            checkWax( QFile::exists( fileName + ".journal") && !QFile::exists( fileName + ".journal.pending")
+                      && !QFile::exists( fileName + ".journal.rejected"), description, passCount, failCount);
+
+            description = "journal: a pending journal for another version of the file is removed.";
+            QFile pending( fileName + ".journal.pending");
+            pending.open( QIODevice::WriteOnly);
+            pending.write("{\"base\":\"0\"}\n[{\"op\":\"replace\",\"path\":\"/name\",\"value\":\"wrong\"}]\n");
+            pending.close();
+            checkWax( loaded.loadFile( fileName) && loaded.value({"name"}) == "third" && !pending.exists(), description, passCount, failCount);
+            QFile::remove( fileName + ".journal");
+            QFile::remove( fileName);
+        }
+
+        {
+            QString fileName = QDir::tempPath() + "/jsonwax_binary_test.jwb";
+            JsonWax json;
+            json.fromByteArray("{\"name\":\"gr\u00f8d \\\"x\\\"\",\"ints\":[1,2,3],\"doubles\":[0.1,2.5,-1e300],\"bools\":[true,false],"
+                               "\"mixed\":[1,\"a\",null,{\"name\":\"a\"},[]],\"empty\":{},\"big\":9007199254740993}");
+            json.setValue({"sparse",5000}, "last");
+            json.setValue({"uint"}, 4000000000u);
+            QString description = "binary: saveBinary() and loadBinary() give the same document.";
+            JsonWax loaded;
+            checkWax( json.saveBinary( fileName) && loaded.loadBinary( fileName), description, passCount, failCount);
+            checkWax( loaded.equals( json) && loaded.toString( JsonWax::Compact) == json.toString( JsonWax::Compact), description, passCount, failCount);
+            checkWax( loaded.value({"big"}) == qlonglong(9007199254740993LL) && loaded.value({"doubles",0}).toDouble() == 0.1, description, passCount, failCount);
+            checkWax( loaded.memoryUsage({"ints"}) <= json.memoryUsage({"ints"}) && loaded.size({"sparse"}) == 5001, description, passCount, failCount);
+
+            description = "binary: invalid files aren't loaded.";
+            QFile file( fileName);
+            file.open( QIODevice::ReadOnly);
+            QByteArray bytes = file.readAll();
+            file.close();
+            file.open( QIODevice::WriteOnly);
+            file.write( bytes.left( bytes.size() - 3));
+            file.close();
+            checkWax( !loaded.loadBinary( fileName) && loaded.equals( json), description, passCount, failCount);
+            file.open( QIODevice::WriteOnly);
+            file.write( "{\"a\":1}");
+            file.close();
+            checkWax( !loaded.loadBinary( fileName) && !loaded.loadBinary( fileName + ".missing") && loaded.equals( json), description, passCount, failCount);
+
+            description = "binary: too deeply nested files aren't loaded.";
+            JsonWax empty;
+            empty.fromByteArray("[]");
+            empty.saveBinary( fileName);
+            file.open( QIODevice::ReadOnly);
+            bytes = file.readAll();                                     // The header, and an array tag with a count of 0.
+            file.close();
+            QByteArray level = bytes.right(5);
+            level[1] = 1;
+            file.open( QIODevice::WriteOnly);
+            file.write( bytes.left( bytes.size() - 5) + level.repeated( 100000) + bytes.right(5));
+            file.close();
+            checkWax( !loaded.loadBinary( fileName) && loaded.equals( json), description, passCount, failCount);
+            file.open( QIODevice::WriteOnly);
+            file.write( bytes.left( bytes.size() - 5) + level.repeated( 500) + bytes.right(5));
+            file.close();
+            checkWax( loaded.loadBinary( fileName) && loaded.size({0,0,0}) == 1, description, passCount, failCount);
+            QFile::remove( fileName);
+        }
+
+        {
+            JsonWax json;
+            json.fromByteArray("{\"a\":[1,-1,1.5,\"x\",true,null]}");
+            QString description = "CBOR and MessagePack: the encodings are as specified.";
+            checkWax( json.toCbor().toHex() == "a16161860120fb3ff80000000000006178f5f6" && json.toMessagePack().toHex() == "81a1619601ffcb3ff8000000000000a178c3c0",
+                      description, passCount, failCount);
+            checkWax( json.toCbor({"a",2}).toHex() == "fb3ff8000000000000" && json.toMessagePack({"a",0}).toHex() == "01", description, passCount, failCount);
+
+            description = "CBOR and MessagePack: values keep their types.";
+            json.setValue({"bytes"}, QByteArray("\x00\xff", 2));
+            json.setValue({"large"}, qlonglong(-5000000000LL));
+            json.setValue({"unsigned"}, qulonglong(18446744073709551615ULL));
+            json.setValue({"text"}, QString::fromUtf8("gr\u00f8d"));
+            for (int i = 0; i < 300; ++i)
+                json.setValue({"numbers",i}, i * 1000);
+            JsonWax decoded;
+            checkWax( decoded.fromCbor( json.toCbor()) && decoded.equals( json) && decoded.value({"bytes"}) == QByteArray("\x00\xff", 2), description, passCount, failCount);
+            checkWax( decoded.value({"unsigned"}).type() == QVariant::ULongLong && decoded.value({"large"}).type() == QVariant::LongLong, description, passCount, failCount);
+            decoded.clear();
+            checkWax( decoded.fromMessagePack( json.toMessagePack()) && decoded.equals( json) && decoded.value({"numbers",299}) == 299000, description, passCount, failCount);
+            checkWax( decoded.value({"bytes"}).type() == QVariant::ByteArray && decoded.memoryUsage({"numbers"}) < 300 * 16, description, passCount, failCount);
+
+            description = "CBOR: indefinite lengths, half floats, tags and integer keys.";
+            checkWax( decoded.fromCbor( QByteArray::fromHex("bf6161f93c00617382c11a514b67b00a01f6ff")), description, passCount, failCount);
+            checkWax( decoded.toString( JsonWax::Compact) == "{\"1\":null,\"a\":1,\"s\":[1363896240,10]}", description, passCount, failCount);
+
+            description = "CBOR and MessagePack: invalid documents change nothing.";
+            QString before = decoded.toString( JsonWax::Compact);
+            QByteArray cbor = json.toCbor();
+            checkWax( !decoded.fromCbor( cbor.left( cbor.size() - 1)) && !decoded.fromCbor( cbor + char(0)) && !decoded.fromCbor( QByteArray::fromHex("01")), description, passCount, failCount);
+            checkWax( !decoded.fromMessagePack( QByteArray::fromHex("92c1")) && !decoded.fromCbor( QByteArray( 2000, char(0x81))), description, passCount, failCount);
+            checkWax( decoded.toString( JsonWax::Compact) == before, description, passCount, failCount);
+        }
+
+        {
+            QString fileName = QDir::tempPath() + "/jsonwax_compressed_test.json.gz";
+            JsonWax json;
+            for (int i = 0; i < 1000; ++i)
+                json.setValue({"records",i,"name"}, QString::fromUtf8("r\u00f8w ") + QString::number(i));
+#ifdef JSONWAX_ZLIB
+            QString description = "compression: gzip and zlib files are written and read.";
+            JsonWax loaded;
+            checkWax( json.saveAs( fileName, JsonWax::Readable, false, true, JsonWax::Gzip) && loaded.loadFile( fileName) && loaded.equals( json), description, passCount, failCount);
+            QFile file( fileName);
+            file.open( QIODevice::ReadOnly);
+            QByteArray compressed = file.readAll();
+            file.close();
+            checkWax( compressed.startsWith("\x1f\x8b") && compressed.size() * 4 < json.toString( JsonWax::Readable).toUtf8().size(), description, passCount, failCount);
+            checkWax( json.saveAs( fileName, JsonWax::Compact, false, true, JsonWax::Zlib) && loaded.loadFile( fileName) && loaded.equals( json), description, passCount, failCount);
+
+            description = "compression: save() keeps the compression of the file.";
+            loaded.setValue({"records",0,"name"}, "changed");
+            checkWax( loaded.save() && json.loadFile( fileName) && json.value({"records",0,"name"}) == "changed", description, passCount, failCount);
+            file.open( QIODevice::ReadOnly);
+            checkWax( JsonWaxInternals::compressionOf( file.read(2)) == JsonWax::Zlib, description, passCount, failCount);
+            file.close();
+
+            description = "compression: damaged files aren't loaded.";
+            file.open( QIODevice::WriteOnly);
+            file.write( compressed.left( compressed.size() / 2));
+            file.close();
+            checkWax( !loaded.loadFile( fileName) && loaded.value({"records",0,"name"}) == "changed", description, passCount, failCount);
+#else
+            QString description = "compression: refused without JSONWAX_ZLIB.";
+            checkWax( !json.saveAs( fileName, JsonWax::Readable, false, true, JsonWax::Gzip) && !QFile::exists( fileName), description, passCount, failCount);
+#endif
+            QFile::remove( fileName);
+        }
+
+        {
+            QString fileName = QDir::tempPath() + "/jsonwax_chunks_test.json";
+            JsonWax json;
+            for (int i = 0; i < 5000; ++i)
+                json.setValue({"records",i}, QString::fromUtf8("r\u00f8w \"") + QString::number(i) + "\\\u00e6");
+            json.setValue({"long"}, QString( 200000, 'x') + "\n\"");
+            QString description = "loadFile: the file is parsed in chunks, also values that span them.";
+            JsonWax loaded;
+            checkWax( json.saveAs( fileName, JsonWax::Compact) && QFile( fileName).size() > 4 * 65536, description, passCount, failCount);
+            checkWax( loaded.loadFile( fileName) && loaded.equals( json), description, passCount, failCount);
+
+            description = "loadFile: a byte order mark is skipped.";
+            QFile file( fileName);
+            file.open( QIODevice::WriteOnly);
+            file.write("\xEF\xBB\xBF[1]");
+            file.close();
+            checkWax( loaded.loadFile( fileName) && loaded.toString( JsonWax::Compact) == "[1]", description, passCount, failCount);
+
+            description = "loadFile: errors are at their position in the file.";
+            QByteArray invalid = "[" + QByteArray( 100000, ' ') + "x]";
+            file.open( QIODevice::WriteOnly);
+            file.write( invalid);
+            file.close();
+            json.fromByteArray( invalid);
+            checkWax( !loaded.loadFile( fileName) && loaded.errorPos() == json.errorPos() && json.errorPos() > 100000, description, passCount, failCount);
+            QFile::remove( fileName);
+        }
+
+        {
+            JsonWax json;
+            json.fromByteArray("{\"a\":[1,{},[],\"x\\\"y\"],\"b\":{},\"c\":[],\"d\":null}");
+            QString description = "write: the same text as toString(), for both styles.";
+            QBuffer buffer;
+            buffer.open( QIODevice::WriteOnly);
+            checkWax( json.write( &buffer, JsonWax::Readable) && buffer.data() == json.toString( JsonWax::Readable).toUtf8(), description, passCount, failCount);
+            buffer.close();
+            buffer.setData( QByteArray());
+            buffer.open( QIODevice::WriteOnly);
+            checkWax( json.write( &buffer, JsonWax::Compact, false, {"a"}) && buffer.data() == json.toString( JsonWax::Compact, false, {"a"}).toUtf8(), description, passCount, failCount);
+            buffer.close();
+
+            description = "write: documents larger than a chunk, with cached parts.";
+            for (int i = 0; i < 5000; ++i)
+            {
+                json.setValue({"records",i,"name"}, QString::fromUtf8("r\u00f8w ") + QString::number(i));
+                json.setValue({"records",i,"values",0}, i * 0.5);
+            }
+            json.toString( JsonWax::Readable);
+            json.setValue({"records",10,"name"}, "changed");
+            buffer.setData( QByteArray());
+            buffer.open( QIODevice::WriteOnly);
+            checkWax( json.write( &buffer, JsonWax::Readable), description, passCount, failCount);
+            buffer.close();
+            checkWax( buffer.data().size() > 64 * 1024 && buffer.data() == json.toString( JsonWax::Readable).toUtf8(), description, passCount, failCount);
+
+            description = "write: fails for missing keys and closed devices.";
+            checkWax( !json.write( &buffer) && !json.write( &buffer, JsonWax::Compact, false, {"missing"}), description, passCount, failCount);
+
+            description = "saveAs: replaces the file only when allowed.";
+            QString fileName = QDir::tempPath() + "/jsonwax_write_test.json";
+            JsonWax loaded;
+            checkWax( json.saveAs( fileName) && loaded.loadFile( fileName) && loaded.equals( json), description, passCount, failCount);
+            json.setValue({"records",0,"name"}, "again");
+            checkWax( !json.saveAs( fileName, JsonWax::Readable, false, false) && loaded.loadFile( fileName) && loaded.value({"records",0,"name"}) != "again", description, passCount, failCount);
+            QFile::remove( fileName);
+        }
+
+        {
+            QString fileName = QDir::tempPath() + "/jsonwax_async_test.json";
+            JsonWax json;
+            for (int i = 0; i < 2000; ++i)
+                json.setValue({"records",i,"name"}, QString("name ") + QString::number(i));
+            QString expected = json.toString( JsonWax::Readable);
+            QString description = "saveAsync: saves the document as it was when called.";
+            QFuture<bool> future = json.saveAsync( fileName);
+            json.setValue({"records",0,"name"}, "changed");
+            json.remove({"records",1});
+            future.waitForFinished();
+            JsonWax loaded;
+            checkWax( future.result() && loaded.loadFile( fileName) && loaded.toString( JsonWax::Readable) == expected, description, passCount, failCount);
+            checkWax( json.value({"records",0,"name"}) == "changed", description, passCount, failCount);
+
+            description = "saveAsync: a journaled save() afterwards writes the whole file.";
+            loaded.setJournaled( true);
+            loaded.setValue({"records",0,"name"}, "first");
+            checkWax( loaded.save(), description, passCount, failCount);
+            future = loaded.saveAsync( fileName);
+            loaded.setValue({"records",0,"name"}, "second");
+            future.waitForFinished();
+            checkWax( future.result() && loaded.save() && !QFile::exists( fileName + ".journal"), description, passCount, failCount);
+            checkWax( json.loadFile( fileName) && json.value({"records",0,"name"}) == "second", description, passCount, failCount);
+
+            description = "saveAsync: reports failure.";
+            future = json.saveAsync( QDir::tempPath() + "/jsonwax_missing_folder/file.json");
+            checkWax( !future.result(), description, passCount, failCount);
+            QFile::remove( fileName);
+        }
+
+        {
+            JsonWax json;
+            json.fromByteArray("{\"b\":[1,[],{}],\"a\":{\"x\":\"\\u00f8\\n\"},\"c\":{}}");
+            QString description = "toByteArray: the same text as toString(), as UTF-8.";
+            QByteArray expected = "{\n    \"a\": {\n        \"x\": \"\xc3\xb8\\n\"\n    },\n    \"b\": [\n        1,\n        [\n        ],\n        {\n\n        }\n    ],\n    \"c\": {\n\n    }\n}";
+            checkWax( json.toByteArray() == expected && json.toString().toUtf8() == expected, description, passCount, failCount);
+            checkWax( json.toByteArray( JsonWax::Compact) == "{\"a\":{\"x\":\"\xc3\xb8\\n\"},\"b\":[1,[],{}],\"c\":{}}", description, passCount, failCount);
+            checkWax( json.toByteArray( JsonWax::Compact, true) == "{\"a\":{\"x\":\"\\u00f8\\n\"},\"b\":[1,[],{}],\"c\":{}}"
+                      && json.toByteArray( JsonWax::Compact, false, {"b",0}) == "1", description, passCount, failCount);
+
+            description = "toByteArray: cached parts and later changes.";
+            for (int i = 0; i < 100; ++i)
+                json.setValue({"list",i}, i);                           // Packed.
+            json.setValue({"sparse",50}, "x");
+            QByteArray first = json.toByteArray( JsonWax::Compact);
+            json.setValue({"a","y"}, 2);
+            QByteArray second = json.toByteArray( JsonWax::Compact);
+            JsonWax copy;
+            copy.fromByteArray( second);
+            checkWax( first != second && second == copy.toByteArray( JsonWax::Compact) && json.toByteArray( JsonWax::Compact) == second, description, passCount, failCount);
+            checkWax( json.toByteArray( JsonWax::Readable) == copy.toString( JsonWax::Readable).toUtf8(), description, passCount, failCount);
+        }
+
+        {
+            JsonWax json;
+            QString text = QString::fromUtf8("a\"b\\c\b\f\n\r\t\x01\x7f/\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80");
+            json.setValue({"s"}, text);
+            QString description = "escaping: special characters, with and without code points.";
+            checkWax( json.toByteArray( JsonWax::Compact, false, {"s"}) == "\"a\\\"b\\\\c\\b\\f\\n\\r\\t\x01\x7f/\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80\"", description, passCount, failCount);
+            checkWax( json.toByteArray( JsonWax::Compact, true, {"s"}) == "\"a\\\"b\\\\c\\b\\f\\n\\r\\t\\u0001\\u007f/\\u00e9\\u20ac\\ud83d\\ude00\"", description, passCount, failCount);
+            checkWax( json.toString( JsonWax::Compact, false).toUtf8() == json.toByteArray( JsonWax::Compact, false), description, passCount, failCount);
+
+            description = "escaping: surrogates without their other half become '?'.";
+            json.setValue({"s"}, QString("x") + QChar(0xd800) + QString("y") + QChar(0xdc00));
+            checkWax( json.toByteArray( JsonWax::Compact, false, {"s"}) == "\"x?y?\"" && json.toByteArray( JsonWax::Compact, true, {"s"}) == "\"x\\ud800y\\udc00\"", description, passCount, failCount);
+
+            description = "escaping: at every position in long strings.";
+            bool isEscaped = true;
+            for (int i = 0; i < 40; ++i)
+            {
+                QString plain( 40, QChar('a'));
+                json.setValue({"s"}, QString( plain).replace( i, 1, QChar('\"')));
+                QByteArray expected = "\"" + QByteArray( 40, 'a').replace( i, 1, "\\\"") + "\"";
+                json.setValue({"t"}, QString( plain).replace( i, 1, QChar(0xe9)));
+                QByteArray expected2 = "\"" + QByteArray( 40, 'a').replace( i, 1, "\\u00e9") + "\"";
+                isEscaped = isEscaped && json.toByteArray( JsonWax::Compact, false, {"s"}) == expected && json.toByteArray( JsonWax::Compact, true, {"t"}) == expected2;
+            }
+            checkWax( isEscaped, description, passCount, failCount);
+        }
+
+        {
+            JsonWax json;
+            json.setValue({"a"}, 0.1);
+            json.setValue({"b"}, 1e23);
+            json.setValue({"c"}, 5e-324);
+            json.setValue({"d"}, -1.7976931348623157e308);
+            json.setValue({"e"}, -0.0);
+            json.setValue({"f"}, qlonglong(-9223372036854775807LL - 1));
+            json.setValue({"g"}, qulonglong(18446744073709551615ULL));
+            json.setValue({"j"}, 123456789012345680.0);
+            json.setValue({"k"}, 1.5f);
+            QString description = "numbers: the fewest digits.";
+            checkWax( json.toByteArray( JsonWax::Compact) == "{\"a\":0.1,\"b\":1e+23,\"c\":5e-324,\"d\":-1.7976931348623157e+308,\"e\":-0,"
+                      "\"f\":-9223372036854775808,\"g\":18446744073709551615,\"j\":123456789012345680,\"k\":1.5}", description, passCount, failCount);
+
+            description = "numbers: floats get the fewest digits for a float.";
+            JsonWax floats;
+            floats.setValue({"a"}, 0.1f);
+            floats.setValue({"b"}, -3.4028235e38f);
+            floats.setValue({"c"}, 1e-45f);
+            floats.setValue({"d"}, 16777216.0f);
+            checkWax( floats.toByteArray( JsonWax::Compact) == "{\"a\":0.1,\"b\":-3.4028235e+38,\"c\":1e-45,\"d\":16777216}", description, passCount, failCount);
+
+            description = "numbers: doubles read back exactly.";
+            quint64 state = 12345;
+            QVector<double> numbers;
+            for (int i = 0; i < 20000; ++i)
+            {
+                state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+                quint64 bits = state ^ (state >> 29);
+                double number;
+                memcpy( &number, &bits, sizeof(number));
+
+                if (i % 2 == 1)
+                    number = double( qint64( state >> 20)) / double( 1ULL << (state % 40));
+                if (!std::isnan( number) && !std::isinf( number))
+                    numbers.append( number);
+            }
+            for (int i = 0; i < numbers.size(); ++i)
+                json.setValue({"list",i}, numbers.at(i));
+            JsonWax loaded;
+            loaded.fromByteArray( json.toByteArray( JsonWax::Compact));
+            bool isExact = (loaded.size({"list"}) == numbers.size());
+            for (int i = 0; i < numbers.size() && isExact; ++i)
+                isExact = (loaded.value({"list",i}).toDouble() == numbers.at(i));
+            checkWax( isExact, description, passCount, failCount);
+
+            description = "numbers: doubles are written like QVariant::toString().";
+            numbers << 1e5 << 1e6 << 1e-4 << 1e-5 << 1234567.0 << 12345678901.5 << 1e21 << 1.5e100 << 1.5e101 << 2.5e-300 << -9e8 << -0.0;
+            bool isSame = true;
+            for (int i = 0; i < numbers.size() && isSame; ++i)
+            {
+                json.setValue({"n"}, numbers.at(i));
+                isSame = (json.toByteArray( JsonWax::Compact, false, {"n"}) == QVariant( numbers.at(i)).toString().toLatin1());
+            }
+            checkWax( isSame, description, passCount, failCount);
+            loaded.fromByteArray( json.toByteArray( JsonWax::Compact, false, {"g"}).prepend('[').append(']'));
+            checkWax( loaded.value({0}).toULongLong() == 18446744073709551615ULL, description, passCount, failCount);
+        }
+
+        {
+            QByteArray text = "{\"records\":[";
+            for (int i = 0; i < 20000; ++i)
+                text += "{\"id\":" + QByteArray::number(i) + ",\"name\":\"n\\\"\xc3\xa9 " + QByteArray::number(i) + "\",\"tags\":[\"a\",{\"b\":0.5}]},";
+            text.chop(1);
+            text += "],\"numbers\":[";
+            for (int i = 0; i < 60000; ++i)
+                text += QByteArray::number(i * 3) + ",";
+            text.chop(1);
+            text += "],\"small\":{\"x\":[1,2]}}";
+
+            JsonWax json;
+            json.fromByteArray( text);
+            json.setValue({"sparse",70000}, "end");
+            JsonWax parallel;
+            parallel.fromByteArray( text);
+            parallel.setValue({"sparse",70000}, "end");
+            parallel.setParallel( true);
+
+            QString description = "setParallel: the same text as without threads.";
+            QByteArray compact = json.toByteArray( JsonWax::Compact);
+            QByteArray readable = json.toByteArray( JsonWax::Readable);
+            checkWax( parallel.toByteArray( JsonWax::Compact) == compact && parallel.toByteArray( JsonWax::Readable) == readable, description, passCount, failCount);
+            checkWax( parallel.toByteArray( JsonWax::Compact, true) == json.toByteArray( JsonWax::Compact, true)
+                      && parallel.toString( JsonWax::Readable) == json.toString( JsonWax::Readable), description, passCount, failCount);
+            checkWax( parallel.toByteArray( JsonWax::Compact, false, {"records"}) == json.toByteArray( JsonWax::Compact, false, {"records"}), description, passCount, failCount);
+
+            description = "setParallel: cached parts and later changes.";
+            json.setValue({"records",12345,"tags",1,"b"}, "changed");
+            parallel.setValue({"records",12345,"tags",1,"b"}, "changed");
+            compact = json.toByteArray( JsonWax::Compact);
+            checkWax( parallel.toByteArray( JsonWax::Compact) == compact && parallel.toByteArray( JsonWax::Compact) == compact
+                      && compact.contains( "\"b\":\"changed\""), description, passCount, failCount);
+
+            description = "setParallel: write() and saveAs().";
+            QBuffer buffer;
+            buffer.open( QIODevice::WriteOnly);
+            checkWax( parallel.write( &buffer, JsonWax::Compact) && buffer.data() == compact, description, passCount, failCount);
+            QString fileName = QDir::tempPath() + "/jsonwax_parallel_test.json";
+            QFile::remove( fileName);
+            parallel.saveAs( fileName, JsonWax::Readable);
+            QFile file( fileName);
+            file.open( QIODevice::ReadOnly);
+            checkWax( file.readAll() == json.toByteArray( JsonWax::Readable), description, passCount, failCount);
+            file.close();
+            QFile::remove( fileName);
+
+            description = "setParallel: kept after loading another document.";
+            parallel.fromByteArray( text);
+            json.fromByteArray( text);
+            checkWax( parallel.toByteArray( JsonWax::Readable) == json.toByteArray( JsonWax::Readable), description, passCount, failCount);
+        }
+
+        {
+            JsonWax json;
+            for (int i = 0; i < 10; ++i)
+                json.setValue({"packed",i}, i * 10);
+            json.setValue({"sparse",500}, 7);
+            json.setValue({"plain","x"}, 20);
+            QString description = "packed elements and holes: read as values, without an element of their own.";
+            checkWax( json.value({"packed",3}) == 30 && json.type({"packed",9}) == JsonWax::Value && json.size({"packed",2}) == 1
+                      && json.isNullValue({"sparse",3}) && json.exists({"sparse",3}) && !json.exists({"packed",10}), description, passCount, failCount);
+            checkWax( json.memoryUsage({"packed",0}) == 0 && json.memoryUsage({"sparse",3}) == 0, description, passCount, failCount);
+            checkWax( json.toByteArray( JsonWax::Compact, false, {"packed",2}) == "20" && json.toCbor({"packed",2}).toHex() == "14"
+                      && json.toMessagePack({"sparse",3}).toHex() == "c0", description, passCount, failCount);
+
+            description = "packed elements and holes: compared and hashed by value.";
+            checkWax( json.equals({"packed",2}, json, {"plain","x"}) && !json.equals({"packed",1}, json, {"packed",2})
+                      && json.equals({"sparse",3}, json, {"sparse",4}), description, passCount, failCount);
+            checkWax( json.hash({"packed",2}) == json.hash({"plain","x"}) && json.hash({"packed",1}) != json.hash({"packed",2}), description, passCount, failCount);
+
+            description = "packed elements and holes: queried, copied and moved.";
+            checkWax( json.queryValues( JsonWax::JsonPath("$.packed[?(@ > 50)]")) == QVariantList({60,70,80,90})
+                      && json.query( JsonWax::JsonPath("$.sparse[?(@ == 7)]")) == QList<QVariantList>({{"sparse",500}}), description, passCount, failCount);
+            json.copy({"packed",4}, {"copied"});
+            json.move({"packed",0}, {"moved"});
+            checkWax( json.value({"copied"}) == 40 && json.value({"moved"}) == 0 && json.isNullValue({"packed",0}), description, passCount, failCount);
+
+            description = "packed elements and holes: diffed by value.";
+            JsonWax target;
+            target.fromByteArray( json.toByteArray());
+            target.setValue({"packed",5}, 55);
+            target.setValue({"sparse",3}, "filled");
+            JsonWax::Patch patch = json.diff( target);
+            checkWax( patch.size() == 2 && json.applyPatch( patch) && json.equals( target), description, passCount, failCount);
+        }
+
         qDebug() << "---------------------------------------------";
         qDebug() << "=====    Editor tests PASSED: " << passCount;
         qDebug() << "=====    Editor tests FAILED: " << failCount;